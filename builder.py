@@ -85,6 +85,24 @@ class ConfigHeaderExtractor(Extractor):
     def ENABLE_BENCHMARK(self):
         return self.jq('.debug.benchmark', False, c_bool=True)
 
+    @property
+    def TRACE_EVENTS(self):
+        return self.jq('.debug.trace_events', 256)
+
+    @property
+    def DLOG_RECORDS(self):
+        if not self.jq('.debug.deferred', False):
+            return 0
+        return self.jq('.debug.deferred_records', 256)
+
+    @property
+    def HEAP_PROFILER_SLOTS(self):
+        return self.jq('.debug.heap_profiler_slots', 0)
+
+    @property
+    def LOOP_STALL_THRESHOLD_MICROS(self):
+        return self.jq('.debug.loop_stall_threshold', 4000)
+
     @property
     def BOARD_TYPE(self):
         return BOARD_TYPES[self.jq('.board.type', 'generic')]
@@ -200,6 +218,22 @@ class ConfigHeaderExtractor(Extractor):
     def WS_PING_INTERVAL(self):
         return self.jq('.ws.ping_interval', 300)
 
+    @property
+    def UART_STREAM_MAX_CLIENTS(self):
+        return self.jq('.http.uart_stream.max_clients', 2)
+
+    @property
+    def UART_STREAM_BUF_SIZE(self):
+        return self.jq('.http.uart_stream.buffer_size', 4096)
+
+    @property
+    def UART_EXEC_OUTPUT_MAX(self):
+        return self.jq('.http.exec.output_max', 4096)
+
+    @property
+    def UART_EXEC_TIMEOUT_MAX_MILLIS(self):
+        return self.jq('.http.exec.timeout_max', 60000)
+
     @property
     def TTYD_WEB_CONFIG(self):
         cfg = self.jq('.ttyd.web_config', None) or {"disableLeaveAlert": True}
@@ -269,6 +303,46 @@ class ConfigHeaderExtractor(Extractor):
         jq = self.jq('.board.target', [])
         return '%s' % len(jq)
 
+    @property
+    def AUTORESPONDER_MAX_RULES(self):
+        return self.jq('.uart.autoresponder.max_rules', 4)
+
+    @property
+    def AUTORESPONDER_RESPONSE_MAX_LEN(self):
+        return self.jq('.uart.autoresponder.response_max_len', 32)
+
+    @property
+    def AUTORESPONDER_HOLDOVER_SIZE(self):
+        return self.jq('.uart.autoresponder.holdover_size', 512)
+
+    @property
+    def UART_CAPTURE_MAX_TRIGGERS(self):
+        return self.jq('.uart.capture.max_triggers', 4)
+
+    @property
+    def UART_CAPTURE_SLOTS(self):
+        return self.jq('.uart.capture.slots', 2)
+
+    @property
+    def UART_CAPTURE_HISTORY_SIZE(self):
+        return self.jq('.uart.capture.history_size', 2048)
+
+    @property
+    def UART_CAPTURE_SLOT_MAX_SIZE(self):
+        return self.jq('.uart.capture.slot_max_size', 4096)
+
+    @property
+    def UART_LOSS_MARKER(self):
+        return self.jq('.uart.loss_marker', False, c_bool=True)
+
+    @property
+    def SCROLLBACK_SIZE(self):
+        return self.jq('.uart.scrollback.size', 0)
+
+    @property
+    def SCROLLBACK_BLOCK_SIZE(self):
+        return self.jq('.uart.scrollback.block_size', 2048)
+
     @property
     def UART_RX_BUF_SIZE(self):
         return self.jq('.uart.advanced.rx_buf_size', 10240)
@@ -328,6 +402,10 @@ class PlatformIOExtractor(Extractor):
     def atomic_ota(self):
         return self.jq('.ota.atomic', True)
 
+    @property
+    def heap_profiler(self):
+        return self.jq('.debug.heap_profiler_slots', 0) > 0
+
     @property
     def board_type(self):
         board = self.jq('.board.type', 'generic')
@@ -540,9 +618,22 @@ class Builder:
         shutil.copytree(*srcdirs, symlinks=True, dirs_exist_ok=True)
         shutil.copytree(*includedirs, symlinks=True, dirs_exist_ok=True)
 
+    def gen_dlog_table(self):
+        # Format strings for tools/dlog.py, to decode deferred debug messages from this build
+        table = os.path.join(self.builder_dir, "dlog_table.json")
+        if self.header_extr.DLOG_RECORDS == 0:
+            # Deferred logging is off, don't leave behind the table of a previous build
+            if os.path.exists(table):
+                os.remove(table)
+            return
+        subprocess.run([sys.executable, os.path.join(git_toplevel_dir(), "tools", "dlog.py"), "table",
+                        "-o", table,
+                        os.path.join(self.builder_dir, "src"), os.path.join(self.builder_dir, "include")], check=True)
+
     def prepare(self):
         self.prepare_sources()
         self.gen_configs(self.builder_dir)
+        self.gen_dlog_table()
 
     def build(self) -> None:
         self.prepare()
@@ -15,6 +15,20 @@
 // Prints a bunch of timing measurements to debug UART.
 #define ENABLE_BENCHMARK {{ cfg.ENABLE_BENCHMARK }}
 
+// Events kept by the flight recorder (GET /trace), 16 bytes each. Must be a power of 2, 0 disables it.
+#define TRACE_EVENTS {{ cfg.TRACE_EVENTS }}
+
+// When not 0, debug messages aren't printed but stored in binary form in a ring of this many records (32 bytes each,
+// GET /dlog), to be formatted by tools/dlog.py. Must be a power of 2.
+#define DLOG_RECORDS {{ cfg.DLOG_RECORDS }}
+
+// Live heap allocations tracked by the heap profiler (GET /heap/profile), 12 bytes each. Must be a power of 2, 0 disables
+// it. Requires linking with -Wl,--wrap for malloc(), free(), realloc() and calloc().
+#define HEAP_PROFILER_SLOTS {{ cfg.HEAP_PROFILER_SLOTS }}
+
+// Main loop iterations longer than this (microseconds) are reported as stalls by /profile, 0 disables it.
+#define LOOP_STALL_THRESHOLD_MICROS {{ cfg.LOOP_STALL_THRESHOLD_MICROS }}
+
 // Available board types:
 // - 0: generic ESP8266 boards
 // - 1: wi-se-rpi-v0.1
@@ -73,6 +87,16 @@
 #define WS_MAX_CLIENTS {{ cfg.WS_MAX_CLIENTS }}
 #define WS_PING_INTERVAL {{ cfg.WS_PING_INTERVAL }}
 
+// UART output streaming over plain HTTP (GET /uart/stream).
+// Each stream client gets its own buffer of UART_STREAM_BUF_SIZE bytes, allocated on connection.
+#define UART_STREAM_MAX_CLIENTS {{ cfg.UART_STREAM_MAX_CLIENTS }}
+#define UART_STREAM_BUF_SIZE {{ cfg.UART_STREAM_BUF_SIZE }}
+
+// Expect-style command execution (POST /exec).
+// The output buffer is allocated only while a command is running.
+#define UART_EXEC_OUTPUT_MAX {{ cfg.UART_EXEC_OUTPUT_MAX }}
+#define UART_EXEC_TIMEOUT_MAX_MILLIS {{ cfg.UART_EXEC_TIMEOUT_MAX_MILLIS }}
+
 // Web TTY configuration.
 // You can specify any option documented here: https://xtermjs.org/docs/api/terminal/interfaces/iterminaloptions
 // Make sure it is a valid JSON and that it's also a valid C string.
@@ -102,6 +126,28 @@
 #define TARGET_GPIO_LOCKED 3
 #define TARGET_GPIO_UNLOCKED 4
 
+// On-device responder for UART prompts (managed through /autoresponder).
+// Patterns of all rules share a 32 bytes budget.
+#define AUTORESPONDER_MAX_RULES {{ cfg.AUTORESPONDER_MAX_RULES }}
+#define AUTORESPONDER_RESPONSE_MAX_LEN {{ cfg.AUTORESPONDER_RESPONSE_MAX_LEN }}
+// UART output read ahead for the rules while it can't be sent (slow clients, low heap), allocated while rules exist.
+#define AUTORESPONDER_HOLDOVER_SIZE {{ cfg.AUTORESPONDER_HOLDOVER_SIZE }}
+
+// Pattern-triggered capture (managed through /capture/triggers, downloaded from /capture).
+// The history holds the pre-trigger window and is allocated while triggers are defined, slots when they're hit.
+#define UART_CAPTURE_MAX_TRIGGERS {{ cfg.UART_CAPTURE_MAX_TRIGGERS }}
+#define UART_CAPTURE_SLOTS {{ cfg.UART_CAPTURE_SLOTS }}
+#define UART_CAPTURE_HISTORY_SIZE {{ cfg.UART_CAPTURE_HISTORY_SIZE }}
+#define UART_CAPTURE_SLOT_MAX_SIZE {{ cfg.UART_CAPTURE_SLOT_MAX_SIZE }}
+
+// Print a marker in the web terminal where UART output was lost because of overruns.
+#define UART_LOSS_MARKER {{ cfg.UART_LOSS_MARKER }}
+
+// Compressed scrollback (GET /scrollback), 0 disables it.
+// Besides SCROLLBACK_SIZE, it takes two blocks and 1 KB of scratch space.
+#define SCROLLBACK_SIZE {{ cfg.SCROLLBACK_SIZE }}
+#define SCROLLBACK_BLOCK_SIZE {{ cfg.SCROLLBACK_BLOCK_SIZE }}
+
 // Advanced buffering parameters:
 // Tweak if you feel brave. Report any improvements, but make sure you test them at 1500000 8N1 and that it works better
 // than the defaults before submitting.
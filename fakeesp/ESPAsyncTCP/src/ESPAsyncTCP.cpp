@@ -75,6 +75,7 @@ yield(), etc.
 #include "async_config.h"
 #include <lwip/err.h>
 #include <Arduino.h>
+#include <Reactor.h>
 #include <cstdio>
 #include <cerrno>
 #include <cstdlib>
@@ -86,6 +87,14 @@ extern "C" {
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
+#include <FakeHeap.h>
+
+// TCP_SND_BUF of the ESP8266 with PIO_FRAMEWORK_ARDUINO_LWIP_HIGHER_BANDWIDTH
+#define FAKE_HEAP_TCP_WINDOW 5840
 }
 
 void setNonBlocking(int sock_fd) {
@@ -145,8 +154,8 @@ err_t ACErrorTracker::getCallbackCloseError(void) {
   Async TCP Client
 */
 
-void callAsyncClientDelayCallback(AsyncClient *obj) {
-    obj->onDelayCB();
+void callAsyncClientReactorCallback(void *arg, uint32_t events) {
+    reinterpret_cast<AsyncClient *>(arg)->onReactorEvent(events);
 }
 
 AsyncClient::AsyncClient(int sock_fd) :
@@ -160,10 +169,26 @@ AsyncClient::AsyncClient(int sock_fd) :
     _errorTracker = std::make_shared<ACErrorTracker>(this);
 
     sockState = 4;
-    delayCallbackId = registerOnDelayCallback(reinterpret_cast<void (*)(void *)>(callAsyncClientDelayCallback),
-                                              (void *) this);
-    if (delayCallbackId < 0) {
-        fprintf(stderr, "Failed to bind on delay callback\n");
+
+    int sndbuf = 0;
+    socklen_t optlen = sizeof(sndbuf);
+    if (getsockopt(sock_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) < 0 || sndbuf <= 0) {
+        sndbuf = TCP_MSS * 2;
+    }
+    sendWindow = sndbuf;
+    // e.g. FAKEESP_TCP_WINDOW=5840 for the TCP_SND_BUF of the ESP8266 with PIO_FRAMEWORK_ARDUINO_LWIP_HIGHER_BANDWIDTH
+    const char *window = getenv("FAKEESP_TCP_WINDOW");
+    if (window != nullptr && atoi(window) > 0) {
+        sendWindow = std::min(sendWindow, (size_t) atoi(window));
+    } else if (fakeHeapIsEnabled()) {
+        // txBuf comes from the emulated heap, a Linux sized window wouldn't fit in it
+        sendWindow = std::min(sendWindow, (size_t) FAKE_HEAP_TCP_WINDOW);
+    }
+    updateSendWindow(sendWindow);
+
+    reactorId = reactorAdd(sock_fd, EPOLLIN, callAsyncClientReactorCallback, (void *) this);
+    if (reactorId < 0) {
+        fprintf(stderr, "Failed to add client socket to the reactor\n");
         panic();
     }
 
@@ -172,6 +197,7 @@ AsyncClient::AsyncClient(int sock_fd) :
 AsyncClient::~AsyncClient() {
     close(true);
     _errorTracker->clearClient();
+    delete[] txBuf;
 }
 
 inline void clearTcpCallbacks(tcp_pcb *pcb) {
@@ -244,33 +270,147 @@ size_t AsyncClient::add(const char *data, size_t size, uint8_t apiflags) {
     if (sock_fd < 0 || sockErrno != 0 || size == 0 || data == nullptr)
         return 0;
 
-    ssize_t sent = ::send(sock_fd, data, size, MSG_NOSIGNAL);
-    if (sent == -1) {
-        if (errno != EWOULDBLOCK) {
-            sockErrno = errno;
+    // Like lwIP, take as much as fits in the window and always copy it, callers free the buffer right away
+    size_t will_add = std::min(size, space());
+    if (will_add == 0) {
+        return 0;
+    }
+    if (txBuf == nullptr) {
+        txBufSize = sendWindow;
+        txBuf = new char[txBufSize];
+    }
+    size_t tail = (txHead + txLen) % txBufSize;
+    size_t first = std::min(will_add, txBufSize - tail);
+    memcpy(txBuf + tail, data, first);
+    memcpy(txBuf, data + first, will_add - first);
+    txLen += will_add;
+    return will_add;
+}
+
+bool AsyncClient::send() {
+    if (sock_fd < 0 || sockErrno != 0) {
+        return false;
+    }
+    flushTx();
+    updateWantWritable();
+    return true;
+}
+
+static void onFakeNetRelease(void *arg) {
+    auto *client = reinterpret_cast<AsyncClient *>(arg);
+    client->flushTx();
+    client->updateWantWritable();
+}
+
+void AsyncClient::flushTx() {
+    bool impaired = fakeNetEnabled();
+    uint64_t now = 0;
+    uint64_t retryAt = 0;
+    if (impaired) {
+        now = micros64();
+        segmentTx(now);
+    } else {
+        // Whatever the impairment was holding, if it's just been switched off, goes now
+        txSegmentsHead = txSegmentsLen = 0;
+        txSegmentedLen = 0;
+    }
+
+    bool kernelFull = false;
+    while (txLen > 0 && sock_fd >= 0) {
+        size_t allowed = impaired ? releasableTx(now, &retryAt) : txLen;
+        if (allowed == 0) {
+            break;
         }
-        if (errno == EWOULDBLOCK) {
-            return 0;  // Send later
-        } else if (errno == ECONNRESET) {
-            sockState = 0;
-            _s_error(this, ERR_RST);
-            return 0;
-        }else if (errno == EPIPE) {
-            perror("EPIPE");
-            if (sockState != 0) {
-                _s_error(this, ERR_RST);
+        // The WebSocket frame header and its payload were added separately, they leave together
+        size_t first = std::min(allowed, txBufSize - txHead);
+        iovec iov[2] = {{txBuf + txHead, first}, {txBuf, allowed - first}};
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = allowed > first ? 2 : 1;
+        ssize_t sent = ::sendmsg(sock_fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EWOULDBLOCK) {
+                // The error is picked up by recv() when epoll reports EPOLLERR/EPOLLHUP, we may be inside a
+                // library call here and it's not safe to call the error callbacks
+                txLen = 0;
+                txSegmentsHead = txSegmentsLen = 0;
+                txSegmentedLen = 0;
             }
-        } else {
-            perror("Failed sending to socket");
-            return 0;
+            kernelFull = true;
+            break;
         }
+        txHead = (txHead + sent) % txBufSize;
+        txLen -= sent;
+        sentBytesForCallback += sent;
+        if (impaired) {
+            fakeNetConsume(sent);
+            consumeTxSegments(sent);
+        }
+    }
+    if (txLen == 0) {
+        txHead = 0;
+    }
+
+    txHeld = impaired && txLen > 0 && !kernelFull && sock_fd >= 0;
+    if (txHeld) {
+        fakeNetSchedule(onFakeNetRelease, this, retryAt);
     }
-    sentBytesForCallback += sent;
-    return sent;
 }
 
-bool AsyncClient::send() {
-    return true;
+void AsyncClient::updateSendWindow(size_t window) {
+    if (window == effectiveSendWindow) {
+        return;
+    }
+    effectiveSendWindow = window;
+    // Otherwise Linux would report the socket as writable long before space() is not 0 anymore
+    int lowat = (int) window;
+    setsockopt(sock_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+}
+
+void AsyncClient::segmentTx(uint64_t now) {
+    size_t len = txLen - txSegmentedLen;
+    if (len == 0) {
+        return;
+    }
+    txSegmentedLen += len;
+    if (txSegmentsLen == FAKENET_MAX_SEGMENTS) {
+        // Leaves with the last one, like data queued behind a full lwIP queue
+        txSegments[(txSegmentsHead + txSegmentsLen - 1) % FAKENET_MAX_SEGMENTS].len += len;
+        return;
+    }
+    uint64_t notBefore = txSegmentsLen > 0 ? txSegments[(txSegmentsHead + txSegmentsLen - 1) % FAKENET_MAX_SEGMENTS].releaseAt : 0;
+    txSegments[(txSegmentsHead + txSegmentsLen) % FAKENET_MAX_SEGMENTS] = {len, fakeNetReleaseTime(now, notBefore)};
+    txSegmentsLen++;
+}
+
+size_t AsyncClient::releasableTx(uint64_t now, uint64_t *retryAt) {
+    size_t due = 0;
+    for (uint8_t i = 0; i < txSegmentsLen; i++) {
+        const TxSegment &segment = txSegments[(txSegmentsHead + i) % FAKENET_MAX_SEGMENTS];
+        if (segment.releaseAt > now) {
+            *retryAt = segment.releaseAt;
+            break;
+        }
+        due += segment.len;
+    }
+    return due > 0 ? fakeNetAvailable(now, due, retryAt) : 0;
+}
+
+void AsyncClient::consumeTxSegments(size_t len) {
+    txSegmentedLen -= len;
+    while (len > 0 && txSegmentsLen > 0) {
+        TxSegment &segment = txSegments[txSegmentsHead];
+        size_t taken = std::min(len, segment.len);
+        segment.len -= taken;
+        len -= taken;
+        if (segment.len == 0) {
+            txSegmentsHead = (txSegmentsHead + 1) % FAKENET_MAX_SEGMENTS;
+            txSegmentsLen--;
+        }
+    }
 }
 
 size_t AsyncClient::ack(size_t len) {
@@ -285,14 +425,21 @@ void AsyncClient::_connected(std::shared_ptr<ACErrorTracker> &errorTracker, void
 
 void AsyncClient::_close() {
     sockState = 0;
+    txLen = 0;
+    txSegmentsHead = txSegmentsLen = 0;
+    txSegmentedLen = 0;
+    txHeld = false;
+    fakeNetCancel(this);
+    sentBytesForCallback = 0;
+    waitingForSpace = false;
+    if (reactorId >= 0) {
+        reactorRemove(reactorId);
+        reactorId = -1;
+    }
     if (sock_fd >= 0) {
         ::close(sock_fd);
         sock_fd = -1;
     }
-    if (delayCallbackId >= 0) {
-        deregisterOnDelayCallback(delayCallbackId);
-        delayCallbackId = -1;
-    }
 }
 
 void AsyncClient::_error(err_t err) {
@@ -319,17 +466,51 @@ void AsyncClient::_sent(std::shared_ptr<ACErrorTracker> &errorTracker, tcp_pcb *
 void AsyncClient::_recv(std::shared_ptr<ACErrorTracker> &errorTracker, tcp_pcb *pcb, pbuf *pb, err_t err) {
 }
 
-void AsyncClient::onDelayCB() {
+void AsyncClient::setWantWritable(bool want) {
+    if (want == wantWritable || reactorId < 0) {
+        return;
+    }
+    wantWritable = want;
+    reactorModify(reactorId, want ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+void AsyncClient::updateWantWritable() {
+    // Leaving EPOLLOUT on with nothing to do would wake epoll over and over
+    setWantWritable(sentBytesForCallback > 0 || ((txLen > 0 || waitingForSpace) && !txHeld));
+}
+
+void AsyncClient::onReactorEvent(uint32_t events) {
     if (!connected() || sockErrno != 0 || sock_fd == -1) {
         return;
     }
 
-    while (sentBytesForCallback > 0) {
-        // That bitch of a library sends more stuff in the onAck handler, we need to back up the variable so we don't
-        // zero it and lock up websockets
-        uint64_t sentTemp = sentBytesForCallback;
-        sentBytesForCallback = 0;
-        _sent(_errorTracker, nullptr, sentTemp);
+    if (events & EPOLLOUT) {
+        // The callbacks may delete this client
+        std::shared_ptr<ACErrorTracker> errorTracker = _errorTracker;
+        flushTx();
+        // Bytes count as acked once the kernel took them. That bitch of a library sends more stuff in the onAck
+        // handler, so the counter is zeroed before calling it.
+        while (sentBytesForCallback > 0) {
+            auto sentTemp = (uint16_t) std::min(sentBytesForCallback, (uint64_t) UINT16_MAX);
+            sentBytesForCallback -= sentTemp;
+            _sent(errorTracker, nullptr, sentTemp);
+            if (!errorTracker->hasClient() || sock_fd == -1) {
+                return;
+            }
+        }
+        if (waitingForSpace && space() > 0) {
+            // The library found no space earlier, let it retry
+            waitingForSpace = false;
+            _poll(errorTracker, nullptr);
+            if (!errorTracker->hasClient() || sock_fd == -1) {
+                return;
+            }
+        }
+        updateWantWritable();
+    }
+
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        return;
     }
 
     ssize_t recvd = ::recv(sock_fd, tempBuf, sizeof(tempBuf), 0);
@@ -374,7 +555,7 @@ void AsyncClient::onDelayCB() {
 }
 
 void AsyncClient::_poll(std::shared_ptr<ACErrorTracker> &errorTracker, tcp_pcb *pcb) {
-    if (sockState == 4) {
+    if (sockState == 4 && _poll_cb) {
         errorTracker->setCloseError(ERR_OK);
         _poll_cb(_poll_cb_arg, this);
     }
@@ -541,7 +722,7 @@ bool AsyncClient::freeable() {
 }
 
 bool AsyncClient::canSend() {
-    return true;
+    return space() > 0;
 }
 
 
@@ -594,8 +775,27 @@ void AsyncClient::onPoll(AcConnectHandler cb, void *arg) {
 
 
 size_t AsyncClient::space() {
-    return 99999;
-    return 0;
+    if (sock_fd < 0 || sockState != 4) {
+        return 0;
+    }
+    size_t window = sendWindow;
+    if (fakeNetSendBufferCap() > 0) {
+        window = std::min(window, fakeNetSendBufferCap());
+    }
+    updateSendWindow(window);
+    // Like tcp_sndbuf(): the window minus what hasn't left yet, both here and in the kernel
+    int unsent = 0;
+    if (ioctl(sock_fd, SIOCOUTQNSD, &unsent) < 0) {
+        unsent = 0;
+    }
+    size_t used = txLen + unsent;
+    if (used >= window) {
+        // We'll get EPOLLOUT when the kernel sent enough of it, or when the impairment lets some of it out
+        waitingForSpace = true;
+        updateWantWritable();
+        return 0;
+    }
+    return window - used;
 }
 
 void AsyncClient::ackPacket(struct pbuf *pb) {
@@ -695,7 +895,7 @@ void AsyncServer::onClient(AcConnectHandler cb, void *arg) {
     _connect_cb_arg = arg;
 }
 
-void AsyncServer::onDelayCB() {
+void AsyncServer::onReactorEvent(uint32_t events) {
     int client_fd = accept(sock_fd, NULL, NULL);
     if (client_fd == -1) {
         if (errno == EWOULDBLOCK) {
@@ -711,8 +911,8 @@ void AsyncServer::onDelayCB() {
     }, this);
 }
 
-void callAsyncServerDelayCallback(AsyncServer *obj) {
-    obj->onDelayCB();
+void callAsyncServerReactorCallback(void *arg, uint32_t events) {
+    reinterpret_cast<AsyncServer *>(arg)->onReactorEvent(events);
 }
 
 void AsyncServer::begin() {
@@ -720,6 +920,7 @@ void AsyncServer::begin() {
     sprintf(buf, "%d.%d.%d.%d", _addr[0], _addr[1], _addr[2], _addr[3]);
     printf("%d.%d.%d.%d port %d\n", _addr[0], _addr[1], _addr[2], _addr[3], _port);
 
+    serv_addr.sin_family = AF_INET;
     serv_addr.sin_port = htons(_port);
     inet_aton(buf, &serv_addr.sin_addr);
 
@@ -741,24 +942,25 @@ void AsyncServer::begin() {
         panic();
     }
     listen(sock_fd, 10);
+    // Reads FAKEESP_NET now rather than on the first send, so that the profile in use is logged at startup
+    fakeNetEnabled();
     char tempIpAddr[20];
     _addr.toString().toCharArray(tempIpAddr, 20, 0);
     fprintf(stderr, "Listening on %s port %d\n", tempIpAddr, _port);
     sockState = 1;
-    delayCallbackId = registerOnDelayCallback(reinterpret_cast<void (*)(void *)>(callAsyncServerDelayCallback),
-                                              (void *) this);
-    if (delayCallbackId < 0) {
-        fprintf(stderr, "Failed to bind on delay callback\n");
+    reactorId = reactorAdd(sock_fd, EPOLLIN, callAsyncServerReactorCallback, (void *) this);
+    if (reactorId < 0) {
+        fprintf(stderr, "Failed to add server socket to the reactor\n");
         panic();
     }
 }
 
 
 void AsyncServer::end() {
-    if (delayCallbackId >= 0) {
-        deregisterOnDelayCallback(delayCallbackId);
+    if (reactorId >= 0) {
+        reactorRemove(reactorId);
     }
-    delayCallbackId = -1;
+    reactorId = -1;
     if (sock_fd >= 0) {
         ::close(sock_fd);
     }
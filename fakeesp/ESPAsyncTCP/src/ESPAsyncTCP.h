@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <FakeNet.h>
 
 extern "C" {
     #include "lwip/init.h"
@@ -108,9 +109,35 @@ class AsyncClient {
     friend class AsyncServer;
 
     int sock_fd;
-    int32_t delayCallbackId = -1;
+    int32_t reactorId = -1;
     uint8_t sockState = 0;
+    // Taken by the kernel, to be reported to the ack callback on the next EPOLLOUT
     uint64_t sentBytesForCallback = 0;
+    // Waiting for EPOLLOUT, to flush txBuf, report sent bytes or tell the library there's space() again
+    bool wantWritable = false;
+    bool waitingForSpace = false;
+    // Data add()ed but not taken by the kernel yet, ring buffer
+    char *txBuf = nullptr;
+    size_t txBufSize = 0;
+    size_t txHead = 0;
+    size_t txLen = 0;
+    // SO_SNDBUF when the connection was accepted. It's also set as TCP_NOTSENT_LOWAT, so that the socket is writable
+    // exactly when space() is not 0.
+    size_t sendWindow = 0;
+    // sendWindow or what the network impairment caps it to, the current TCP_NOTSENT_LOWAT
+    size_t effectiveSendWindow = 0;
+    // With the network impairment (FakeNet.h) the data in txBuf is split in segments, one per send(), each leaving
+    // when the emulated link would have delivered it. The bytes after txSegmentedLen were add()ed after the last one.
+    struct TxSegment {
+        size_t len;
+        uint64_t releaseAt;
+    };
+    TxSegment txSegments[FAKENET_MAX_SEGMENTS] = {};
+    uint8_t txSegmentsHead = 0;
+    uint8_t txSegmentsLen = 0;
+    size_t txSegmentedLen = 0;
+    // The impairment is holding data back, it calls flushTx() when it can leave, EPOLLOUT would only spin
+    bool txHeld = false;
     uint64_t fakePollLastSentMillis = 0;
 public:
     uint8_t undersmashDet = 0xaa;
@@ -242,7 +269,15 @@ private:
     void _recv(std::shared_ptr<ACErrorTracker>& closeAbort, tcp_pcb* pcb, pbuf* pb, err_t err);
     err_t getCloseError(void) const { return _errorTracker->getCloseError();}
 
-    void onDelayCB();
+    void onReactorEvent(uint32_t events);
+    void setWantWritable(bool want);
+    void updateWantWritable();
+    // Hands txBuf to the kernel with writev(), as much as it takes and the network impairment lets out.
+    void flushTx();
+    void updateSendWindow(size_t window);
+    void segmentTx(uint64_t now);
+    size_t releasableTx(uint64_t now, uint64_t *retryAt);
+    void consumeTxSegments(size_t len);
 };
 
 class AsyncServer {
@@ -254,7 +289,7 @@ class AsyncServer {
 
     int sock_fd = 0;
     sockaddr_in serv_addr = {0};
-    int32_t delayCallbackId = -1;
+    int32_t reactorId = -1;
     uint8_t sockState = 0;
 
 public:
@@ -269,7 +304,7 @@ public:
     bool getNoDelay();
     uint8_t status();
 
-    void onDelayCB();
+    void onReactorEvent(uint32_t events);
 
 protected:
     err_t _accept(tcp_pcb* newpcb, err_t err);
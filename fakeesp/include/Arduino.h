@@ -5,8 +5,6 @@
 #ifndef WI_SE_SW_ARDUINO_H
 #define WI_SE_SW_ARDUINO_H
 
-//#define SIMULATE_BAUDRATE
-
 #include <cstdint>
 #include <cstdarg>
 #include <algorithm>
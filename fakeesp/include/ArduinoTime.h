@@ -21,10 +21,11 @@ void delayMicrosecondsNoYield(unsigned int us);
 
 void yield();
 
-int32_t registerOnDelayCallback(void (*callback)(void *arg), void *arg);
+// With FAKEESP_VIRTUAL_TIME=1 time only moves when the firmware waits: delays skip ahead instead of sleeping, and when
+// there's nothing to do until a deadline the reactor jumps straight to it. Otherwise it's the wall clock.
+bool virtualTimeEnabled();
 
-void deregisterOnDelayCallback(uint32_t id);
-
-void callOnDelayCallbacks();
+// Moves the virtual clock forward, does nothing with the wall clock.
+void virtualTimeAdvance(uint64_t us);
 
 #endif //WI_SE_SW_ARDUINOTIME_H
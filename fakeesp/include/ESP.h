@@ -9,10 +9,11 @@
 #include <stdio.h>
 #include <algorithm>
 #include "WString.h"
+#include "FakeHeap.h"
 
 class FakeESP {
 public:
-    uint32_t getFreeHeap() { return 999999; }
+    uint32_t getFreeHeap() { return fakeHeapGetFree(); }
     uint16_t getVcc() { return 3300; }
     String getFullVersion() {
         return String("Totally an ESP8266");
@@ -36,7 +37,11 @@ public:
     }
 
     uint8_t getHeapFragmentation() {
-        return 1;
+        return fakeHeapGetFragmentation();
+    }
+
+    uint32_t getMaxFreeBlockSize() {
+        return fakeHeapGetMaxFreeBlockSize();
     }
 };
 
@@ -0,0 +1,61 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_FAKEGPIO_H
+#define WI_SE_SW_FAKEGPIO_H
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of the file the GPIO state is shared through (FAKEESP_GPIO_FILE, /dev/shm/fakeesp_gpio by default). Both
+// fakeesp and the fakeesp_gpio tool map it, so it's only plain data and lock-free atomics.
+#define FAKEESP_GPIO_MAGIC   0x4f495047 // "GPIO"
+#define FAKEESP_GPIO_VERSION 1
+#define FAKEESP_GPIO_PINS    17
+
+// pinMode() hasn't been called for the pin
+#define FAKEESP_GPIO_MODE_UNSET 42
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "GPIO state can't be shared between processes");
+
+struct FakeGpioShared {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pinCount;
+
+    // Seqlock over modes and values, only fakeesp writes them. Odd while they're being updated: readers copy them and
+    // retry if it was odd or changed meanwhile. It also counts the updates, two per change.
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint8_t> modes[FAKEESP_GPIO_PINS];
+    // 0 or 1, 0-255 for PWM
+    std::atomic<int32_t> values[FAKEESP_GPIO_PINS];
+
+    // Written by other processes to drive input pins. digitalRead() returns driveValues[pin] for the pins whose bit is
+    // set in driveMask, the last value written by the firmware otherwise.
+    std::atomic<uint32_t> driveMask;
+    std::atomic<int32_t> driveValues[FAKEESP_GPIO_PINS];
+};
+
+struct FakeGpioSnapshot {
+    uint32_t sequence;
+    uint8_t modes[FAKEESP_GPIO_PINS];
+    int32_t values[FAKEESP_GPIO_PINS];
+};
+
+static inline void fakeGpioReadSnapshot(const FakeGpioShared *shared, FakeGpioSnapshot *snapshot) {
+    uint32_t before;
+    uint32_t after;
+    do {
+        before = shared->sequence.load(std::memory_order_acquire);
+        for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+            snapshot->modes[i] = shared->modes[i].load(std::memory_order_relaxed);
+            snapshot->values[i] = shared->values[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = shared->sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    snapshot->sequence = before;
+}
+
+#endif //WI_SE_SW_FAKEGPIO_H
@@ -0,0 +1,38 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_FAKEHEAP_H
+#define WI_SE_SW_FAKEHEAP_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Stand-in for umm_malloc, the ESP8266 heap. With FAKEESP_HEAP set to a size in bytes (e.g. 40000), the allocations
+// made by the firmware and its libraries come from an arena that large, split into 8 bytes blocks with a 4 bytes
+// header each, best fit, like on the device. So they can fail, and the free heap, the largest free block and the
+// fragmentation are real. Without it they go to the system allocator.
+//
+// malloc() and friends are wrapped at link time (-Wl,--wrap), so only the code linked into the executable goes
+// through here, not libstdc++ or OpenSSL.
+#define FAKE_HEAP_BLOCK_SIZE 8
+
+bool fakeHeapIsEnabled();
+
+void *fakeHeapMalloc(size_t size);
+
+void fakeHeapFree(void *ptr);
+
+void *fakeHeapRealloc(void *ptr, size_t size);
+
+void *fakeHeapCalloc(size_t count, size_t size);
+
+uint32_t fakeHeapGetFree();
+
+uint32_t fakeHeapGetMaxFreeBlockSize();
+
+// Same metric as umm_fragmentation_metric(): 0 when all the free memory is in one block, close to 100 when it's all
+// in tiny ones.
+uint8_t fakeHeapGetFragmentation();
+
+#endif //WI_SE_SW_FAKEHEAP_H
@@ -0,0 +1,58 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_FAKENET_H
+#define WI_SE_SW_FAKENET_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Makes the sockets behave like a Wi-Fi link rather than localhost, in the direction that matters for flow control:
+// from fakeesp to the clients. Data sent by AsyncClient is held back and handed to the kernel when the link would have
+// delivered it, and the ack callback only runs then, like on lwIP. Enabled with FAKEESP_NET, e.g.
+//
+//   FAKEESP_NET=wifi-bad
+//   FAKEESP_NET=wifi-fair,stall=3000/500
+//   FAKEESP_NET=rate=20000,latency=50,jitter=30,dist=pareto,loss=0.02,rto=250,sndbuf=2920,seed=7
+//
+// - rate:    link bandwidth in bytes per second, shared by all the connections
+// - latency: delay added to each send(), in milliseconds
+// - jitter:  how much the delay varies, in milliseconds, following dist: uniform (latency +/- jitter), normal (standard
+//            deviation jitter) or pareto (only longer, heavy tailed)
+// - stall:   EVERY/FOR in milliseconds, the link goes silent for FOR milliseconds every EVERY, like during interference
+// - loss:    probability that a send() is lost and retransmitted after rto milliseconds, doubling for each retry
+// - sndbuf:  caps space() per connection, like TCP_SND_BUF
+// - seed:    for the random numbers, the same seed and traffic give the same delays
+//
+// With FAKEESP_NET_FILE set to a path, the profile is read again from that file whenever it changes, so it can be
+// switched while running: echo wifi-bad > $FAKEESP_NET_FILE
+//
+// All the times are micros64(), so it works with FAKEESP_VIRTUAL_TIME as well.
+
+// Send()s waiting to be released per connection, the ones after that are merged into the last one
+#define FAKENET_MAX_SEGMENTS 32
+
+typedef void (*FakeNetReleaseCallback)(void *arg);
+
+// Whether the current profile impairs anything. Sending goes straight to the kernel otherwise.
+bool fakeNetEnabled();
+
+// Max space() of a connection, 0 for no limit.
+size_t fakeNetSendBufferCap();
+
+// When data sent now may leave, following latency, jitter and loss. Not before notBefore, TCP doesn't reorder.
+uint64_t fakeNetReleaseTime(uint64_t now, uint64_t notBefore);
+
+// How many bytes of the link the caller may send now, out of the wanted ones. If it's 0, *retryAt is when to try again.
+size_t fakeNetAvailable(uint64_t now, size_t wanted, uint64_t *retryAt);
+
+// Takes what was sent out of the link's budget.
+void fakeNetConsume(size_t len);
+
+// Calls callback(arg) from the reactor once micros64() reaches at. Replaces what was scheduled for the same arg.
+void fakeNetSchedule(FakeNetReleaseCallback callback, void *arg, uint64_t at);
+
+void fakeNetCancel(void *arg);
+
+#endif //WI_SE_SW_FAKENET_H
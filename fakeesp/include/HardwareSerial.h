@@ -10,13 +10,15 @@
 #include "ArduinoTime.h"
 #include <cstdio>
 #include <unistd.h>
-#include <cerrno>
-#include <fcntl.h>
 #include <algorithm>
 #include "uart.h"
-#include "HardwareSerial.h"
+#include "Reactor.h"
 
 #define FAKESERIAL_BUF_LEN 10000
+// What the wire model reads ahead from stdin, the bytes the device has queued for sending
+#define FAKESERIAL_WIRE_BUF_LEN 4096
+// The ESP8266 RX FIFO. An overrun loses what's in it.
+#define FAKESERIAL_HW_FIFO_LEN 128
 
 enum SerialConfig {
     SERIAL_5N1 = UART_5N1,
@@ -52,18 +54,133 @@ enum SerialMode {
 };
 
 
+// Where a FakeSerial reads from: stdin, shared by all the stdio ones, or its tty device.
+struct FakeSerialRx {
+    int fd;
+    int32_t reactorId;
+    // Set by the reactor, cleared once read() would block. Always set if the fd can't be watched (e.g. stdin is a
+    // regular file), as there's no way to know.
+    bool readable;
+};
+
+// Per-byte probabilities of the faults injected by the wire model, out of 2^32. See FAKEESP_UART_FAULTS.
+struct FakeSerialFaults {
+    uint32_t overrun;
+    uint32_t framing;
+    uint32_t noise;
+};
+
+// Without FAKEESP_UART<n> set it reads stdin and writes to stdout (stderr for UART1), as before. With it set to a tty
+// device (FAKEESP_UART0=/dev/ttyUSB0) that device is driven through termios, so the server can be used as a wired
+// serial gateway.
+//
+// On stdio, FAKEESP_UART_WIRE=1 models the wire: what comes from stdin reaches the RX buffer at the configured baud
+// rate and frame size, and is dropped as an overrun if the buffer is full, like on the ESP8266. Writes take as long as
+// the bytes take to go out and block while the TX FIFO is full. FAKEESP_UART_FAULTS injects errors on RX.
 class FakeSerial : public Stream {
 private:
-    FILE *fd;
-    char buffer[FAKESERIAL_BUF_LEN] = {0};
-    size_t seekPos = 0;
-    size_t bufLen = 0;
-    double rate = 115200 / 8;
+    FILE *out;
+    const char *ttyPath = nullptr;
+    int ttyFd = -1;
+    FakeSerialRx ttyRx = {-1, -1, true};
+    inline static FakeSerialRx stdinRx = {STDIN_FILENO, -1, true};
+
+    unsigned long baud = 115200;
+    SerialConfig config = SERIAL_8N1;
+    // Start, data, parity and stop bits of a frame, in half bits for 1.5 stop bits
+    uint8_t frameHalfBits = 20;
+
+    // RX ring buffer, its size is set with setRxBufferSize()
+    uint8_t *rxBuf = nullptr;
+    size_t rxBufSize = 0;
+    size_t rxHead = 0;
+    size_t rxLen = 0;
+
+    // Driver counters (TIOCGICOUNT) at the last hasOverrun()/hasRxError() call
+    uint32_t lastOverruns = 0;
+    uint32_t lastRxErrors = 0;
+
+    // Wire model state, only on stdio
+    bool wireModel = false;
+    FakeSerialFaults faults = {};
+    uint8_t *wireBuf = nullptr;
+    size_t wireHead = 0;
+    size_t wireLen = 0;
+    uint64_t wireLastMicros = 0;
+    // Time on the wire not spent on whole frames yet, in microseconds * baud
+    uint64_t wireCredit = 0;
+    uint64_t txBusyUntilMicros = 0;
+    uint32_t faultRandom = 1;
+    // Flagged by the wire model, cleared by hasOverrun()/hasRxError()
+    bool wireOverrun = false;
+    bool wireRxError = false;
+
+    // Baud rate estimator state, see estimateBaudrate()
+    int8_t autobaudCandidate = -1;
+    unsigned long autobaudSavedBaud = 0;
+    uint32_t autobaudBytes = 0;
+    uint32_t autobaudTextBytes = 0;
+    uint32_t autobaudErrorsAtStart = 0;
+    unsigned long autobaudBest = 0;
+    uint32_t autobaudBestScore = 0;
+
+    static void onRxReadable(void *arg, uint32_t events);
+
+    FakeSerialRx *rx() {
+        return ttyFd >= 0 ? &ttyRx : &stdinRx;
+    }
+
+    // Moves what's available from the fd into the ring buffer, through the wire model if it's enabled.
+    void fillRx();
+
+    // Reads what's available from the fd into the free part of a ring buffer. Returns the bytes read.
+    size_t readSource(uint8_t *buf, size_t size, size_t head, size_t len);
+
+    bool isModelled() const {
+        return ttyFd < 0 && (wireModel || faults.overrun || faults.framing || faults.noise);
+    }
+
+    // Moves the bytes whose time has come from the wire to the RX buffer, injecting faults on the way.
+    void releaseWire();
+
+    uint64_t wireMicros(size_t bytes) const {
+        return bytes * frameHalfBits * 500000 / baud;
+    }
+
+    uint32_t nextFaultRandom();
+
+    void parseFaults(const char *spec);
+
+    void configureTty();
+
+    bool setTtySpeed(unsigned long baud);
+
+    // Framing + parity errors and overruns counted by the driver, false if it doesn't count them.
+    bool getDriverErrors(uint32_t &rxErrors, uint32_t &overruns);
+
+    void startAutobaudCandidate(int8_t candidate);
 
 public:
-    FakeSerial(FILE *fd) : fd{fd} {}
+    explicit FakeSerial(FILE *out);
 
-    virtual ~FakeSerial() = default;;
+    // The tty device is taken from FAKEESP_UART<uartNr>. UART0 and UART1 fall back to stdin/stdout and stdin/stderr,
+    // the others are only meant to be created when their device is set.
+    explicit FakeSerial(int uartNr);
+
+    // FAKEESP_UART<uartNr>, nullptr if it's not set.
+    static const char *getDevicePath(int uartNr);
+
+    static bool hasDevice(int uartNr) {
+        return getDevicePath(uartNr) != nullptr;
+    }
+
+    virtual ~FakeSerial();
+
+    // Call once at startup, stdin must be non-blocking.
+    static void watchStdin() {
+        // Armed by fillRx() once it finds nothing to read
+        stdinRx.reactorId = reactorAdd(STDIN_FILENO, 0, onRxReadable, &stdinRx);
+    }
 
     void begin(unsigned long baud) {
         begin(baud, SERIAL_8N1, SERIAL_FULL, 1, false);
@@ -81,19 +198,9 @@ public:
         begin(baud, config, mode, tx_pin, false);
     }
 
-    void begin(unsigned long baud, SerialConfig config, SerialMode mode, uint8_t tx_pin, bool invert) {
-        rate = ((double) baud) / 8.0;
-    }
+    void begin(unsigned long baud, SerialConfig config, SerialMode mode, uint8_t tx_pin, bool invert);
 
-    void end() {}
-
-    void simulateBaudrate(uint64_t callTimeUs, size_t bytesTransceived) {
-#ifdef SIMULATE_BAUDRATE
-        uint64_t now = micros();
-        uint64_t transferDuration = (uint64_t) (bytesTransceived * 1000000 / rate);
-        delayMicrosecondsNoYield((callTimeUs - now) + transferDuration);
-#endif
-    }
+    void end();
 
     unsigned long detectBaudrate(time_t timeoutMillis) {
         for (int iters = std::max((int) timeoutMillis / 100, 1); iters > 0; iters--) {
@@ -103,86 +210,23 @@ public:
     }
 
     size_t write(uint8_t uint8) override {
-        uint64_t now = micros();
-        fputc(uint8, fd);
-        simulateBaudrate(now, 1);
-        return 1;
+        return write(&uint8, 1);
     }
 
-    size_t write(const uint8_t *outBuffer, size_t size) override {
-        uint64_t now = micros();
-        size_t ret = fwrite(outBuffer, sizeof(uint8_t), size, fd);
-        fflush(fd);
-        simulateBaudrate(now, size);
-        return ret;
-    }
+    size_t write(const uint8_t *outBuffer, size_t size) override;
 
-    void flush() override {
-        fflush(fd);
-    }
+    void flush() override;
 
-    int available() override {
-//        fd_set readfds;
-//        FD_ZERO(&readfds);
-//        FD_SET(STDIN_FILENO, &readfds);
-//        struct timeval timeout{};
-//        timeout.tv_sec = 0;
-//        timeout.tv_usec = 0;
-//        if (select(1, &readfds, nullptr, nullptr, &timeout) <= 0) {
-//            return 0;
-//        }
-        size_t bread = ::read(fileno(stdin), buffer + seekPos, FAKESERIAL_BUF_LEN - bufLen);
-        if (bread != -1 || errno != EWOULDBLOCK) {
-            bufLen += bread;  // NOLINT(cppcoreguidelines-narrowing-conversions)
-        }
-        return bufLen - seekPos;
-    }
+    int available() override;
 
-    int read() override {
-        simulateBaudrate(0, 1);
-        if (bufLen == 0) {
-            return fgetc(stdin);
-        }
-        return buffer[seekPos++];
-    }
+    int read() override;
 
-    int peek() override {
-        if (bufLen == 0) {
-            int c = fgetc(stdin);
-            buffer[0] = c; // NOLINT(cppcoreguidelines-narrowing-conversions)
-            return c;
-        }
-        return buffer[seekPos];
-    }
+    int peek() override;
 
-    size_t readBytes(char *outBuffer, size_t length) override {
-        uint64_t now = micros();
-        if (bufLen == 0) {
-            available();
-        }
-        if (bufLen == 0) {
-            return 0;
-        }
-        size_t readLen = std::min(length, bufLen - seekPos);
-        // Copy internal buffer into output buffer
-        memcpy(outBuffer, buffer + seekPos, sizeof(char) * readLen);
-        seekPos += readLen;
-        if (seekPos >= bufLen) {
-            // Reset internal buffer
-            seekPos = 0;
-            bufLen = 0;
-        } else if (seekPos < bufLen) {
-            // Move internal buffer contents to the beginning
-            memcpy(buffer, buffer + seekPos, sizeof(char) * (bufLen - seekPos));
-            bufLen -= seekPos;
-            seekPos = 0;
-        }
-        simulateBaudrate(now, readLen);
-        return readLen;
-    }
+    size_t readBytes(char *outBuffer, size_t length) override;
 
     size_t readBytes(uint8_t *outBuffer, size_t length) override {
-        return readBytes((char *) buffer, length);
+        return readBytes((char *) outBuffer, length);
     }
 
     String readString() override {
@@ -192,16 +236,32 @@ public:
         return String(buf);
     }
 
-    size_t setRxBufferSize(size_t size) { return size; }
+    // Resizes the RX ring buffer, keeping what fits of its contents.
+    size_t setRxBufferSize(size_t size);
+
+    // Like on the ESP8266, these report whether it happened since the last call.
+    bool hasOverrun();
+
+    bool hasRxError();
+
+    void sendBreak();
+
+    // Host side stand-in for the ESP8266 pulse width measurement. Each call switches the port to the next standard
+    // rate and scores the previous one by how much of what came in looks like text and how many framing and parity
+    // errors the driver counted. After a full sweep it returns the best rate, or 0 if none of them was convincing.
+    // Always 0 on stdio.
+    int estimateBaudrate();
 
     bool operator!=(const FakeSerial &other) const {
-        return fd == other.fd;
+        return out == other.out;
     }
 };
 
 class HardwareSerial : public FakeSerial {
 public:
     HardwareSerial(FILE *fd) : FakeSerial(fd) {};
+
+    HardwareSerial(int uart_nr) : FakeSerial(uart_nr) {};
 };
 
 extern HardwareSerial Serial;
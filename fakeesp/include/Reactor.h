@@ -0,0 +1,47 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_REACTOR_H
+#define WI_SE_SW_REACTOR_H
+
+#include <cstdint>
+#include <sys/epoll.h>
+
+// Stands in for the lwIP callbacks: the sockets and the serial port are watched with epoll and the callback of an fd
+// runs from yield(), delay() and friends only when it's ready.
+#define REACTOR_SLOTS 256
+
+// Functions that run after every poll, for code with timers of its own
+#define REACTOR_TICKS 4
+
+typedef void (*ReactorCallback)(void *arg, uint32_t events);
+
+typedef void (*ReactorTickCallback)(void *arg);
+
+// Watches fd for events (EPOLLIN, EPOLLOUT), level triggered. Returns the id to pass to the other functions, -1 if
+// there's no room for it or the fd can't be watched.
+int32_t reactorAdd(int fd, uint32_t events, ReactorCallback callback, void *arg);
+
+void reactorModify(int32_t id, uint32_t events);
+
+// Call before closing the fd. The callback won't be called anymore, even if the fd was already reported as ready.
+void reactorRemove(int32_t id);
+
+// Runs the callbacks of the ready fds, waiting up to timeoutMicros for one of them to become ready.
+void reactorPoll(uint64_t timeoutMicros);
+
+// The next yield() waits for the fds until then (micros64()) instead of just checking them. loop() sets it to when
+// there's housekeeping to do, so the process sleeps while nothing happens.
+void reactorSetYieldDeadline(uint64_t deadlineMicros);
+
+// Makes the reactor stop waiting by then (micros64()), for things that happen at a given time rather than on an fd,
+// like the next byte of an emulated UART. Only needs to be called once per wake-up, the earliest one wins.
+void reactorWakeBy(uint64_t deadlineMicros);
+
+// Calls callback after every poll, once the ready fds have been handled, from then on. It's for things that happen at
+// a given time and that nothing else would check for: the callback handles what's due according to micros64() and
+// asks for the next wake-up with reactorWakeBy(). Returns false if there's no room for it.
+bool reactorAddTick(ReactorTickCallback callback, void *arg);
+
+#endif //WI_SE_SW_REACTOR_H
@@ -13,6 +13,7 @@
 #define memmove_P memmove
 #define strlen_P strlen
 #define strcpy_P strcpy
+#define strcmp_P strcmp
 #define vsnprintf_P vsnprintf
 #define pgm_read_byte(arg) (*(arg))
 
@@ -22,7 +22,10 @@ int main() {
         perror("Unable to set non blocking stdin");
         exit(1);
     }
-    srand(time(NULL));
+    // The serial port goes in the same epoll set as the sockets
+    FakeSerial::watchStdin();
+    // Runs with virtual time are meant to be repeatable, random numbers included
+    srand(virtualTimeEnabled() ? 1 : time(NULL));
 
     setup();
 #pragma clang diagnostic push
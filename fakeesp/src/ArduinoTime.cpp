@@ -3,58 +3,45 @@
 //
 
 #include <time.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include <stdint.h>
 
 #include "ArduinoTime.h"
+#include "Reactor.h"
 
-#define ODJT_LEN 50
-
-#ifndef NULL
-#define NULL 0
-#endif
-
-void (*onDelayJumpTable[ODJT_LEN])(void *arg) = {0};
-void *onDelayArgs[ODJT_LEN] = {0};
-
-
-int32_t registerOnDelayCallback(void (*callback)(void *arg), void *arg) {
-    for (int32_t i = 0; i < ODJT_LEN; i++) {
-        if (onDelayJumpTable[i] == NULL) {
-            onDelayJumpTable[i] = callback;
-            onDelayArgs[i] = arg;
-            return i;
-        }
-    }
-    return -1;
+unsigned long millis() {
+    return micros64() / 1000;
 }
 
-void deregisterOnDelayCallback(uint32_t id) {
-    onDelayJumpTable[id] = nullptr;
-    onDelayArgs[id] = nullptr;
+unsigned long micros() {
+    return micros64();
 }
 
-void callOnDelayCallbacks() {
-    for (int i = 0; i < ODJT_LEN; i++) {
-        if (onDelayJumpTable[i] != nullptr) {
-            (*onDelayJumpTable[i])(onDelayArgs[i]);
-        }
-    }
-}
+// Not 0, the firmware uses 0 timestamps for "never"
+#define VIRTUAL_TIME_START_MICROS 1000000
 
-void yield() {
-    delay(1);
-}
+static int virtualTime = -1;
+static uint64_t virtualMicros = VIRTUAL_TIME_START_MICROS;
 
-unsigned long millis() {
-    return micros64() / 1000;
+bool virtualTimeEnabled() {
+    if (virtualTime < 0) {
+        const char *env = getenv("FAKEESP_VIRTUAL_TIME");
+        virtualTime = env != nullptr && env[0] != '\0' && env[0] != '0';
+    }
+    return virtualTime;
 }
 
-unsigned long micros() {
-    return micros64();
+void virtualTimeAdvance(uint64_t us) {
+    if (virtualTimeEnabled()) {
+        virtualMicros += us;
+    }
 }
 
 uint64_t micros64() {
+    if (virtualTimeEnabled()) {
+        return virtualMicros;
+    }
     struct timeval tv = {0};
     gettimeofday(&tv, nullptr);
     return (1000000 * tv.tv_sec) + tv.tv_usec;
@@ -69,11 +56,24 @@ void delayNoYield(unsigned long ms) {
 }
 
 void delayMicroseconds(unsigned int us) {
-    callOnDelayCallbacks();
-    delayMicrosecondsNoYield(us);
+    // Serve the sockets while waiting, like the SDK does
+    uint64_t deadline = micros64() + us;
+    reactorPoll(0);
+    for (uint64_t now = micros64(); now < deadline; now = micros64()) {
+        if (deadline - now < 1000) {
+            // epoll_wait() can't wait for less than a millisecond
+            delayMicrosecondsNoYield(deadline - now);
+            break;
+        }
+        reactorPoll((deadline - now) / 1000 * 1000);
+    }
 }
 
 void delayMicrosecondsNoYield(unsigned int us) {
+    if (virtualTimeEnabled()) {
+        virtualMicros += us;
+        return;
+    }
     struct timespec delta = {us / (1000 * 1000), (us % (1000 * 1000)) * 1000};
     while (nanosleep(&delta, &delta));
 }
\ No newline at end of file
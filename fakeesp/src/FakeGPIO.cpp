@@ -6,15 +6,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "Arduino.h"
+#include "FakeGPIO.h"
+#include "Reactor.h"
 
-#define FAKEESP_ENU_PINS 17
+char fakeEspDefaultGpioFilePath[] = "/dev/shm/fakeesp_gpio";
 
-char fakeEspDefaultGpioFilePath[] = "/tmp/fakeesp_gpio.txt";
-
-uint8_t pinModes[FAKEESP_ENU_PINS] = {42}; // Init to invalid pin mode
-int pinValues[FAKEESP_ENU_PINS] = {0};
+static FakeGpioShared *gpio = nullptr;
 
 
 char *getGpioFilePath() {
@@ -25,74 +27,121 @@ char *getGpioFilePath() {
     return path;
 }
 
-void writePinFile() {
-    FILE *file = fopen(getGpioFilePath(), "w");
-    if (file == NULL) {
-        fprintf(stderr, "Unable to open fake GPIO file (%d): %s\n", errno, strerror(errno));
-        return;
+static FakeGpioShared *mapGpioFile() {
+    const char *path = getGpioFilePath();
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open fake GPIO file %s (%d): %s\n", path, errno, strerror(errno));
+        return nullptr;
+    }
+    if (ftruncate(fd, sizeof(FakeGpioShared)) < 0) {
+        fprintf(stderr, "Unable to resize fake GPIO file %s (%d): %s\n", path, errno, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, sizeof(FakeGpioShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Unable to map fake GPIO file %s (%d): %s\n", path, errno, strerror(errno));
+        return nullptr;
+    }
+    return (FakeGpioShared *) addr;
+}
+
+static FakeGpioShared *getGpio() {
+    if (gpio != nullptr) {
+        return gpio;
+    }
+    gpio = mapGpioFile();
+    if (gpio == nullptr) {
+        // Keep going without sharing the state
+        gpio = (FakeGpioShared *) calloc(1, sizeof(FakeGpioShared));
+    }
+
+    // Inputs driven before we started are kept, as long as the layout is the same
+    bool compatible = gpio->magic == FAKEESP_GPIO_MAGIC && gpio->version == FAKEESP_GPIO_VERSION &&
+                      gpio->pinCount == FAKEESP_GPIO_PINS;
+    if (!compatible) {
+        memset((void *) gpio, 0, sizeof(FakeGpioShared));
+    }
+    gpio->magic = FAKEESP_GPIO_MAGIC;
+    gpio->version = FAKEESP_GPIO_VERSION;
+    gpio->pinCount = FAKEESP_GPIO_PINS;
+
+    // Odd, also if a previous run died halfway through an update
+    uint32_t sequence = gpio->sequence.load(std::memory_order_relaxed) | 1;
+    gpio->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        gpio->modes[i].store(FAKEESP_GPIO_MODE_UNSET, std::memory_order_relaxed);
+        gpio->values[i].store(0, std::memory_order_relaxed);
     }
-    fprintf(file, "PIN:  ");
-    for (int i = 0; i < FAKEESP_ENU_PINS; i++) {
-        fprintf(file, " %3d ", i);
+    gpio->sequence.store(sequence + 1, std::memory_order_release);
+    return gpio;
+}
+
+// Only stores and bumps the sequence if something changes, the LEDs are written over and over with the same value
+static void writePin(uint8_t pin, uint8_t mode, int32_t value) {
+    FakeGpioShared *shared = getGpio();
+    if (pin >= FAKEESP_GPIO_PINS) {
+        return;
     }
-    fprintf(file, "\n------");
-    for (int i = 0; i < FAKEESP_ENU_PINS; i++) {
-        fprintf(file, "-----");
+    if (shared->modes[pin].load(std::memory_order_relaxed) == mode &&
+        shared->values[pin].load(std::memory_order_relaxed) == value) {
+        return;
     }
-    fprintf(file, "\nMODE: ");
-    for (int i = 0; i < FAKEESP_ENU_PINS; i++) {
-        if (pinModes[i] == OUTPUT) {
-            fprintf(file, " OUT ");
-        } else if (pinModes[i] == INPUT) {
-            fprintf(file, " INP ");
-        } else if (pinModes[i] == FAKEMODE_PWM_OUT) {
-            fprintf(file, " PWM ");
-        } else {
-            fprintf(file, " ??? ");
-        }
+    shared->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shared->modes[pin].store(mode, std::memory_order_relaxed);
+    shared->values[pin].store(value, std::memory_order_relaxed);
+    shared->sequence.fetch_add(1, std::memory_order_release);
+}
+
+static int32_t readPin(uint8_t pin) {
+    FakeGpioShared *shared = getGpio();
+    if (pin >= FAKEESP_GPIO_PINS) {
+        return 0;
     }
-    fprintf(file, "\nVALUE:");
-    for (int i = 0; i < FAKEESP_ENU_PINS; i++) {
-        fprintf(file, " %3d ", pinValues[i]);
+    if (shared->driveMask.load(std::memory_order_acquire) & (1u << pin)) {
+        return shared->driveValues[pin].load(std::memory_order_relaxed);
     }
-    fputc('\n', file);
-    fclose(file);
+    return shared->values[pin].load(std::memory_order_relaxed);
+}
+
+static uint8_t getPinMode(uint8_t pin) {
+    return pin < FAKEESP_GPIO_PINS ? getGpio()->modes[pin].load(std::memory_order_relaxed) : FAKEESP_GPIO_MODE_UNSET;
 }
 
 void pinMode(uint8_t pin, uint8_t mode) {
-    callOnDelayCallbacks();
-    pinModes[pin] = mode;
+    reactorPoll(0);
+    if (pin < FAKEESP_GPIO_PINS) {
+        writePin(pin, mode, getGpio()->values[pin].load(std::memory_order_relaxed));
+    }
 }
 
 void digitalWrite(uint8_t pin, uint8_t val) {
-    callOnDelayCallbacks();
-    if (pinModes[pin] == FAKEMODE_PWM_OUT) {
-        pinModes[pin] = OUTPUT;
-    }
-    pinValues[pin] = val != 0;
-    writePinFile();
+    reactorPoll(0);
+    uint8_t mode = getPinMode(pin);
+    writePin(pin, mode == FAKEMODE_PWM_OUT ? OUTPUT : mode, val != 0);
 }
 
 int digitalRead(uint8_t pin) {
-    callOnDelayCallbacks();
-    return pinValues[pin] != 0;
+    reactorPoll(0);
+    return readPin(pin) != 0;
 }
 
 int analogRead(uint8_t pin) {
-    callOnDelayCallbacks();
-    return pinValues[pin];
+    reactorPoll(0);
+    return readPin(pin);
 }
 
 void analogReference(uint8_t mode) {}
 
 void analogWrite(uint8_t pin, int val) {
-    callOnDelayCallbacks();
-    pinModes[pin] = FAKEMODE_PWM_OUT;
-    pinValues[pin] = val;
-    writePinFile();
+    reactorPoll(0);
+    writePin(pin, FAKEMODE_PWM_OUT, val);
 }
 
 void analogWriteFreq(uint32_t freq) {}
 
 void analogWriteRange(uint32_t range) {}
-
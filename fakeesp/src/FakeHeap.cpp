@@ -0,0 +1,377 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+#include "FakeHeap.h"
+
+// Like umm_malloc: block 0 is the head of the free list, the last block ends the chunk list, the ones in between
+// are the heap. A chunk is a run of blocks, starting with a 4 bytes header, so n blocks hold n * 8 - 4 bytes.
+// The headers and the free list live in the arrays below rather than in the arena, so nothing the firmware does
+// can corrupt them, and the pointers handed out are 8 bytes aligned.
+#define FAKE_HEAP_HEADER_SIZE 4
+#define FAKE_HEAP_MIN_BLOCKS 64
+
+extern "C" {
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_calloc(size_t count, size_t size);
+}
+
+enum FakeHeapState {
+    FAKE_HEAP_UNINITIALIZED,
+    FAKE_HEAP_ENABLED,
+    FAKE_HEAP_DISABLED,
+};
+
+// Blocks other than the first of a chunk are inside it, including those of chunks merged into their neighbour, so that
+// only the start of an allocated chunk passes as a pointer to free.
+enum FakeHeapBlockState : uint8_t {
+    FAKE_HEAP_BLOCK_INSIDE,
+    FAKE_HEAP_BLOCK_FREE_CHUNK,
+    FAKE_HEAP_BLOCK_USED_CHUNK,
+};
+
+static FakeHeapState state = FAKE_HEAP_UNINITIALIZED;
+static uint8_t *arena = nullptr;
+static uint32_t blockCount = 0;
+static uint32_t freeBlocks = 0;
+
+// Indexed by the first block of a chunk
+static uint32_t *nextChunk = nullptr;
+static uint32_t *prevChunk = nullptr;
+static uint32_t *nextFree = nullptr;
+static uint32_t *prevFree = nullptr;
+// Indexed by any block
+static uint8_t *blockState = nullptr;
+
+static bool init() {
+    if (state != FAKE_HEAP_UNINITIALIZED) {
+        return state == FAKE_HEAP_ENABLED;
+    }
+    state = FAKE_HEAP_DISABLED;
+    const char *size = getenv("FAKEESP_HEAP");
+    if (size == nullptr || size[0] == '\0') {
+        return false;
+    }
+
+    blockCount = std::max((uint32_t) (strtoul(size, nullptr, 10) / FAKE_HEAP_BLOCK_SIZE), (uint32_t) FAKE_HEAP_MIN_BLOCKS);
+    // Not with malloc(), that's us
+    size_t metadataSize = blockCount * (4 * sizeof(uint32_t) + sizeof(uint8_t));
+    void *mem = mmap(nullptr, blockCount * FAKE_HEAP_BLOCK_SIZE + metadataSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("Unable to map the emulated heap");
+        abort();
+    }
+    arena = (uint8_t *) mem;
+    nextChunk = (uint32_t *) (arena + blockCount * FAKE_HEAP_BLOCK_SIZE);
+    prevChunk = nextChunk + blockCount;
+    nextFree = prevChunk + blockCount;
+    prevFree = nextFree + blockCount;
+    blockState = (uint8_t *) (prevFree + blockCount);
+
+    uint32_t last = blockCount - 1;
+    nextChunk[0] = 1;
+    nextChunk[1] = last;
+    prevChunk[1] = 0;
+    nextChunk[last] = 0;
+    prevChunk[last] = 1;
+    nextFree[0] = 1;
+    prevFree[1] = 0;
+    nextFree[1] = 0;
+    blockState[1] = FAKE_HEAP_BLOCK_FREE_CHUNK;
+    freeBlocks = last - 1;
+
+    state = FAKE_HEAP_ENABLED;
+    fprintf(stderr, "Emulated heap: %u bytes\n", freeBlocks * FAKE_HEAP_BLOCK_SIZE);
+    return true;
+}
+
+static uint32_t blocksFor(size_t size) {
+    if (size <= FAKE_HEAP_BLOCK_SIZE - FAKE_HEAP_HEADER_SIZE) {
+        return 1;
+    }
+    return 2 + (size - (FAKE_HEAP_BLOCK_SIZE - FAKE_HEAP_HEADER_SIZE) - 1) / FAKE_HEAP_BLOCK_SIZE;
+}
+
+static uint32_t chunkBlocks(uint32_t chunk) {
+    return nextChunk[chunk] - chunk;
+}
+
+static bool inArena(const void *ptr) {
+    return arena != nullptr && ptr >= arena && ptr < arena + blockCount * FAKE_HEAP_BLOCK_SIZE;
+}
+
+static bool isFree(uint32_t chunk) {
+    return blockState[chunk] == FAKE_HEAP_BLOCK_FREE_CHUNK;
+}
+
+static uint32_t chunkOf(void *ptr) {
+    size_t offset = (uint8_t *) ptr - arena;
+    auto chunk = (uint32_t) (offset / FAKE_HEAP_BLOCK_SIZE);
+    if (offset % FAKE_HEAP_BLOCK_SIZE != 0 || blockState[chunk] != FAKE_HEAP_BLOCK_USED_CHUNK) {
+        // The device would corrupt the heap and crash at some later point, better stop here
+        fprintf(stderr, "Emulated heap: bad pointer or double free: %p\n", ptr);
+        abort();
+    }
+    return chunk;
+}
+
+static void *pointerTo(uint32_t chunk) {
+    return arena + chunk * FAKE_HEAP_BLOCK_SIZE;
+}
+
+// Takes it off the free list, to be handed out or merged into its neighbour.
+static void unlinkFree(uint32_t chunk) {
+    nextFree[prevFree[chunk]] = nextFree[chunk];
+    if (nextFree[chunk]) {
+        prevFree[nextFree[chunk]] = prevFree[chunk];
+    }
+    blockState[chunk] = FAKE_HEAP_BLOCK_USED_CHUNK;
+}
+
+static void pushFree(uint32_t chunk) {
+    nextFree[chunk] = nextFree[0];
+    prevFree[chunk] = 0;
+    if (nextFree[0]) {
+        prevFree[nextFree[0]] = chunk;
+    }
+    nextFree[0] = chunk;
+    blockState[chunk] = FAKE_HEAP_BLOCK_FREE_CHUNK;
+}
+
+// Merges the chunk after this one into it.
+static void absorbNext(uint32_t chunk) {
+    uint32_t next = nextChunk[chunk];
+    nextChunk[chunk] = nextChunk[next];
+    prevChunk[nextChunk[next]] = chunk;
+    blockState[next] = FAKE_HEAP_BLOCK_INSIDE;
+}
+
+// Cuts the chunk after its first `blocks` blocks. Returns the second part, which is in use.
+static uint32_t split(uint32_t chunk, uint32_t blocks) {
+    uint32_t tail = chunk + blocks;
+    nextChunk[tail] = nextChunk[chunk];
+    prevChunk[tail] = chunk;
+    prevChunk[nextChunk[chunk]] = tail;
+    nextChunk[chunk] = tail;
+    blockState[tail] = FAKE_HEAP_BLOCK_USED_CHUNK;
+    return tail;
+}
+
+// Like umm_free(): merge with the next chunk if it's free, then into the previous one if that's free.
+static void freeChunk(uint32_t chunk) {
+    freeBlocks += chunkBlocks(chunk);
+    if (isFree(nextChunk[chunk])) {
+        unlinkFree(nextChunk[chunk]);
+        absorbNext(chunk);
+    }
+    uint32_t prev = prevChunk[chunk];
+    if (prev != 0 && isFree(prev)) {
+        absorbNext(prev);
+    } else {
+        pushFree(chunk);
+    }
+}
+
+bool fakeHeapIsEnabled() {
+    return init();
+}
+
+void *fakeHeapMalloc(size_t size) {
+    if (!init()) {
+        return __real_malloc(size);
+    }
+    if (size == 0) {
+        return nullptr;
+    }
+
+    // Best fit, like UMM_BEST_FIT which the ESP8266 core uses
+    uint32_t blocks = blocksFor(size);
+    uint32_t best = 0;
+    uint32_t bestBlocks = UINT32_MAX;
+    for (uint32_t chunk = nextFree[0]; chunk != 0; chunk = nextFree[chunk]) {
+        uint32_t available = chunkBlocks(chunk);
+        if (available >= blocks && available < bestBlocks) {
+            best = chunk;
+            bestBlocks = available;
+            if (available == blocks) {
+                break;
+            }
+        }
+    }
+    if (best == 0) {
+        return nullptr;
+    }
+
+    unlinkFree(best);
+    if (bestBlocks > blocks) {
+        // The rest stays free
+        pushFree(split(best, blocks));
+    }
+    freeBlocks -= blocks;
+    return pointerTo(best);
+}
+
+void fakeHeapFree(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (!inArena(ptr)) {
+        // Allocated by libc or libstdc++, or before the emulated heap was enabled
+        __real_free(ptr);
+        return;
+    }
+    freeChunk(chunkOf(ptr));
+}
+
+void *fakeHeapRealloc(void *ptr, size_t size) {
+    if (ptr == nullptr) {
+        return fakeHeapMalloc(size);
+    }
+    if (!inArena(ptr)) {
+        return __real_realloc(ptr, size);
+    }
+    if (size == 0) {
+        fakeHeapFree(ptr);
+        return nullptr;
+    }
+
+    uint32_t chunk = chunkOf(ptr);
+    uint32_t blocks = blocksFor(size);
+    uint32_t current = chunkBlocks(chunk);
+    uint32_t next = nextChunk[chunk];
+    if (blocks > current && isFree(next) && current + chunkBlocks(next) >= blocks) {
+        // Grow into the free chunk that follows
+        unlinkFree(next);
+        freeBlocks -= chunkBlocks(next);
+        absorbNext(chunk);
+        current = chunkBlocks(chunk);
+    }
+    if (blocks <= current) {
+        if (blocks < current) {
+            freeChunk(split(chunk, blocks));
+        }
+        return ptr;
+    }
+
+    void *newPtr = fakeHeapMalloc(size);
+    if (newPtr == nullptr) {
+        // The old block is left alone, like realloc() does
+        return nullptr;
+    }
+    memcpy(newPtr, ptr, current * FAKE_HEAP_BLOCK_SIZE - FAKE_HEAP_HEADER_SIZE);
+    freeChunk(chunk);
+    return newPtr;
+}
+
+void *fakeHeapCalloc(size_t count, size_t size) {
+    if (!init()) {
+        return __real_calloc(count, size);
+    }
+    if (size != 0 && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void *ptr = fakeHeapMalloc(count * size);
+    if (ptr != nullptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+uint32_t fakeHeapGetFree() {
+    return init() ? freeBlocks * FAKE_HEAP_BLOCK_SIZE : 999999;
+}
+
+uint32_t fakeHeapGetMaxFreeBlockSize() {
+    if (!init()) {
+        return 999999;
+    }
+    uint32_t maxBlocks = 0;
+    for (uint32_t chunk = nextFree[0]; chunk != 0; chunk = nextFree[chunk]) {
+        maxBlocks = std::max(maxBlocks, chunkBlocks(chunk));
+    }
+    return maxBlocks * FAKE_HEAP_BLOCK_SIZE;
+}
+
+uint8_t fakeHeapGetFragmentation() {
+    if (!init()) {
+        return 1;
+    }
+    if (freeBlocks == 0) {
+        return 0;
+    }
+    uint64_t freeBlocksSquared = 0;
+    for (uint32_t chunk = nextFree[0]; chunk != 0; chunk = nextFree[chunk]) {
+        freeBlocksSquared += (uint64_t) chunkBlocks(chunk) * chunkBlocks(chunk);
+    }
+    return 100 - (uint32_t) (sqrt((double) freeBlocksSquared) * 100) / freeBlocks;
+}
+
+// The heap profiler replaces these when it's enabled, and calls the functions above itself.
+extern "C" {
+__attribute__((weak)) void *__wrap_malloc(size_t size) {
+    return fakeHeapMalloc(size);
+}
+
+__attribute__((weak)) void __wrap_free(void *ptr) {
+    fakeHeapFree(ptr);
+}
+
+__attribute__((weak)) void *__wrap_realloc(void *ptr, size_t size) {
+    return fakeHeapRealloc(ptr, size);
+}
+
+__attribute__((weak)) void *__wrap_calloc(size_t count, size_t size) {
+    return fakeHeapCalloc(count, size);
+}
+}
+
+// On the device operator new is linked statically and calls malloc(), here it lives in libstdc++ and wouldn't be seen.
+// malloc(0) returns NULL like umm_malloc() does, but new must return a unique pointer even for zero bytes, so those
+// take a block.
+void *operator new(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        fprintf(stderr, "Out of memory allocating %zu bytes\n", size);
+        abort();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
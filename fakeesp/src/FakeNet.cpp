@@ -0,0 +1,329 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "Arduino.h"
+#include "FakeNet.h"
+#include "Reactor.h"
+
+// Same as TCP_MSS. The link sends at least this much at once when there's that much to send, rather than trickling
+// out a few bytes every time the rate allows it.
+#define FAKENET_MSS 1460
+#define FAKENET_BURST_BYTES (2 * FAKENET_MSS)
+#define FAKENET_PARETO_ALPHA 1.5
+#define FAKENET_PARETO_MAX 20
+#define FAKENET_MAX_RETRIES 6
+#define FAKENET_FILE_CHECK_MICROS 250000
+#define FAKENET_SPEC_MAX_LEN 256
+
+enum FakeNetJitter {
+    FAKENET_JITTER_UNIFORM,
+    FAKENET_JITTER_NORMAL,
+    FAKENET_JITTER_PARETO,
+};
+
+struct FakeNetProfile {
+    const char *name;
+    uint32_t rate;
+    uint32_t latencyMillis;
+    uint32_t jitterMillis;
+    FakeNetJitter jitter;
+    uint32_t stallEveryMillis;
+    uint32_t stallForMillis;
+    double loss;
+    uint32_t rtoMillis;
+    uint32_t sendBufferCap;
+};
+
+// Rough figures for an ESP8266 in the same room as the AP, a couple of walls away, and at the edge of the coverage.
+// 5840 is TCP_SND_BUF with PIO_FRAMEWORK_ARDUINO_LWIP_HIGHER_BANDWIDTH.
+static const FakeNetProfile builtinProfiles[] = {
+        {"none",      0,      0,   0,   FAKENET_JITTER_UNIFORM, 0,    0,    0,    250, 0},
+        {"wifi-good", 500000, 3,   2,   FAKENET_JITTER_NORMAL,  0,    0,    0,    250, 5840},
+        {"wifi-fair", 100000, 20,  15,  FAKENET_JITTER_NORMAL,  0,    0,    0.01, 250, 5840},
+        {"wifi-bad",  20000,  60,  40,  FAKENET_JITTER_PARETO,  5000, 400,  0.03, 300, 5840},
+        {"congested", 5000,   150, 50,  FAKENET_JITTER_UNIFORM, 2000, 1000, 0.05, 500, 2920},
+};
+
+struct FakeNetWaiting {
+    FakeNetReleaseCallback callback;
+    void *arg;
+    uint64_t at;
+};
+
+static bool initialized = false;
+static FakeNetProfile profile = builtinProfiles[0];
+static bool enabled = false;
+static uint32_t randomState = 1;
+
+static double tokens = 0;
+static uint64_t tokensUpdatedMicros = 0;
+static uint64_t stallOriginMicros = 0;
+
+static const char *controlFile = nullptr;
+static time_t controlFileMtime = 0;
+static off_t controlFileSize = -1;
+static uint64_t controlFileCheckedMicros = 0;
+
+// One per connection at most, and there's one reactor slot per connection
+static FakeNetWaiting waiting[REACTOR_SLOTS] = {};
+
+static void onReactorTick(void *arg);
+
+static uint32_t nextRandom() {
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// (0, 1]
+static double nextUniform() {
+    return ((double) nextRandom() + 1) / 4294967296.0;
+}
+
+static bool parseJitter(const char *name, FakeNetJitter *jitter) {
+    if (strcmp(name, "uniform") == 0) {
+        *jitter = FAKENET_JITTER_UNIFORM;
+    } else if (strcmp(name, "normal") == 0) {
+        *jitter = FAKENET_JITTER_NORMAL;
+    } else if (strcmp(name, "pareto") == 0) {
+        *jitter = FAKENET_JITTER_PARETO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void applySpec(const char *spec) {
+    // e.g. wifi-bad,rate=50000 or rate=20000,latency=50,jitter=30,dist=pareto
+    FakeNetProfile next = builtinProfiles[0];
+    char buf[FAKENET_SPEC_MAX_LEN];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    char *save = nullptr;
+    for (char *item = strtok_r(buf, ", \t\r\n", &save); item != nullptr; item = strtok_r(nullptr, ", \t\r\n", &save)) {
+        char *value = strchr(item, '=');
+        if (value == nullptr) {
+            bool found = false;
+            for (const FakeNetProfile &builtin: builtinProfiles) {
+                if (strcmp(item, builtin.name) == 0) {
+                    next = builtin;
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Unknown network profile: %s\n", item);
+            }
+            continue;
+        }
+        *value++ = '\0';
+        if (strcmp(item, "rate") == 0) {
+            next.rate = strtoul(value, nullptr, 10);
+        } else if (strcmp(item, "latency") == 0) {
+            next.latencyMillis = strtoul(value, nullptr, 10);
+        } else if (strcmp(item, "jitter") == 0) {
+            next.jitterMillis = strtoul(value, nullptr, 10);
+        } else if (strcmp(item, "dist") == 0) {
+            if (!parseJitter(value, &next.jitter)) {
+                fprintf(stderr, "Unknown jitter distribution: %s\n", value);
+            }
+        } else if (strcmp(item, "stall") == 0) {
+            char *end;
+            next.stallEveryMillis = strtoul(value, &end, 10);
+            next.stallForMillis = *end == '/' ? strtoul(end + 1, nullptr, 10) : 0;
+            if (next.stallForMillis >= next.stallEveryMillis) {
+                fprintf(stderr, "Ignoring a stall longer than its period: %s\n", value);
+                next.stallEveryMillis = next.stallForMillis = 0;
+            }
+        } else if (strcmp(item, "loss") == 0) {
+            next.loss = std::min(std::max(strtod(value, nullptr), 0.0), 1.0);
+        } else if (strcmp(item, "rto") == 0) {
+            next.rtoMillis = strtoul(value, nullptr, 10);
+        } else if (strcmp(item, "sndbuf") == 0) {
+            next.sendBufferCap = strtoul(value, nullptr, 10);
+        } else if (strcmp(item, "seed") == 0) {
+            // Scrambled, xorshift gives tiny numbers for a while after a small seed and the pareto tail is all there
+            randomState = ((uint32_t) strtoul(value, nullptr, 10) * 2654435761u) | 1;
+        } else {
+            fprintf(stderr, "Unknown network impairment: %s\n", item);
+        }
+    }
+
+    profile = next;
+    enabled = profile.rate > 0 || profile.latencyMillis > 0 || profile.jitterMillis > 0 || profile.stallForMillis > 0 ||
+              profile.loss > 0;
+    tokens = FAKENET_BURST_BYTES;
+    tokensUpdatedMicros = stallOriginMicros = micros64();
+    fprintf(stderr, "Network impairment: rate=%u latency=%u jitter=%u stall=%u/%u loss=%g rto=%u sndbuf=%u\n",
+            profile.rate, profile.latencyMillis, profile.jitterMillis, profile.stallEveryMillis, profile.stallForMillis,
+            profile.loss, profile.rtoMillis, profile.sendBufferCap);
+}
+
+static void checkControlFile(uint64_t now) {
+    if (controlFile == nullptr || now - controlFileCheckedMicros < FAKENET_FILE_CHECK_MICROS) {
+        return;
+    }
+    controlFileCheckedMicros = now;
+    struct stat st = {};
+    if (stat(controlFile, &st) < 0 || (st.st_mtime == controlFileMtime && st.st_size == controlFileSize)) {
+        return;
+    }
+    controlFileMtime = st.st_mtime;
+    controlFileSize = st.st_size;
+    FILE *file = fopen(controlFile, "r");
+    if (file == nullptr) {
+        return;
+    }
+    char spec[FAKENET_SPEC_MAX_LEN] = {0};
+    size_t len = fread(spec, 1, sizeof(spec) - 1, file);
+    fclose(file);
+    spec[len] = '\0';
+    applySpec(spec);
+}
+
+static void init() {
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    const char *spec = getenv("FAKEESP_NET");
+    if (spec != nullptr && spec[0] != '\0') {
+        applySpec(spec);
+    }
+    controlFile = getenv("FAKEESP_NET_FILE");
+    if (controlFile != nullptr && controlFile[0] == '\0') {
+        controlFile = nullptr;
+    }
+    checkControlFile(micros64());
+    if (!reactorAddTick(onReactorTick, nullptr)) {
+        fprintf(stderr, "No room in the reactor for the network impairment\n");
+        panic();
+    }
+}
+
+bool fakeNetEnabled() {
+    init();
+    return enabled;
+}
+
+size_t fakeNetSendBufferCap() {
+    init();
+    return profile.sendBufferCap;
+}
+
+uint64_t fakeNetReleaseTime(uint64_t now, uint64_t notBefore) {
+    double delayMillis = profile.latencyMillis;
+    if (profile.jitterMillis > 0) {
+        switch (profile.jitter) {
+            case FAKENET_JITTER_UNIFORM:
+                delayMillis += (nextUniform() * 2 - 1) * profile.jitterMillis;
+                break;
+            case FAKENET_JITTER_NORMAL:
+                // Box-Muller
+                delayMillis += sqrt(-2 * log(nextUniform())) * cos(2 * M_PI * nextUniform()) * profile.jitterMillis;
+                break;
+            case FAKENET_JITTER_PARETO:
+                delayMillis += std::min(pow(nextUniform(), -1 / FAKENET_PARETO_ALPHA) - 1, (double) FAKENET_PARETO_MAX) *
+                               profile.jitterMillis;
+                break;
+        }
+    }
+    // Each retransmission waits twice as long, like lwIP's backoff
+    for (int retry = 0; retry < FAKENET_MAX_RETRIES && profile.loss > 0 && nextUniform() <= profile.loss; retry++) {
+        delayMillis += (double) profile.rtoMillis * (1 << retry);
+    }
+    uint64_t releaseAt = now + (uint64_t) (std::max(delayMillis, 0.0) * 1000);
+    return std::max(releaseAt, notBefore);
+}
+
+size_t fakeNetAvailable(uint64_t now, size_t wanted, uint64_t *retryAt) {
+    if (profile.stallForMillis > 0) {
+        uint64_t period = (uint64_t) profile.stallEveryMillis * 1000;
+        uint64_t phase = (now - stallOriginMicros) % period;
+        // At the end of each period
+        if (phase >= period - (uint64_t) profile.stallForMillis * 1000) {
+            *retryAt = now + period - phase;
+            return 0;
+        }
+    }
+    if (profile.rate == 0) {
+        return wanted;
+    }
+
+    tokens = std::min(tokens + (double) (now - tokensUpdatedMicros) * profile.rate / 1000000, (double) FAKENET_BURST_BYTES);
+    tokensUpdatedMicros = now;
+    double needed = (double) std::min(wanted, (size_t) FAKENET_MSS);
+    if (tokens < needed) {
+        *retryAt = now + (uint64_t) ceil((needed - tokens) * 1000000 / profile.rate);
+        return 0;
+    }
+    return std::min(wanted, (size_t) tokens);
+}
+
+void fakeNetConsume(size_t len) {
+    if (profile.rate > 0) {
+        tokens -= (double) len;
+    }
+}
+
+void fakeNetSchedule(FakeNetReleaseCallback callback, void *arg, uint64_t at) {
+    init();
+    FakeNetWaiting *free = nullptr;
+    for (FakeNetWaiting &entry: waiting) {
+        if (entry.arg == arg) {
+            free = &entry;
+            break;
+        }
+        if (entry.arg == nullptr && free == nullptr) {
+            free = &entry;
+        }
+    }
+    if (free == nullptr) {
+        fprintf(stderr, "Too many connections waiting for the emulated network\n");
+        panic();
+    }
+    free->callback = callback;
+    free->arg = arg;
+    free->at = at;
+    reactorWakeBy(at);
+}
+
+void fakeNetCancel(void *arg) {
+    for (FakeNetWaiting &entry: waiting) {
+        if (entry.arg == arg) {
+            entry = {};
+        }
+    }
+}
+
+static void onReactorTick(void *arg) {
+    uint64_t now = micros64();
+    checkControlFile(now);
+
+    for (FakeNetWaiting &entry: waiting) {
+        if (entry.arg != nullptr && entry.at <= now) {
+            FakeNetWaiting due = entry;
+            // The callback may schedule it again
+            entry = {};
+            due.callback(due.arg);
+        }
+    }
+    uint64_t next = UINT64_MAX;
+    for (const FakeNetWaiting &entry: waiting) {
+        if (entry.arg != nullptr) {
+            next = std::min(next, entry.at);
+        }
+    }
+    if (next != UINT64_MAX) {
+        reactorWakeBy(next);
+    }
+}
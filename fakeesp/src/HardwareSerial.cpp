@@ -0,0 +1,564 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/serial.h>
+
+#include "Arduino.h"
+#include "HardwareSerial.h"
+
+// glibc has no termios2, which is what takes arbitrary rates. This is the asm-generic layout, used by x86 and ARM.
+struct FakeTermios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+
+#define FAKE_TCGETS2 _IOR('T', 0x2A, FakeTermios2)
+#define FAKE_TCSETS2 _IOW('T', 0x2B, FakeTermios2)
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+// Below this many bytes a rate isn't scored, there isn't enough to tell
+#define AUTOBAUD_MIN_BYTES 8
+// Percentage of text-looking bytes, errors count 4 times
+#define AUTOBAUD_MIN_SCORE 90
+
+static const struct {
+    unsigned long baud;
+    speed_t speed;
+} standardSpeeds[] = {
+        {50, B50}, {75, B75}, {110, B110}, {134, B134}, {150, B150}, {200, B200}, {300, B300}, {600, B600},
+        {1200, B1200}, {1800, B1800}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+        {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400}, {460800, B460800},
+        {500000, B500000}, {576000, B576000}, {921600, B921600}, {1000000, B1000000}, {1152000, B1152000},
+        {1500000, B1500000}, {2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000},
+        {3500000, B3500000}, {4000000, B4000000},
+};
+
+static const unsigned long autobaudCandidates[] = {300, 600, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 74880,
+                                                   115200, 230400, 460800, 921600};
+#define AUTOBAUD_CANDIDATES (sizeof(autobaudCandidates) / sizeof(autobaudCandidates[0]))
+
+FakeSerial::FakeSerial(FILE *out) : out{out} {
+    setRxBufferSize(FAKESERIAL_BUF_LEN);
+    const char *wire = getenv("FAKEESP_UART_WIRE");
+    wireModel = wire != nullptr && wire[0] != '\0' && wire[0] != '0';
+    parseFaults(getenv("FAKEESP_UART_FAULTS"));
+}
+
+FakeSerial::FakeSerial(int uartNr) : FakeSerial(uartNr == UART1 ? stderr : stdout) {
+    ttyPath = getDevicePath(uartNr);
+}
+
+void FakeSerial::parseFaults(const char *spec) {
+    // e.g. overrun=1e-5,framing=1e-6,noise=1e-4,seed=42
+    if (spec == nullptr) {
+        return;
+    }
+    char buf[128];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    char *save = nullptr;
+    for (char *item = strtok_r(buf, ",", &save); item != nullptr; item = strtok_r(nullptr, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (value == nullptr) {
+            fprintf(stderr, "Ignoring UART fault without a value: %s\n", item);
+            continue;
+        }
+        *value++ = '\0';
+        double probability = std::min(std::max(strtod(value, nullptr), 0.0), 1.0);
+        auto threshold = (uint32_t) std::min(probability * 4294967296.0, 4294967295.0);
+        if (strcmp(item, "overrun") == 0) {
+            faults.overrun = threshold;
+        } else if (strcmp(item, "framing") == 0) {
+            faults.framing = threshold;
+        } else if (strcmp(item, "noise") == 0) {
+            faults.noise = threshold;
+        } else if (strcmp(item, "seed") == 0) {
+            // Same seed, same faults at the same bytes
+            faultRandom = (uint32_t) strtoul(value, nullptr, 10) | 1;
+        } else {
+            fprintf(stderr, "Unknown UART fault: %s\n", item);
+        }
+    }
+}
+
+uint32_t FakeSerial::nextFaultRandom() {
+    // xorshift32
+    faultRandom ^= faultRandom << 13;
+    faultRandom ^= faultRandom >> 17;
+    faultRandom ^= faultRandom << 5;
+    return faultRandom;
+}
+
+const char *FakeSerial::getDevicePath(int uartNr) {
+    char name[24];
+    snprintf(name, sizeof(name), "FAKEESP_UART%d", uartNr);
+    const char *path = getenv(name);
+    return path != nullptr && path[0] != '\0' ? path : nullptr;
+}
+
+FakeSerial::~FakeSerial() {
+    delete[] rxBuf;
+    delete[] wireBuf;
+}
+
+void FakeSerial::onRxReadable(void *arg, uint32_t events) {
+    auto *rx = (FakeSerialRx *) arg;
+    rx->readable = true;
+    // Stop watching until it's drained, or yield() wouldn't sleep while flow control holds the data back
+    reactorModify(rx->reactorId, 0);
+}
+
+void FakeSerial::begin(unsigned long baud, SerialConfig config, SerialMode mode, uint8_t tx_pin, bool invert) {
+    this->baud = baud;
+    this->config = config;
+    autobaudCandidate = -1;
+
+    uint8_t dataBits = 5 + ((config & UART_NB_BIT_MASK) >> 2);
+    uint8_t parityBits = (config & UART_PARITY_MASK) != UART_PARITY_NONE ? 1 : 0;
+    uint8_t stopHalfBits;
+    switch (config & UART_NB_STOP_BIT_MASK) {
+        case UART_NB_STOP_BIT_15:
+            stopHalfBits = 3;
+            break;
+        case UART_NB_STOP_BIT_2:
+            stopHalfBits = 4;
+            break;
+        default:
+            stopHalfBits = 2;
+            break;
+    }
+    frameHalfBits = 2 * (1 + dataBits + parityBits) + stopHalfBits;
+
+    if (ttyPath == nullptr) {
+        return;
+    }
+    // The device stays open across end() and begin(): closing it drops DTR, which resets many boards
+    if (ttyFd < 0) {
+        ttyFd = open(ttyPath, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (ttyFd < 0) {
+            fprintf(stderr, "Unable to open %s: %s\n", ttyPath, strerror(errno));
+            panic();
+        }
+        ioctl(ttyFd, TIOCEXCL);
+        ttyRx = {ttyFd, reactorAdd(ttyFd, 0, onRxReadable, &ttyRx), true};
+        if (ttyRx.reactorId < 0) {
+            fprintf(stderr, "Failed to add %s to the reactor\n", ttyPath);
+            panic();
+        }
+        getDriverErrors(lastRxErrors, lastOverruns);
+    }
+    configureTty();
+}
+
+void FakeSerial::end() {
+    autobaudCandidate = -1;
+}
+
+void FakeSerial::configureTty() {
+    termios tio = {};
+    if (tcgetattr(ttyFd, &tio) < 0) {
+        perror("tcgetattr failed");
+        return;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD;
+    switch (config & UART_NB_BIT_MASK) {
+        case UART_NB_BIT_5:
+            tio.c_cflag |= CS5;
+            break;
+        case UART_NB_BIT_6:
+            tio.c_cflag |= CS6;
+            break;
+        case UART_NB_BIT_7:
+            tio.c_cflag |= CS7;
+            break;
+        default:
+            tio.c_cflag |= CS8;
+            break;
+    }
+    switch (config & UART_PARITY_MASK) {
+        case UART_PARITY_EVEN:
+            tio.c_cflag |= PARENB;
+            break;
+        case UART_PARITY_ODD:
+            tio.c_cflag |= PARENB | PARODD;
+            break;
+        default:
+            break;
+    }
+    // termios can't do 1.5 stop bits other than with 5 data bits, where CSTOPB means 1.5
+    if ((config & UART_NB_STOP_BIT_MASK) >= UART_NB_STOP_BIT_15) {
+        tio.c_cflag |= CSTOPB;
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(ttyFd, TCSANOW, &tio) < 0) {
+        perror("tcsetattr failed");
+        return;
+    }
+    if (!setTtySpeed(baud)) {
+        fprintf(stderr, "%s doesn't support %lu baud\n", ttyPath, baud);
+    }
+}
+
+bool FakeSerial::setTtySpeed(unsigned long baud) {
+    for (const auto &standard: standardSpeeds) {
+        if (standard.baud == baud) {
+            termios tio = {};
+            if (tcgetattr(ttyFd, &tio) < 0) {
+                return false;
+            }
+            cfsetispeed(&tio, standard.speed);
+            cfsetospeed(&tio, standard.speed);
+            return tcsetattr(ttyFd, TCSANOW, &tio) == 0;
+        }
+    }
+
+    // Non-standard rates (74880 for the ESP8266 boot ROM, for instance) go through BOTHER, the driver picks the
+    // closest divisor it can do
+    FakeTermios2 tio2 = {};
+    if (ioctl(ttyFd, FAKE_TCGETS2, &tio2) < 0) {
+        return false;
+    }
+    tio2.c_cflag &= ~CBAUD;
+    tio2.c_cflag |= BOTHER;
+    tio2.c_ispeed = baud;
+    tio2.c_ospeed = baud;
+    return ioctl(ttyFd, FAKE_TCSETS2, &tio2) == 0;
+}
+
+size_t FakeSerial::write(const uint8_t *outBuffer, size_t size) {
+    if (ttyFd < 0) {
+        size_t ret = fwrite(outBuffer, sizeof(uint8_t), size, out);
+        fflush(out);
+        if (wireModel) {
+            // The core returns once what's left fits in the TX FIFO, busy waiting meanwhile
+            uint64_t now = micros64();
+            txBusyUntilMicros = std::max(txBusyUntilMicros, now) + wireMicros(size);
+            uint64_t fifoMicros = wireMicros(FAKESERIAL_HW_FIFO_LEN);
+            if (txBusyUntilMicros > now + fifoMicros) {
+                delayMicrosecondsNoYield(txBusyUntilMicros - fifoMicros - now);
+            }
+        }
+        return ret;
+    }
+
+    // Blocks like the real one does when the TX FIFO is full
+    size_t written = 0;
+    while (written < size) {
+        ssize_t ret = ::write(ttyFd, outBuffer + written, size - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret < 0 && errno == EAGAIN) {
+            pollfd pfd = {ttyFd, POLLOUT, 0};
+            if (poll(&pfd, 1, 1000) <= 0) {
+                fprintf(stderr, "Timed out writing to %s\n", ttyPath);
+                break;
+            }
+        } else if (ret < 0 && errno != EINTR) {
+            perror("Failed to write to serial device");
+            break;
+        }
+    }
+    return written;
+}
+
+void FakeSerial::flush() {
+    if (ttyFd >= 0) {
+        tcdrain(ttyFd);
+        return;
+    }
+    fflush(out);
+    uint64_t now = micros64();
+    if (wireModel && txBusyUntilMicros > now) {
+        delayMicrosecondsNoYield(txBusyUntilMicros - now);
+    }
+}
+
+size_t FakeSerial::readSource(uint8_t *buf, size_t size, size_t head, size_t len) {
+    FakeSerialRx *source = rx();
+    if (!source->readable || len == size) {
+        return 0;
+    }
+
+    // Read straight into the free part of the ring, which may wrap around
+    size_t tail = (head + len) % size;
+    size_t free = size - len;
+    size_t first = std::min(free, size - tail);
+    iovec iov[2] = {{buf + tail, first}, {buf, free - first}};
+    ssize_t bread = readv(source->fd, iov, free > first ? 2 : 1);
+
+    if (bread > 0) {
+        return bread;
+    }
+    if (bread < 0 && (errno == EAGAIN || errno == EINTR)) {
+        if (source->reactorId >= 0) {
+            source->readable = false;
+            reactorModify(source->reactorId, EPOLLIN);
+        }
+        return 0;
+    }
+    if (source->reactorId < 0) {
+        // Not watched, keep trying
+        return 0;
+    }
+    // EOF on stdin, or the device went away: it would be reported as readable forever
+    if (bread < 0) {
+        perror("Failed to read from serial");
+    }
+    source->readable = false;
+    reactorRemove(source->reactorId);
+    source->reactorId = -1;
+    return 0;
+}
+
+void FakeSerial::fillRx() {
+    if (isModelled()) {
+        if (wireBuf == nullptr) {
+            wireBuf = new uint8_t[FAKESERIAL_WIRE_BUF_LEN];
+        }
+        // What was already on the wire goes first, then the device gets to queue more
+        releaseWire();
+        wireLen += readSource(wireBuf, FAKESERIAL_WIRE_BUF_LEN, wireHead, wireLen);
+        releaseWire();
+        return;
+    }
+
+    size_t tail = (rxHead + rxLen) % rxBufSize;
+    size_t bread = readSource(rxBuf, rxBufSize, rxHead, rxLen);
+    if (autobaudCandidate >= 0) {
+        for (size_t i = 0; i < bread; i++) {
+            uint8_t c = rxBuf[(tail + i) % rxBufSize];
+            autobaudBytes++;
+            if ((c >= 0x20 && c < 0x7F) || c == '\r' || c == '\n' || c == '\t' || c == '\b' || c == 0x1B) {
+                autobaudTextBytes++;
+            }
+        }
+    }
+    rxLen += bread;
+}
+
+void FakeSerial::releaseWire() {
+    uint64_t now = micros64();
+    if (wireLen == 0) {
+        // Idle line, nothing to catch up on once the device starts sending again
+        wireLastMicros = now;
+        wireCredit = 0;
+        return;
+    }
+
+    size_t due = wireLen;
+    uint64_t frameCost = (uint64_t) frameHalfBits * 500000;
+    if (wireModel) {
+        wireCredit += (now - wireLastMicros) * baud;
+        wireLastMicros = now;
+        due = std::min<uint64_t>(wireCredit / frameCost, wireLen);
+        wireCredit = due == wireLen ? wireCredit % frameCost : wireCredit - due * frameCost;
+    }
+
+    uint8_t dataBits = 5 + ((config & UART_NB_BIT_MASK) >> 2);
+    uint8_t dataMask = (1 << dataBits) - 1;
+    bool parity = (config & UART_PARITY_MASK) != UART_PARITY_NONE;
+    for (size_t i = 0; i < due && wireLen > 0; i++) {
+        uint8_t c = wireBuf[wireHead] & dataMask;
+        wireHead = (wireHead + 1) % FAKESERIAL_WIRE_BUF_LEN;
+        wireLen--;
+
+        if (faults.overrun && nextFaultRandom() < faults.overrun) {
+            // The ISR was late: the FIFO filled up, and whatever was in it is gone
+            size_t lost = std::min(wireLen, (size_t) FAKESERIAL_HW_FIFO_LEN - 1);
+            wireHead = (wireHead + lost) % FAKESERIAL_WIRE_BUF_LEN;
+            wireLen -= lost;
+            i += lost;
+            wireOverrun = true;
+            continue;
+        }
+        if (faults.framing && nextFaultRandom() < faults.framing) {
+            // Bad stop bit, the byte is garbage
+            c = nextFaultRandom() & dataMask;
+            wireRxError = true;
+        } else if (faults.noise && nextFaultRandom() < faults.noise) {
+            // A flipped bit, only noticed if there's a parity bit
+            c ^= 1 << (nextFaultRandom() % dataBits);
+            wireRxError |= parity;
+        }
+
+        if (rxLen == rxBufSize) {
+            // Like the ESP8266 core, bytes that don't fit in the RX buffer are dropped
+            wireOverrun = true;
+            continue;
+        }
+        rxBuf[(rxHead + rxLen) % rxBufSize] = c;
+        rxLen++;
+    }
+
+    if (wireModel && wireLen > 0) {
+        // Come back when the next byte is in
+        reactorWakeBy(now + (frameCost - wireCredit + baud - 1) / baud);
+    }
+}
+
+int FakeSerial::available() {
+    fillRx();
+    return (int) rxLen;
+}
+
+int FakeSerial::read() {
+    fillRx();
+    if (rxLen == 0) {
+        return -1;
+    }
+    uint8_t c = rxBuf[rxHead];
+    rxHead = (rxHead + 1) % rxBufSize;
+    rxLen--;
+    return c;
+}
+
+int FakeSerial::peek() {
+    fillRx();
+    if (rxLen == 0) {
+        return -1;
+    }
+    return rxBuf[rxHead];
+}
+
+size_t FakeSerial::readBytes(char *outBuffer, size_t length) {
+    if (rxLen < length) {
+        fillRx();
+    }
+    size_t readLen = std::min(length, rxLen);
+    size_t first = std::min(readLen, rxBufSize - rxHead);
+    memcpy(outBuffer, rxBuf + rxHead, first);
+    memcpy(outBuffer + first, rxBuf, readLen - first);
+    rxHead = (rxHead + readLen) % rxBufSize;
+    rxLen -= readLen;
+    return readLen;
+}
+
+size_t FakeSerial::setRxBufferSize(size_t size) {
+    if (size == 0 || size == rxBufSize) {
+        return rxBufSize;
+    }
+    auto *newBuf = new uint8_t[size];
+    size_t keep = std::min(rxLen, size);
+    for (size_t i = 0; i < keep; i++) {
+        newBuf[i] = rxBuf[(rxHead + i) % rxBufSize];
+    }
+    delete[] rxBuf;
+    rxBuf = newBuf;
+    rxBufSize = size;
+    rxHead = 0;
+    rxLen = keep;
+    return size;
+}
+
+bool FakeSerial::getDriverErrors(uint32_t &rxErrors, uint32_t &overruns) {
+    serial_icounter_struct icount = {};
+    // Most USB adapters count at least some of them, pseudo terminals and pipes don't
+    if (ttyFd < 0 || ioctl(ttyFd, TIOCGICOUNT, &icount) < 0) {
+        return false;
+    }
+    rxErrors = icount.frame + icount.parity;
+    overruns = icount.overrun + icount.buf_overrun;
+    return true;
+}
+
+bool FakeSerial::hasOverrun() {
+    bool ret = wireOverrun;
+    wireOverrun = false;
+    uint32_t rxErrors, overruns;
+    if (getDriverErrors(rxErrors, overruns)) {
+        ret |= overruns != lastOverruns;
+        lastOverruns = overruns;
+    }
+    return ret;
+}
+
+bool FakeSerial::hasRxError() {
+    bool ret = wireRxError;
+    wireRxError = false;
+    uint32_t rxErrors, overruns;
+    if (getDriverErrors(rxErrors, overruns)) {
+        ret |= rxErrors != lastRxErrors;
+        lastRxErrors = rxErrors;
+    }
+    return ret;
+}
+
+void FakeSerial::sendBreak() {
+    if (ttyFd < 0) {
+        return;
+    }
+    tcdrain(ttyFd);
+    // 0 means 0.25 to 0.5 s, plenty for agetty
+    tcsendbreak(ttyFd, 0);
+}
+
+void FakeSerial::startAutobaudCandidate(int8_t candidate) {
+    autobaudCandidate = candidate;
+    setTtySpeed(autobaudCandidates[candidate]);
+    // Whatever is there was received at the previous rate
+    tcflush(ttyFd, TCIFLUSH);
+    autobaudBytes = 0;
+    autobaudTextBytes = 0;
+    uint32_t overruns;
+    autobaudErrorsAtStart = 0;
+    getDriverErrors(autobaudErrorsAtStart, overruns);
+}
+
+int FakeSerial::estimateBaudrate() {
+    if (ttyFd < 0) {
+        return 0;
+    }
+    if (autobaudCandidate < 0) {
+        autobaudSavedBaud = baud;
+        autobaudBest = 0;
+        autobaudBestScore = 0;
+        startAutobaudCandidate(0);
+        return 0;
+    }
+
+    fillRx();
+    uint32_t errors = 0, overruns;
+    if (getDriverErrors(errors, overruns)) {
+        errors -= autobaudErrorsAtStart;
+    }
+    if (autobaudBytes >= AUTOBAUD_MIN_BYTES) {
+        uint32_t score = autobaudTextBytes * 100 / (autobaudBytes + errors * 4);
+        if (score > autobaudBestScore) {
+            autobaudBestScore = score;
+            autobaudBest = autobaudCandidates[autobaudCandidate];
+        }
+    }
+
+    if ((size_t) autobaudCandidate + 1 < AUTOBAUD_CANDIDATES) {
+        startAutobaudCandidate((int8_t) (autobaudCandidate + 1));
+        return 0;
+    }
+
+    // Sweep done, go back to what the user asked for. If nothing was convincing, the next call starts over.
+    autobaudCandidate = -1;
+    setTtySpeed(autobaudSavedBaud);
+    if (autobaudBestScore < AUTOBAUD_MIN_SCORE) {
+        return 0;
+    }
+    return (int) autobaudBest;
+}
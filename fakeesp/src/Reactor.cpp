@@ -0,0 +1,171 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Reactor.h"
+
+#define REACTOR_MAX_EVENTS 16
+// With virtual time, how far a poll that finds nothing and has no deadline moves the clock, so that busy loops make
+// progress
+#define REACTOR_VIRTUAL_IDLE_QUANTUM_MICROS 1
+
+struct ReactorSlot {
+    int fd;
+    ReactorCallback callback;
+    void *arg;
+    // Bumped when the slot is freed, so that stale events already returned by epoll_wait() are ignored
+    uint32_t generation;
+};
+
+struct ReactorTick {
+    ReactorTickCallback callback;
+    void *arg;
+};
+
+static ReactorSlot slots[REACTOR_SLOTS] = {};
+static ReactorTick ticks[REACTOR_TICKS] = {};
+static int epollFd = -1;
+static uint64_t yieldDeadlineMicros = 0;
+static uint64_t wakeByMicros = UINT64_MAX;
+// With virtual time, how long to really wait for the sockets before skipping to the deadline
+static int virtualIdleMillis = 0;
+
+static void reactorInit() {
+    if (epollFd >= 0) {
+        return;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        perror("Unable to create epoll instance");
+        panic();
+    }
+    const char *idle = getenv("FAKEESP_VIRTUAL_TIME_IDLE_MS");
+    if (idle != nullptr) {
+        virtualIdleMillis = atoi(idle);
+    }
+}
+
+static uint64_t slotData(int32_t id) {
+    return ((uint64_t) slots[id].generation << 32) | (uint32_t) id;
+}
+
+int32_t reactorAdd(int fd, uint32_t events, ReactorCallback callback, void *arg) {
+    reactorInit();
+    for (int32_t i = 0; i < REACTOR_SLOTS; i++) {
+        if (slots[i].callback == nullptr) {
+            slots[i].fd = fd;
+            slots[i].callback = callback;
+            slots[i].arg = arg;
+
+            epoll_event event = {};
+            event.events = events;
+            event.data.u64 = slotData(i);
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                // errno is left for the caller, e.g. EPERM for regular files
+                slots[i].callback = nullptr;
+                return -1;
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+void reactorModify(int32_t id, uint32_t events) {
+    epoll_event event = {};
+    event.events = events;
+    event.data.u64 = slotData(id);
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, slots[id].fd, &event) < 0) {
+        perror("Unable to modify epoll fd");
+    }
+}
+
+void reactorRemove(int32_t id) {
+    // Fails if the fd has been closed already, it's been dropped from the set anyway
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, slots[id].fd, nullptr);
+    slots[id].fd = -1;
+    slots[id].callback = nullptr;
+    slots[id].arg = nullptr;
+    slots[id].generation++;
+}
+
+void reactorPoll(uint64_t timeoutMicros) {
+    reactorInit();
+    if (wakeByMicros != UINT64_MAX) {
+        uint64_t now = micros64();
+        if (wakeByMicros <= now) {
+            wakeByMicros = UINT64_MAX;
+            timeoutMicros = 0;
+        } else {
+            timeoutMicros = std::min(timeoutMicros, wakeByMicros - now);
+        }
+    }
+    epoll_event events[REACTOR_MAX_EVENTS];
+    // Round up, so that we don't spin for the last fraction of a millisecond
+    int timeoutMillis = (int) std::min<uint64_t>((timeoutMicros + 999) / 1000, INT32_MAX);
+    if (virtualTimeEnabled()) {
+        // Clients in other processes get a moment to answer, then time skips ahead
+        timeoutMillis = std::min(timeoutMillis, virtualIdleMillis);
+    }
+    int count = epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, timeoutMillis);
+    if (count < 0) {
+        if (errno != EINTR) {
+            perror("epoll_wait failed");
+            panic();
+        }
+        return;
+    }
+    if (count == 0) {
+        // Nothing happened until the deadline
+        virtualTimeAdvance(timeoutMicros > 0 ? timeoutMicros : REACTOR_VIRTUAL_IDLE_QUANTUM_MICROS);
+    }
+
+    for (int i = 0; i < count; i++) {
+        auto id = (uint32_t) events[i].data.u64;
+        auto generation = (uint32_t) (events[i].data.u64 >> 32);
+        // A previous callback may have closed this fd
+        if (slots[id].callback == nullptr || slots[id].generation != generation) {
+            continue;
+        }
+        slots[id].callback(slots[id].arg, events[i].events);
+    }
+
+    for (ReactorTick &tick: ticks) {
+        if (tick.callback != nullptr) {
+            tick.callback(tick.arg);
+        }
+    }
+}
+
+bool reactorAddTick(ReactorTickCallback callback, void *arg) {
+    for (ReactorTick &tick: ticks) {
+        if (tick.callback == nullptr) {
+            tick.callback = callback;
+            tick.arg = arg;
+            return true;
+        }
+    }
+    return false;
+}
+
+void reactorSetYieldDeadline(uint64_t deadlineMicros) {
+    yieldDeadlineMicros = deadlineMicros;
+}
+
+void reactorWakeBy(uint64_t deadlineMicros) {
+    wakeByMicros = std::min(wakeByMicros, deadlineMicros);
+}
+
+void yield() {
+    uint64_t now = micros64();
+    uint64_t timeout = yieldDeadlineMicros > now ? yieldDeadlineMicros - now : 0;
+    // Only the first yield() after the deadline is set sleeps, the others just run the callbacks
+    yieldDeadlineMicros = 0;
+    reactorPoll(timeout);
+}
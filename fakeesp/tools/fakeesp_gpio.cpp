@@ -0,0 +1,160 @@
+//
+// Created by depau on 10/19/26.
+//
+// Shows the GPIO state of a running fakeesp and drives its input pins, through the file it shares it in.
+//
+//   fakeesp_gpio                  Print the state
+//   fakeesp_gpio watch            Print the state every time it changes
+//   fakeesp_gpio drive PIN VALUE  Make digitalRead()/analogRead() return VALUE for PIN
+//   fakeesp_gpio release PIN|all  Go back to reading the last value written by the firmware
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "FakeGPIO.h"
+
+// Same values as in Arduino.h, which can't be included here
+#define MODE_INPUT   0x00
+#define MODE_OUTPUT  0x01
+#define MODE_PULLUP  0x02
+#define MODE_PWM_OUT 0xFF
+
+static FakeGpioShared *mapGpioFile() {
+    const char *path = getenv("FAKEESP_GPIO_FILE");
+    if (path == nullptr) {
+        path = "/dev/shm/fakeesp_gpio";
+    }
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\nIs fakeesp running?\n", path, strerror(errno));
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, sizeof(FakeGpioShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s: %s\n", path, strerror(errno));
+        return nullptr;
+    }
+    auto *shared = (FakeGpioShared *) addr;
+    if (shared->magic != FAKEESP_GPIO_MAGIC || shared->version != FAKEESP_GPIO_VERSION ||
+        shared->pinCount != FAKEESP_GPIO_PINS) {
+        fprintf(stderr, "%s has an unknown layout, it was written by a different fakeesp version\n", path);
+        return nullptr;
+    }
+    return shared;
+}
+
+static const char *modeName(uint8_t mode) {
+    switch (mode) {
+        case MODE_INPUT:
+            return "INP";
+        case MODE_OUTPUT:
+            return "OUT";
+        case MODE_PULLUP:
+            return "IPU";
+        case MODE_PWM_OUT:
+            return "PWM";
+        default:
+            return "???";
+    }
+}
+
+static void printState(const FakeGpioShared *shared, const FakeGpioSnapshot &snapshot) {
+    uint32_t driveMask = shared->driveMask.load(std::memory_order_acquire);
+
+    printf("PIN:  ");
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        printf(" %3d ", i);
+    }
+    printf("\n------");
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        printf("-----");
+    }
+    printf("\nMODE: ");
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        printf(" %s ", modeName(snapshot.modes[i]));
+    }
+    printf("\nVALUE:");
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        printf(" %3d ", snapshot.values[i]);
+    }
+    printf("\nDRIVE:");
+    for (int i = 0; i < FAKEESP_GPIO_PINS; i++) {
+        if (driveMask & (1u << i)) {
+            printf(" %3d ", shared->driveValues[i].load(std::memory_order_relaxed));
+        } else {
+            printf("   - ");
+        }
+    }
+    printf("\nUpdates: %u\n", snapshot.sequence / 2);
+}
+
+static int parsePin(const char *arg) {
+    char *end;
+    long pin = strtol(arg, &end, 10);
+    if (*end != '\0' || pin < 0 || pin >= FAKEESP_GPIO_PINS) {
+        fprintf(stderr, "Invalid pin: %s\n", arg);
+        return -1;
+    }
+    return (int) pin;
+}
+
+int main(int argc, char **argv) {
+    FakeGpioShared *shared = mapGpioFile();
+    if (shared == nullptr) {
+        return 1;
+    }
+
+    FakeGpioSnapshot snapshot = {};
+    if (argc == 1) {
+        fakeGpioReadSnapshot(shared, &snapshot);
+        printState(shared, snapshot);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "watch") == 0) {
+        uint32_t lastSequence = 1; // Never a stable value
+        while (true) {
+            if (shared->sequence.load(std::memory_order_acquire) != lastSequence) {
+                fakeGpioReadSnapshot(shared, &snapshot);
+                lastSequence = snapshot.sequence;
+                printState(shared, snapshot);
+                putchar('\n');
+                fflush(stdout);
+            }
+            usleep(10000);
+        }
+    }
+
+    if (strcmp(argv[1], "drive") == 0 && argc == 4) {
+        int pin = parsePin(argv[2]);
+        if (pin < 0) {
+            return 1;
+        }
+        shared->driveValues[pin].store((int32_t) strtol(argv[3], nullptr, 10), std::memory_order_relaxed);
+        shared->driveMask.fetch_or(1u << pin, std::memory_order_release);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "release") == 0 && argc == 3) {
+        if (strcmp(argv[2], "all") == 0) {
+            shared->driveMask.store(0, std::memory_order_release);
+            return 0;
+        }
+        int pin = parsePin(argv[2]);
+        if (pin < 0) {
+            return 1;
+        }
+        shared->driveMask.fetch_and(~(1u << pin), std::memory_order_release);
+        return 0;
+    }
+
+    fprintf(stderr, "Usage: %s [watch | drive PIN VALUE | release PIN|all]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,1402 @@
+//
+// Created by depau on 10/19/26.
+//
+// Load generator for wi-se_fakeesp. For every baud rate and client count in the matrix it starts a fresh server with
+// the UART wire model (FAKEESP_UART_WIRE), the emulated heap (FAKEESP_HEAP) and optionally an emulated Wi-Fi link
+// (FAKEESP_NET), plays a device writing numbered
+// records into the UART at line rate, honoring XON/XOFF, and has N ttyd clients receive them over WebSocket. It reports
+// throughput, lost records, record latency percentiles, CPU time and heap usage as JSON.
+//
+//   wi-se_bench --port 8080 --baud 115200,921600 --clients 1,2,3 --output results.json
+//
+// Run with --help for all the options.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifndef WISE_BENCH_SERVER
+#define WISE_BENCH_SERVER "./wi-se_fakeesp"
+#endif
+
+// Same values as in ttyd.h, which can't be included here
+#define CMD_INPUT         '0'
+#define CMD_PAUSE         '2'
+#define CMD_RESUME        '3'
+#define CMD_OUTPUT        '0'
+#define CMD_SERVER_PAUSE  'S'
+#define CMD_SERVER_RESUME 'Q'
+
+#define FLOW_CTL_XOFF 0x13
+#define FLOW_CTL_XON  0x11
+
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT         0x1
+#define WS_OP_BINARY       0x2
+#define WS_OP_CLOSE        0x8
+#define WS_OP_PING         0x9
+#define WS_OP_PONG         0xA
+
+// The bench only sets the baud rate, frames are always 8N1
+#define BITS_PER_FRAME 10
+
+#define RECORD_SEQ_DIGITS 8
+#define RECORD_MIN_SIZE   16
+#define RECORD_MAX_SIZE   4096
+
+// The source doesn't catch up for more than this after XOFF or a full pipe: a device would have dropped the data
+#define SOURCE_MAX_CREDIT_MICROS 10000
+
+#define INPUT_EVERY_MICROS   50000
+#define HEAP_SAMPLE_MICROS   200000
+#define SERVER_START_MILLIS  10000
+#define CLIENT_READY_MILLIS  5000
+#define HTTP_TIMEOUT_MILLIS  2000
+
+struct Options {
+    const char *server = WISE_BENCH_SERVER;
+    const char *host = "127.0.0.1";
+    uint16_t port = 8080;
+    std::string auth;
+    std::vector<uint32_t> bauds = {115200, 460800, 921600};
+    std::vector<uint32_t> clientCounts = {1, 2, 3};
+    uint32_t durationMillis = 10000;
+    uint32_t drainMillis = 2000;
+    const char *content = "text";
+    uint32_t recordSize = 64;
+    uint32_t heap = 50000;
+    uint32_t tcpWindow = 5840;
+    const char *net = nullptr;
+    uint32_t pauseEveryMillis = 0;
+    uint32_t pauseForMillis = 0;
+    uint32_t inputRate = 0;
+    uint32_t fragments = 1;
+    const char *output = nullptr;
+    const char *serverLog = "/dev/null";
+};
+
+static uint64_t nowMicros() {
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static std::string base64(const std::string &in) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < in.size(); i += 3) {
+        uint32_t chunk = (uint8_t) in[i] << 16;
+        if (i + 1 < in.size()) chunk |= (uint8_t) in[i + 1] << 8;
+        if (i + 2 < in.size()) chunk |= (uint8_t) in[i + 2];
+        out += alphabet[(chunk >> 18) & 0x3f];
+        out += alphabet[(chunk >> 12) & 0x3f];
+        out += i + 1 < in.size() ? alphabet[(chunk >> 6) & 0x3f] : '=';
+        out += i + 2 < in.size() ? alphabet[chunk & 0x3f] : '=';
+    }
+    return out;
+}
+
+// Finds "key": in a JSON document and parses the number after it. Good enough for the flat answers of the firmware.
+static bool jsonNumber(const std::string &json, const char *key, size_t from, double *value, size_t *end = nullptr) {
+    std::string needle = std::string("\"") + key + "\"";
+    size_t pos = json.find(needle, from);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos = json.find(':', pos + needle.size());
+    if (pos == std::string::npos) {
+        return false;
+    }
+    char *numberEnd;
+    *value = strtod(json.c_str() + pos + 1, &numberEnd);
+    if (end != nullptr) {
+        *end = numberEnd - json.c_str();
+    }
+    return numberEnd != json.c_str() + pos + 1;
+}
+
+static double jsonSum(const std::string &json, const char *key) {
+    double sum = 0;
+    double value;
+    size_t pos = 0;
+    while (jsonNumber(json, key, pos, &value, &pos)) {
+        sum += value;
+    }
+    return sum;
+}
+
+static std::string jsonString(const std::string &json, const char *key) {
+    std::string needle = std::string("\"") + key + "\"";
+    size_t pos = json.find(needle);
+    if (pos == std::string::npos || (pos = json.find('"', json.find(':', pos + needle.size()))) == std::string::npos) {
+        return "";
+    }
+    size_t end = json.find('"', pos + 1);
+    return end == std::string::npos ? "" : json.substr(pos + 1, end - pos - 1);
+}
+
+// ---- HTTP
+
+static int connectToServer(const Options &opts, uint32_t timeoutMillis) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    if (inet_pton(AF_INET, opts.host, &addr.sin_addr) != 1) {
+        hostent *host = gethostbyname(opts.host);
+        if (host == nullptr || host->h_addrtype != AF_INET) {
+            return -1;
+        }
+        memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof(addr.sin_addr));
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    timeval timeout = {(time_t) (timeoutMillis / 1000), (suseconds_t) (timeoutMillis % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static std::string authorizationHeader(const Options &opts) {
+    if (opts.auth.empty()) {
+        return "";
+    }
+    return "Authorization: Basic " + base64(opts.auth) + "\r\n";
+}
+
+static bool sendAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// HTTP/1.0 so the body ends with the connection, no chunked encoding.
+static int httpRequest(const Options &opts, const char *method, const char *path, const std::string &body,
+                       std::string *response) {
+    int fd = connectToServer(opts, HTTP_TIMEOUT_MILLIS);
+    if (fd < 0) {
+        return -1;
+    }
+    std::string request = std::string(method) + " " + path + " HTTP/1.0\r\n" + authorizationHeader(opts);
+    if (!body.empty()) {
+        request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    request += "\r\n" + body;
+
+    std::string raw;
+    if (sendAll(fd, request.data(), request.size())) {
+        char buf[4096];
+        ssize_t len;
+        while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            raw.append(buf, len);
+        }
+    }
+    close(fd);
+
+    int status;
+    size_t headersEnd = raw.find("\r\n\r\n");
+    if (headersEnd == std::string::npos || sscanf(raw.c_str(), "HTTP/%*s %d", &status) != 1) {
+        return -1;
+    }
+    if (response != nullptr) {
+        *response = raw.substr(headersEnd + 4);
+    }
+    return status;
+}
+
+// ---- UART source
+
+// Plays the device: writes records at line rate into the server's stdin and stops while it's been sent XOFF. Each record
+// is the sequence number in hex, a space, filler and CRLF, so clients can spot lost and damaged records and the time
+// they took can be measured.
+class Source {
+private:
+    uint32_t recordSize;
+    std::string filler;
+    bool randomFiller;
+    uint32_t randomState = 1;
+
+    double bytesPerMicro = 0;
+    double credit = 0;
+    uint64_t lastUpdateMicros = 0;
+
+    std::string record;
+    size_t recordPos = 0;
+
+public:
+    bool xoff = false;
+    uint64_t xoffSinceMicros = 0;
+    uint64_t xoffMicros = 0;
+    uint32_t xoffCount = 0;
+
+    uint64_t bytes = 0;
+    // When the last byte of each record went out, by sequence number
+    std::vector<uint64_t> sentAtMicros;
+
+    Source(uint32_t recordSize, const std::string &filler, bool randomFiller)
+            : recordSize(recordSize), filler(filler), randomFiller(randomFiller) {}
+
+    void start(uint32_t baud, uint64_t now) {
+        bytesPerMicro = (double) baud / BITS_PER_FRAME / 1000000;
+        lastUpdateMicros = now;
+    }
+
+    uint32_t getRecordCount() const {
+        return sentAtMicros.size();
+    }
+
+    void onFlowControl(uint8_t byte, uint64_t now) {
+        if (byte == FLOW_CTL_XOFF && !xoff) {
+            xoff = true;
+            xoffSinceMicros = now;
+            xoffCount++;
+        } else if (byte == FLOW_CTL_XON && xoff) {
+            xoff = false;
+            xoffMicros += now - xoffSinceMicros;
+        }
+    }
+
+    bool hasDueBytes(uint64_t now) {
+        if (!xoff) {
+            credit = std::min(credit + (double) (now - lastUpdateMicros) * bytesPerMicro,
+                              std::max(SOURCE_MAX_CREDIT_MICROS * bytesPerMicro, 1.0));
+        }
+        lastUpdateMicros = now;
+        return credit >= 1;
+    }
+
+    // Returns false if the pipe is broken.
+    bool write(int fd, uint64_t now) {
+        while (credit >= 1 && !xoff) {
+            if (recordPos == record.size()) {
+                nextRecord();
+            }
+            size_t len = std::min((size_t) credit, record.size() - recordPos);
+            ssize_t written = ::write(fd, record.data() + recordPos, len);
+            if (written < 0) {
+                return errno == EAGAIN || errno == EINTR;
+            }
+            recordPos += written;
+            bytes += written;
+            credit -= (double) written;
+            if (recordPos == record.size()) {
+                sentAtMicros.push_back(now);
+            }
+        }
+        return true;
+    }
+
+    void finish(uint64_t now) {
+        if (xoff) {
+            xoffMicros += now - xoffSinceMicros;
+            xoff = false;
+        }
+    }
+
+private:
+    void nextRecord() {
+        char seq[RECORD_SEQ_DIGITS + 2];
+        snprintf(seq, sizeof(seq), "%08" PRIx32 " ", (uint32_t) sentAtMicros.size());
+        record = seq;
+        size_t fillerLen = recordSize - RECORD_SEQ_DIGITS - 3;
+        for (size_t i = 0; i < fillerLen; i++) {
+            if (randomFiller) {
+                randomState ^= randomState << 13;
+                randomState ^= randomState >> 17;
+                randomState ^= randomState << 5;
+                record += (char) (' ' + randomState % 95);
+            } else {
+                record += filler[(sentAtMicros.size() * fillerLen + i) % filler.size()];
+            }
+        }
+        record += "\r\n";
+        recordPos = 0;
+    }
+};
+
+// ---- ttyd client
+
+class Client {
+private:
+    const Options &opts;
+    const Source &source;
+    uint32_t index;
+    uint32_t count;
+
+    std::string rx;
+    std::string tx;
+    std::string message;
+    bool inMessage = false;
+    std::string line;
+
+    std::vector<bool> seen;
+
+    uint64_t nextPauseMicros = 0;
+    uint64_t resumeMicros = 0;
+    uint64_t nextInputMicros = 0;
+    bool inputHeld = false;
+
+public:
+    int fd = -1;
+    bool closed = false;
+    std::string error;
+
+    uint32_t messages = 0;
+    uint64_t recordBytes = 0;
+    uint32_t records = 0;
+    uint32_t corrupt = 0;
+    uint32_t duplicates = 0;
+    uint32_t pauses = 0;
+    uint64_t inputBytes = 0;
+    std::vector<uint32_t> latencies;
+
+    Client(const Options &opts, const Source &source, uint32_t index, uint32_t count)
+            : opts(opts), source(source), index(index), count(count) {}
+
+    ~Client() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool connectAndAuthenticate(const std::string &token) {
+        fd = connectToServer(opts, HTTP_TIMEOUT_MILLIS);
+        if (fd < 0) {
+            return fail("unable to connect");
+        }
+
+        std::string key;
+        for (int i = 0; i < 16; i++) {
+            key += (char) (rand() & 0xff);
+        }
+        std::string request = "GET /ws HTTP/1.1\r\nHost: " + std::string(opts.host) + "\r\n" +
+                              "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\n" +
+                              "Sec-WebSocket-Protocol: tty\r\nSec-WebSocket-Key: " + base64(key) + "\r\n" +
+                              authorizationHeader(opts) + "\r\n";
+        if (!sendAll(fd, request.data(), request.size())) {
+            return fail("unable to send the handshake");
+        }
+        size_t headersEnd;
+        char buf[1024];
+        while ((headersEnd = rx.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                return fail("no handshake response");
+            }
+            rx.append(buf, len);
+        }
+        if (rx.compare(0, 12, "HTTP/1.1 101") != 0) {
+            return fail("handshake refused: " + rx.substr(0, rx.find("\r\n")));
+        }
+        // Frames may have come right after the headers
+        rx.erase(0, headersEnd + 4);
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        // Like the web UI, the token is sent whether authentication is enabled or not
+        std::string auth = R"({"AuthToken":")" + token + R"(","columns":80,"rows":24})";
+        queueFrame(WS_OP_TEXT, true, auth.data(), auth.size());
+        return true;
+    }
+
+    void start(uint64_t now) {
+        if (opts.pauseEveryMillis > 0) {
+            // Staggered, so that the clients don't all pause at once
+            nextPauseMicros = now + (uint64_t) opts.pauseEveryMillis * 1000 * (index + 1) / count;
+        }
+        nextInputMicros = now + INPUT_EVERY_MICROS;
+    }
+
+    short pollEvents() const {
+        if (closed) {
+            return 0;
+        }
+        // While paused it's busy doing something else, the data piles up in the socket
+        return (short) ((resumeMicros == 0 ? POLLIN : 0) | (tx.empty() ? 0 : POLLOUT));
+    }
+
+    void onEvents(short events, uint64_t now) {
+        if (events & (POLLERR | POLLHUP | POLLNVAL) && !(events & POLLIN)) {
+            fail("connection lost");
+            return;
+        }
+        if (events & POLLOUT) {
+            flush();
+        }
+        if (events & POLLIN) {
+            char buf[65536];
+            ssize_t len;
+            while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+                rx.append(buf, len);
+                parseFrames(now);
+            }
+            if (len == 0) {
+                fail("closed by the server");
+            } else if (errno != EAGAIN && errno != EINTR) {
+                fail(strerror(errno));
+            }
+        }
+    }
+
+    // Pauses, resumes and sends input when it's time to.
+    void tick(uint64_t now, bool sourceRunning) {
+        if (closed) {
+            return;
+        }
+        if (resumeMicros != 0 && now >= resumeMicros) {
+            char resume = CMD_RESUME;
+            queueFrame(WS_OP_BINARY, true, &resume, 1);
+            resumeMicros = 0;
+        }
+        if (sourceRunning && nextPauseMicros != 0 && now >= nextPauseMicros && resumeMicros == 0) {
+            char pause = CMD_PAUSE;
+            queueFrame(WS_OP_BINARY, true, &pause, 1);
+            pauses++;
+            resumeMicros = now + (uint64_t) opts.pauseForMillis * 1000;
+            nextPauseMicros += (uint64_t) opts.pauseEveryMillis * 1000;
+        }
+        if (sourceRunning && opts.inputRate > 0 && now >= nextInputMicros) {
+            nextInputMicros += INPUT_EVERY_MICROS;
+            if (!inputHeld) {
+                sendInput(std::max<uint32_t>(1, (uint64_t) opts.inputRate * INPUT_EVERY_MICROS / 1000000));
+            }
+        }
+        if (!tx.empty()) {
+            flush();
+        }
+    }
+
+    uint32_t getUniqueRecords() const {
+        return records;
+    }
+
+private:
+    bool fail(const std::string &reason) {
+        if (error.empty()) {
+            error = reason;
+        }
+        closed = true;
+        return false;
+    }
+
+    void queueFrame(uint8_t opcode, bool fin, const char *data, size_t len) {
+        tx += (char) ((fin ? 0x80 : 0) | opcode);
+        if (len < 126) {
+            tx += (char) (0x80 | len);
+        } else if (len < 65536) {
+            tx += (char) (0x80 | 126);
+            tx += (char) (len >> 8);
+            tx += (char) len;
+        } else {
+            tx += (char) (0x80 | 127);
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                tx += (char) ((uint64_t) len >> shift);
+            }
+        }
+        uint8_t mask[4];
+        for (uint8_t &byte: mask) {
+            byte = rand() & 0xff;
+            tx += (char) byte;
+        }
+        for (size_t i = 0; i < len; i++) {
+            tx += (char) (data[i] ^ mask[i % 4]);
+        }
+    }
+
+    // Keystrokes, split in as many WebSocket frames as asked, each written on its own so they reach the server in
+    // separate segments too.
+    void sendInput(uint32_t len) {
+        std::string payload(1, CMD_INPUT);
+        for (uint32_t i = 0; i < len; i++) {
+            payload += (char) ('a' + (inputBytes + i) % 26);
+        }
+        inputBytes += len;
+
+        size_t frames = std::min<size_t>(std::max<uint32_t>(opts.fragments, 1), payload.size());
+        size_t frameLen = (payload.size() + frames - 1) / frames;
+        for (size_t pos = 0; pos < payload.size(); pos += frameLen) {
+            size_t chunk = std::min(frameLen, payload.size() - pos);
+            queueFrame(pos == 0 ? WS_OP_BINARY : WS_OP_CONTINUATION, pos + chunk == payload.size(),
+                       payload.data() + pos, chunk);
+            flush();
+        }
+    }
+
+    void flush() {
+        while (!tx.empty()) {
+            ssize_t sent = send(fd, tx.data(), tx.size(), MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EINTR) {
+                    fail(strerror(errno));
+                }
+                return;
+            }
+            tx.erase(0, sent);
+        }
+    }
+
+    void parseFrames(uint64_t now) {
+        size_t pos = 0;
+        while (rx.size() - pos >= 2) {
+            auto b0 = (uint8_t) rx[pos];
+            auto b1 = (uint8_t) rx[pos + 1];
+            size_t header = 2 + ((b1 & 0x80) ? 4 : 0);
+            uint64_t len = b1 & 0x7f;
+            if (len == 126) {
+                header += 2;
+                if (rx.size() - pos < header) break;
+                len = ((uint8_t) rx[pos + 2] << 8) | (uint8_t) rx[pos + 3];
+            } else if (len == 127) {
+                header += 8;
+                if (rx.size() - pos < header) break;
+                len = 0;
+                for (int i = 0; i < 8; i++) {
+                    len = (len << 8) | (uint8_t) rx[pos + 2 + i];
+                }
+            }
+            if (rx.size() - pos < header + len) {
+                break;
+            }
+            onFrame(b0 & 0x0f, b0 & 0x80, rx.data() + pos + header, len, now);
+            pos += header + len;
+        }
+        rx.erase(0, pos);
+    }
+
+    void onFrame(uint8_t opcode, bool fin, const char *data, size_t len, uint64_t now) {
+        switch (opcode) {
+            case WS_OP_PING:
+                queueFrame(WS_OP_PONG, true, data, len);
+                return;
+            case WS_OP_CLOSE: {
+                uint16_t code = len >= 2 ? ((uint8_t) data[0] << 8) | (uint8_t) data[1] : 0;
+                fail("closed by the server with code " + std::to_string(code));
+                return;
+            }
+            case WS_OP_TEXT:
+            case WS_OP_BINARY:
+                message.assign(data, len);
+                inMessage = !fin;
+                break;
+            case WS_OP_CONTINUATION:
+                if (!inMessage) {
+                    return;
+                }
+                message.append(data, len);
+                inMessage = !fin;
+                break;
+            default:
+                return;
+        }
+        if (!inMessage) {
+            onMessage(now);
+        }
+    }
+
+    void onMessage(uint64_t now) {
+        messages++;
+        if (message.empty()) {
+            return;
+        }
+        switch (message[0]) {
+            case CMD_OUTPUT:
+                onOutput(message.data() + 1, message.size() - 1, now);
+                break;
+            case CMD_SERVER_PAUSE:
+                inputHeld = true;
+                break;
+            case CMD_SERVER_RESUME:
+                inputHeld = false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void onOutput(const char *data, size_t len, uint64_t now) {
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] != '\n') {
+                if (line.size() <= RECORD_MAX_SIZE) {
+                    line += data[i];
+                }
+                continue;
+            }
+            onLine(now);
+            line.clear();
+        }
+    }
+
+    void onLine(uint64_t now) {
+        char *end;
+        uint32_t seq = strtoul(line.c_str(), &end, 16);
+        if (line.size() != opts.recordSize - 1 || line.back() != '\r' || end != line.c_str() + RECORD_SEQ_DIGITS ||
+            seq >= source.getRecordCount()) {
+            // Part of the record was lost, or it's the loss marker
+            corrupt++;
+            return;
+        }
+        if (seq >= seen.size()) {
+            seen.resize(seq + 1024);
+        }
+        if (seen[seq]) {
+            duplicates++;
+            return;
+        }
+        seen[seq] = true;
+        records++;
+        recordBytes += opts.recordSize;
+        latencies.push_back((uint32_t) std::min<uint64_t>(now - source.sentAtMicros[seq], UINT32_MAX));
+    }
+};
+
+// ---- Server process
+
+struct Server {
+    pid_t pid = -1;
+    int stdinFd = -1;
+    int stdoutFd = -1;
+    std::string gpioFile;
+
+    bool start(const Options &opts) {
+        int in[2];
+        int out[2];
+        if (pipe2(in, O_CLOEXEC) < 0 || pipe2(out, O_CLOEXEC) < 0) {
+            perror("pipe");
+            return false;
+        }
+        // What's in the pipe is on its way to the UART but the source thinks it's already sent, keep it short
+        fcntl(in[1], F_SETPIPE_SZ, 4096);
+        gpioFile = "/tmp/wi-se_bench_gpio." + std::to_string(getpid());
+
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return false;
+        }
+        if (pid == 0) {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            int log = open(opts.serverLog, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            if (log >= 0) {
+                dup2(log, STDERR_FILENO);
+            }
+            setenv("FAKEESP_UART_WIRE", "1", 1);
+            setenv("FAKEESP_GPIO_FILE", gpioFile.c_str(), 1);
+            unsetenv("FAKEESP_UART0");
+            unsetenv("FAKEESP_VIRTUAL_TIME");
+            if (opts.heap > 0) {
+                setenv("FAKEESP_HEAP", std::to_string(opts.heap).c_str(), 1);
+            } else {
+                unsetenv("FAKEESP_HEAP");
+            }
+            if (opts.tcpWindow > 0) {
+                setenv("FAKEESP_TCP_WINDOW", std::to_string(opts.tcpWindow).c_str(), 1);
+            } else {
+                unsetenv("FAKEESP_TCP_WINDOW");
+            }
+            if (opts.net != nullptr) {
+                setenv("FAKEESP_NET", opts.net, 1);
+            } else {
+                unsetenv("FAKEESP_NET");
+            }
+            unsetenv("FAKEESP_NET_FILE");
+            execl(opts.server, opts.server, (char *) nullptr);
+            fprintf(stderr, "Unable to run %s: %s\n", opts.server, strerror(errno));
+            _exit(127);
+        }
+
+        close(in[0]);
+        close(out[1]);
+        stdinFd = in[1];
+        stdoutFd = out[0];
+        fcntl(stdinFd, F_SETFL, fcntl(stdinFd, F_GETFL) | O_NONBLOCK);
+        fcntl(stdoutFd, F_SETFL, fcntl(stdoutFd, F_GETFL) | O_NONBLOCK);
+
+        uint64_t deadline = nowMicros() + SERVER_START_MILLIS * 1000;
+        while (nowMicros() < deadline) {
+            int status;
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                pid = -1;
+                return false;
+            }
+            int fd = connectToServer(opts, 100);
+            if (fd >= 0) {
+                close(fd);
+                return true;
+            }
+            usleep(50000);
+        }
+        return false;
+    }
+
+    // User + system time in milliseconds, from /proc since the process is still running.
+    double getCpuMillis() const {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        FILE *file = fopen(path, "r");
+        if (file == nullptr) {
+            return 0;
+        }
+        char stat[1024];
+        size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+        fclose(file);
+        stat[len] = '\0';
+        // The command name may contain spaces, the fields after it don't
+        const char *fields = strrchr(stat, ')');
+        unsigned long utime = 0;
+        unsigned long stime = 0;
+        if (fields == nullptr ||
+            sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+            return 0;
+        }
+        return (double) (utime + stime) * 1000 / (double) sysconf(_SC_CLK_TCK);
+    }
+
+    void stop() {
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+            pid = -1;
+        }
+        if (stdinFd >= 0) close(stdinFd);
+        if (stdoutFd >= 0) close(stdoutFd);
+        stdinFd = stdoutFd = -1;
+        unlink(gpioFile.c_str());
+    }
+};
+
+// ---- Runs
+
+struct RunResult {
+    uint32_t baud = 0;
+    uint32_t clients = 0;
+    std::string error;
+
+    double durationMillis = 0;
+    uint64_t uartBytes = 0;
+    uint32_t uartRecords = 0;
+    double xoffMillis = 0;
+    uint32_t xoffCount = 0;
+    double overruns = -1;
+    double bufferFull = -1;
+
+    uint32_t clientsFailed = 0;
+    double aggregateBps = 0;
+    double perClientMeanBps = 0;
+    double perClientMinBps = 0;
+    uint64_t lostRecords = 0;
+    double lossMean = 0;
+    double lossWorst = 0;
+    uint32_t corrupt = 0;
+    uint32_t duplicates = 0;
+    uint32_t pauses = 0;
+
+    std::vector<uint32_t> latencies;
+
+    double cpuMillis = 0;
+
+    double heapFreeStart = -1;
+    double heapFreeMin = -1;
+    double heapUsedMean = -1;
+    double allocBytes = -1;
+    double allocs = -1;
+
+    uint64_t inputBytes = 0;
+    uint64_t inputAtUart = 0;
+};
+
+// Polls GET /heap from its own thread, a blocking request in the main loop would add to the latencies.
+class HeapSampler {
+private:
+    const Options &opts;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+public:
+    double freeStart = -1;
+    std::atomic<int64_t> freeMin{-1};
+    std::atomic<int64_t> freeSum{0};
+    std::atomic<uint32_t> samples{0};
+
+    explicit HeapSampler(const Options &opts) : opts(opts) {}
+
+    void start() {
+        freeStart = sample();
+        freeMin = (int64_t) freeStart;
+        running = true;
+        thread = std::thread([this]() {
+            while (running) {
+                double free = sample();
+                if (free >= 0) {
+                    freeMin = std::min(freeMin.load(), (int64_t) free);
+                    freeSum += (int64_t) free;
+                    samples++;
+                }
+                usleep(HEAP_SAMPLE_MICROS);
+            }
+        });
+    }
+
+    void stop() {
+        if (running) {
+            running = false;
+            thread.join();
+        }
+    }
+
+private:
+    double sample() {
+        std::string body;
+        return httpRequest(opts, "GET", "/heap", "", &body) == 200 ? strtod(body.c_str(), nullptr) : -1;
+    }
+};
+
+static std::string loadFiller(const Options &opts, bool *random) {
+    *random = strcmp(opts.content, "random") == 0;
+    if (*random || strcmp(opts.content, "text") == 0) {
+        return "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore. ";
+    }
+    FILE *file = fopen(opts.content, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Unable to open %s: %s\n", opts.content, strerror(errno));
+        exit(1);
+    }
+    std::string filler;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        // These would break the records or stop the flow
+        filler += (c == '\n' || c == '\r' || c == FLOW_CTL_XOFF || c == FLOW_CTL_XON) ? ' ' : (char) c;
+    }
+    fclose(file);
+    if (filler.empty()) {
+        fprintf(stderr, "%s is empty\n", opts.content);
+        exit(1);
+    }
+    return filler;
+}
+
+static void readServerStats(const Options &opts, RunResult &result, double *allocBytes, double *allocs) {
+    std::string body;
+    if (httpRequest(opts, "GET", "/stats", "", &body) == 200) {
+        jsonNumber(body, "overruns", 0, &result.overruns);
+        jsonNumber(body, "bufferFull", 0, &result.bufferFull);
+    }
+    // Only there if the firmware was built with the heap profiler
+    if (httpRequest(opts, "GET", "/heap/profile", "", &body) == 200) {
+        *allocBytes = jsonSum(body, "allocBytes");
+        *allocs = jsonSum(body, "allocs");
+    }
+}
+
+static void runOnce(const Options &opts, const std::string &filler, bool randomFiller, RunResult &result) {
+    Server server;
+    if (!server.start(opts)) {
+        result.error = std::string("the server didn't start, see ") + opts.serverLog;
+        server.stop();
+        return;
+    }
+
+    std::string body;
+    char stty[128];
+    snprintf(stty, sizeof(stty), R"({"baudrate":%u,"bits":8,"parity":null,"stop":1})", result.baud);
+    if (httpRequest(opts, "POST", "/stty", stty, nullptr) != 200) {
+        result.error = "POST /stty failed";
+        server.stop();
+        return;
+    }
+    int status = httpRequest(opts, "GET", "/token", "", &body);
+    if (status != 200) {
+        result.error = status == 401 ? "authentication failed, check --auth" : "GET /token failed";
+        server.stop();
+        return;
+    }
+    std::string token = jsonString(body, "token");
+
+    Source source(opts.recordSize, filler, randomFiller);
+    std::vector<Client *> clients;
+    for (uint32_t i = 0; i < result.clients; i++) {
+        clients.push_back(new Client(opts, source, i, result.clients));
+        clients.back()->connectAndAuthenticate(token);
+    }
+
+    std::vector<pollfd> fds;
+    auto pollOnce = [&](bool sourceRunning, int timeoutMillis) {
+        uint64_t now = nowMicros();
+        fds.clear();
+        bool writeSource = sourceRunning && source.hasDueBytes(now);
+        fds.push_back({server.stdinFd, (short) (writeSource ? POLLOUT : 0), 0});
+        fds.push_back({server.stdoutFd, POLLIN, 0});
+        for (Client *client: clients) {
+            fds.push_back({client->closed ? -1 : client->fd, client->pollEvents(), 0});
+        }
+        if (poll(fds.data(), fds.size(), timeoutMillis) < 0 && errno != EINTR) {
+            perror("poll");
+            exit(1);
+        }
+        now = nowMicros();
+
+        if (fds[1].revents & POLLIN) {
+            uint8_t buf[4096];
+            ssize_t len;
+            while ((len = read(server.stdoutFd, buf, sizeof(buf))) > 0) {
+                for (ssize_t i = 0; i < len; i++) {
+                    if (buf[i] == FLOW_CTL_XOFF || buf[i] == FLOW_CTL_XON) {
+                        source.onFlowControl(buf[i], now);
+                    } else {
+                        result.inputAtUart++;
+                    }
+                }
+            }
+        }
+        if (fds[0].revents & POLLOUT && !source.write(server.stdinFd, now)) {
+            result.error = "the server closed the UART";
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (fds[i + 2].revents) {
+                clients[i]->onEvents(fds[i + 2].revents, now);
+            }
+            clients[i]->tick(now, sourceRunning);
+        }
+    };
+
+    // Wait for the clients to be authenticated, the server greets them with their configuration
+    uint64_t deadline = nowMicros() + CLIENT_READY_MILLIS * 1000;
+    auto clientsReady = [&]() {
+        return std::all_of(clients.begin(), clients.end(), [](Client *c) { return c->closed || c->messages > 0; });
+    };
+    while (!clientsReady() && nowMicros() < deadline) {
+        pollOnce(false, 10);
+    }
+
+    double allocBytesStart = -1;
+    double allocsStart = -1;
+    RunResult ignored;
+    readServerStats(opts, ignored, &allocBytesStart, &allocsStart);
+    HeapSampler heap(opts);
+    heap.start();
+    double cpuStart = server.getCpuMillis();
+
+    uint64_t startedAt = nowMicros();
+    for (Client *client: clients) {
+        client->start(startedAt);
+    }
+    source.start(result.baud, startedAt);
+    uint64_t stopAt = startedAt + (uint64_t) opts.durationMillis * 1000;
+    while (nowMicros() < stopAt && result.error.empty()) {
+        pollOnce(true, 1);
+    }
+    uint64_t stoppedAt = nowMicros();
+    source.finish(stoppedAt);
+
+    // Let the last records through
+    uint64_t drainUntil = stoppedAt + (uint64_t) opts.drainMillis * 1000;
+    auto allDelivered = [&]() {
+        return std::all_of(clients.begin(), clients.end(), [&](Client *c) {
+            return c->closed || c->getUniqueRecords() >= source.getRecordCount();
+        });
+    };
+    while (nowMicros() < drainUntil && !allDelivered()) {
+        pollOnce(false, 10);
+    }
+
+    result.cpuMillis = server.getCpuMillis() - cpuStart;
+    heap.stop();
+    double allocBytesEnd = -1;
+    double allocsEnd = -1;
+    readServerStats(opts, result, &allocBytesEnd, &allocsEnd);
+    server.stop();
+
+    result.durationMillis = (double) (stoppedAt - startedAt) / 1000;
+    result.uartBytes = source.bytes;
+    result.uartRecords = source.getRecordCount();
+    result.xoffMillis = (double) source.xoffMicros / 1000;
+    result.xoffCount = source.xoffCount;
+    if (heap.freeStart >= 0) {
+        result.heapFreeStart = heap.freeStart;
+        result.heapFreeMin = (double) heap.freeMin;
+        if (heap.samples > 0) {
+            result.heapUsedMean = heap.freeStart - (double) heap.freeSum / heap.samples;
+        }
+    }
+    if (allocBytesStart >= 0 && allocBytesEnd >= 0) {
+        result.allocBytes = allocBytesEnd - allocBytesStart;
+        result.allocs = allocsEnd - allocsStart;
+    }
+
+    double seconds = result.durationMillis / 1000;
+    uint32_t working = 0;
+    result.perClientMinBps = INFINITY;
+    for (size_t i = 0; i < clients.size(); i++) {
+        Client *client = clients[i];
+        result.pauses += client->pauses;
+        result.inputBytes += client->inputBytes;
+        if (!client->error.empty()) {
+            result.clientsFailed++;
+            if (result.error.empty()) {
+                result.error = "client " + std::to_string(i) + ": " + client->error;
+            }
+            if (client->messages == 0) {
+                // Never got in, e.g. over WS_MAX_CLIENTS
+                continue;
+            }
+        }
+        working++;
+        double bps = (double) client->recordBytes / seconds;
+        result.aggregateBps += bps;
+        result.perClientMinBps = std::min(result.perClientMinBps, bps);
+        uint32_t lost = source.getRecordCount() - std::min(client->getUniqueRecords(), source.getRecordCount());
+        double loss = source.getRecordCount() > 0 ? (double) lost / source.getRecordCount() : 0;
+        result.lostRecords += lost;
+        result.lossMean += loss;
+        result.lossWorst = std::max(result.lossWorst, loss);
+        result.corrupt += client->corrupt;
+        result.duplicates += client->duplicates;
+        result.latencies.insert(result.latencies.end(), client->latencies.begin(), client->latencies.end());
+    }
+    for (Client *client: clients) {
+        delete client;
+    }
+    if (working > 0) {
+        result.perClientMeanBps = result.aggregateBps / working;
+        result.lossMean /= working;
+    } else {
+        result.perClientMinBps = 0;
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+}
+
+// ---- Output
+
+static double percentile(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t) std::ceil(p / 100 * (double) sorted.size());
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+static void printNumber(FILE *out, const char *key, double value, bool last = false) {
+    if (value < 0 || std::isnan(value) || std::isinf(value)) {
+        fprintf(out, "\"%s\": null%s", key, last ? "" : ", ");
+    } else if (value == std::floor(value) && value < 1e15) {
+        fprintf(out, "\"%s\": %.0f%s", key, value, last ? "" : ", ");
+    } else {
+        fprintf(out, "\"%s\": %.6g%s", key, value, last ? "" : ", ");
+    }
+}
+
+static void printJsonString(FILE *out, const std::string &value) {
+    fputc('"', out);
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if ((uint8_t) c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void printResult(FILE *out, const RunResult &r, bool last) {
+    double mb = (double) r.uartBytes / 1000000;
+    fprintf(out, "    {");
+    printNumber(out, "baud", r.baud);
+    printNumber(out, "clients", r.clients);
+    fprintf(out, "\"error\": ");
+    if (r.error.empty()) {
+        fprintf(out, "null");
+    } else {
+        printJsonString(out, r.error);
+    }
+    fprintf(out, ",\n     ");
+    printNumber(out, "durationMs", r.durationMillis, true);
+
+    fprintf(out, ",\n     \"uart\": {");
+    printNumber(out, "bytes", (double) r.uartBytes);
+    printNumber(out, "records", r.uartRecords);
+    printNumber(out, "bps", r.durationMillis > 0 ? (double) r.uartBytes * 1000 / r.durationMillis : 0);
+    printNumber(out, "lineUtilization", r.durationMillis > 0 ?
+                                        (double) r.uartBytes * 1000 / r.durationMillis / (r.baud / BITS_PER_FRAME) : 0);
+    printNumber(out, "xoffMs", r.xoffMillis);
+    printNumber(out, "xoffCount", r.xoffCount);
+    printNumber(out, "overruns", r.overruns);
+    printNumber(out, "bufferFull", r.bufferFull, true);
+
+    fprintf(out, "},\n     \"throughput\": {");
+    printNumber(out, "aggregateBps", r.aggregateBps);
+    printNumber(out, "perClientMeanBps", r.perClientMeanBps);
+    printNumber(out, "perClientMinBps", r.perClientMinBps, true);
+
+    fprintf(out, "},\n     \"loss\": {");
+    printNumber(out, "records", (double) r.lostRecords);
+    printNumber(out, "meanRatio", r.lossMean);
+    printNumber(out, "worstRatio", r.lossWorst);
+    printNumber(out, "corrupt", r.corrupt);
+    printNumber(out, "duplicates", r.duplicates, true);
+
+    fprintf(out, "},\n     \"latencyUs\": {");
+    printNumber(out, "count", (double) r.latencies.size());
+    printNumber(out, "p50", percentile(r.latencies, 50));
+    printNumber(out, "p90", percentile(r.latencies, 90));
+    printNumber(out, "p99", percentile(r.latencies, 99));
+    printNumber(out, "p999", percentile(r.latencies, 99.9));
+    printNumber(out, "max", r.latencies.empty() ? 0 : r.latencies.back(), true);
+
+    fprintf(out, "},\n     \"cpu\": {");
+    printNumber(out, "ms", r.cpuMillis);
+    printNumber(out, "msPerMB", mb > 0 ? r.cpuMillis / mb : -1, true);
+
+    fprintf(out, "},\n     \"heap\": {");
+    printNumber(out, "freeStart", r.heapFreeStart);
+    printNumber(out, "freeMin", r.heapFreeMin);
+    printNumber(out, "usedPeak", r.heapFreeMin >= 0 ? r.heapFreeStart - r.heapFreeMin : -1);
+    printNumber(out, "usedMean", r.heapUsedMean);
+    printNumber(out, "allocBytesPerMB", r.allocBytes >= 0 && mb > 0 ? r.allocBytes / mb : -1);
+    printNumber(out, "allocsPerMB", r.allocs >= 0 && mb > 0 ? r.allocs / mb : -1, true);
+
+    fprintf(out, "},\n     \"clientsFailed\": %u, \"pauses\": %u, ", r.clientsFailed, r.pauses);
+    fprintf(out, "\"input\": {");
+    printNumber(out, "sent", (double) r.inputBytes);
+    printNumber(out, "atUart", (double) r.inputAtUart, true);
+    fprintf(out, "}}%s\n", last ? "" : ",");
+}
+
+// ---- Command line
+
+static bool parseList(const char *arg, std::vector<uint32_t> *list) {
+    list->clear();
+    const char *pos = arg;
+    while (*pos != '\0') {
+        char *end;
+        unsigned long value = strtoul(pos, &end, 10);
+        if (end == pos || value == 0 || value > UINT32_MAX || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        list->push_back((uint32_t) value);
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return !list->empty();
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --server PATH        wi-se_fakeesp executable (%s)\n"
+            "  --host HOST          Address it listens on (127.0.0.1)\n"
+            "  --port PORT          HTTP port set in config.h (8080)\n"
+            "  --auth USER:PASS     HTTP credentials, if authentication is enabled in config.h\n"
+            "  --baud LIST          Baud rates, comma separated (115200,460800,921600)\n"
+            "  --clients LIST       Client counts, comma separated (1,2,3)\n"
+            "  --duration SECONDS   How long the UART sends data in each run (10)\n"
+            "  --drain MS           How long to wait for the data still on its way after that (2000)\n"
+            "  --content KIND       text, random or a file the records are filled with (text)\n"
+            "  --record-size BYTES  Size of each record, CRLF included (64)\n"
+            "  --heap BYTES         Emulated heap size, 0 for the system allocator (50000)\n"
+            "  --tcp-window BYTES   TCP send window of each client, 0 for the server default (5840, the ESP8266 one)\n"
+            "  --net SPEC           Wi-Fi link to emulate, a FAKEESP_NET profile such as wifi-bad (none)\n"
+            "  --pause-every MS     Have each client pause the output this often (never)\n"
+            "  --pause-for MS       For this long, not reading from the socket meanwhile (0)\n"
+            "  --input-rate BPS     Keystrokes each client sends, in bytes per second (0)\n"
+            "  --fragments N        WebSocket frames each input message is split into (1)\n"
+            "  --output FILE        Where the JSON results go (stdout)\n"
+            "  --server-log FILE    Where the server's stderr goes (/dev/null)\n",
+            name, WISE_BENCH_SERVER);
+}
+
+static bool parseOptions(int argc, char **argv, Options &opts) {
+    static const option longOptions[] = {
+            {"server",      required_argument, nullptr, 's'},
+            {"host",        required_argument, nullptr, 'H'},
+            {"port",        required_argument, nullptr, 'p'},
+            {"auth",        required_argument, nullptr, 'a'},
+            {"baud",        required_argument, nullptr, 'b'},
+            {"clients",     required_argument, nullptr, 'c'},
+            {"duration",    required_argument, nullptr, 'd'},
+            {"drain",       required_argument, nullptr, 'D'},
+            {"content",     required_argument, nullptr, 'C'},
+            {"record-size", required_argument, nullptr, 'r'},
+            {"heap",        required_argument, nullptr, 'm'},
+            {"tcp-window",  required_argument, nullptr, 'w'},
+            {"net",         required_argument, nullptr, 'n'},
+            {"pause-every", required_argument, nullptr, 'P'},
+            {"pause-for",   required_argument, nullptr, 'F'},
+            {"input-rate",  required_argument, nullptr, 'i'},
+            {"fragments",   required_argument, nullptr, 'f'},
+            {"output",      required_argument, nullptr, 'o'},
+            {"server-log",  required_argument, nullptr, 'l'},
+            {"help",        no_argument,       nullptr, 'h'},
+            {nullptr, 0,                       nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 's':
+                opts.server = optarg;
+                break;
+            case 'H':
+                opts.host = optarg;
+                break;
+            case 'p':
+                opts.port = (uint16_t) strtoul(optarg, nullptr, 10);
+                break;
+            case 'a':
+                opts.auth = optarg;
+                break;
+            case 'b':
+                if (!parseList(optarg, &opts.bauds)) return false;
+                break;
+            case 'c':
+                if (!parseList(optarg, &opts.clientCounts)) return false;
+                break;
+            case 'd':
+                opts.durationMillis = (uint32_t) (strtod(optarg, nullptr) * 1000);
+                break;
+            case 'D':
+                opts.drainMillis = strtoul(optarg, nullptr, 10);
+                break;
+            case 'C':
+                opts.content = optarg;
+                break;
+            case 'r':
+                opts.recordSize = strtoul(optarg, nullptr, 10);
+                break;
+            case 'm':
+                opts.heap = strtoul(optarg, nullptr, 10);
+                break;
+            case 'w':
+                opts.tcpWindow = strtoul(optarg, nullptr, 10);
+                break;
+            case 'n':
+                opts.net = optarg;
+                break;
+            case 'P':
+                opts.pauseEveryMillis = strtoul(optarg, nullptr, 10);
+                break;
+            case 'F':
+                opts.pauseForMillis = strtoul(optarg, nullptr, 10);
+                break;
+            case 'i':
+                opts.inputRate = strtoul(optarg, nullptr, 10);
+                break;
+            case 'f':
+                opts.fragments = strtoul(optarg, nullptr, 10);
+                break;
+            case 'o':
+                opts.output = optarg;
+                break;
+            case 'l':
+                opts.serverLog = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+    if (optind != argc || opts.port == 0 || opts.durationMillis == 0 || opts.recordSize < RECORD_MIN_SIZE ||
+        opts.recordSize > RECORD_MAX_SIZE || (opts.pauseEveryMillis > 0 && opts.pauseForMillis >= opts.pauseEveryMillis)) {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    srand(1);
+
+    bool randomFiller;
+    std::string filler = loadFiller(opts, &randomFiller);
+
+    FILE *out = stdout;
+    if (opts.output != nullptr && (out = fopen(opts.output, "w")) == nullptr) {
+        fprintf(stderr, "Unable to open %s: %s\n", opts.output, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"wi-se\", \"version\": 1, \"timestamp\": %ld,\n  \"settings\": {",
+            (long) time(nullptr));
+    fprintf(out, "\"content\": ");
+    printJsonString(out, opts.content);
+    fprintf(out, ", ");
+    printNumber(out, "durationMs", opts.durationMillis);
+    printNumber(out, "recordSize", opts.recordSize);
+    printNumber(out, "heap", opts.heap > 0 ? opts.heap : -1);
+    printNumber(out, "tcpWindow", opts.tcpWindow > 0 ? opts.tcpWindow : -1);
+    fprintf(out, "\"net\": ");
+    printJsonString(out, opts.net != nullptr ? opts.net : "none");
+    fprintf(out, ", ");
+    printNumber(out, "pauseEveryMs", opts.pauseEveryMillis);
+    printNumber(out, "pauseForMs", opts.pauseForMillis);
+    printNumber(out, "inputRate", opts.inputRate);
+    printNumber(out, "fragments", opts.fragments, true);
+    fprintf(out, "},\n  \"runs\": [\n");
+
+    size_t runs = opts.bauds.size() * opts.clientCounts.size();
+    size_t run = 0;
+    for (uint32_t baud: opts.bauds) {
+        for (uint32_t clientCount: opts.clientCounts) {
+            RunResult result;
+            result.baud = baud;
+            result.clients = clientCount;
+            fprintf(stderr, "[%zu/%zu] %u baud, %u clients: ", run + 1, runs, baud, clientCount);
+            runOnce(opts, filler, randomFiller, result);
+            fprintf(stderr, "%.0f B/s per client, %.3f%% lost, p99 %.1f ms, %.0f ms CPU/MB%s%s\n",
+                    result.perClientMeanBps, result.lossMean * 100, percentile(result.latencies, 99) / 1000,
+                    result.uartBytes > 0 ? result.cpuMillis * 1000000 / (double) result.uartBytes : 0,
+                    result.error.empty() ? "" : ", ", result.error.c_str());
+            printResult(out, result, ++run == runs);
+            fflush(out);
+        }
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_AUTORESPONDER_H
+#define WI_SE_SW_AUTORESPONDER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PatternMatcher.h"
+
+#if AUTORESPONDER_MAX_RULES > PATTERN_MATCHER_MAX_PATTERNS
+#error "AUTORESPONDER_MAX_RULES can't be larger than PATTERN_MATCHER_MAX_PATTERNS"
+#endif
+
+#define AUTORESPONDER_NO_GPIO (-1)
+
+struct AutoResponderRule {
+    bool inUse;
+    char pattern[PATTERN_MATCHER_MAX_TOTAL_LEN + 1];
+    char response[AUTORESPONDER_RESPONSE_MAX_LEN + 1];
+    uint8_t patternLen;
+    uint8_t responseLen;
+
+    // Index into the target GPIOs configuration and state to set (same semantics as POST /gpio).
+    int8_t gpioIndex;
+    uint64_t gpioState;
+
+    // The rule is disarmed after this many hits, 0 means never.
+    uint32_t maxHits;
+    uint32_t hits;
+    uint64_t lastHitMillis;
+};
+
+// Answers prompts coming from the UART (such as "Hit any key to stop autoboot") right from the dispatch path, without
+// waiting for a round trip through the network.
+class AutoResponder {
+private:
+    AutoResponderRule rules[AUTORESPONDER_MAX_RULES] = {};
+    PatternMatcher matcher;
+    int8_t ruleForPattern[PATTERN_MATCHER_MAX_PATTERNS] = {0};
+    // Where the responses go, the UART of the TTY owning it
+    Print *uart = nullptr;
+
+public:
+    void setUart(Print *uart) {
+        this->uart = uart;
+    }
+
+    // Returns the rule ID, or -1 if there's no room for it.
+    int addRule(const char *pattern, const char *response, int8_t gpioIndex, uint64_t gpioState, uint32_t maxHits);
+
+    bool removeRule(int id);
+
+    void clearRules();
+
+    const AutoResponderRule *getRule(int id) const {
+        if (id < 0 || id >= AUTORESPONDER_MAX_RULES || !rules[id].inUse) {
+            return nullptr;
+        }
+        return &rules[id];
+    }
+
+    bool active() const {
+        return matcher.count() > 0;
+    }
+
+    uint8_t patternBytesLeft() const {
+        return matcher.bitsLeft();
+    }
+
+    // Scans UART output and writes the responses of matching rules to the UART straight away.
+    // Returns a bitmask of the rules that fired, and the amount of bytes written in txBytes.
+    uint32_t feed(const uint8_t *data, size_t len, size_t &txBytes);
+
+private:
+    void compile();
+
+    void fire(AutoResponderRule &rule, size_t &txBytes);
+};
+
+#endif // WI_SE_SW_AUTORESPONDER_H
@@ -0,0 +1,150 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_DLOG_H
+#define WI_SE_SW_DLOG_H
+
+#include <Arduino.h>
+#include <cstring>
+#include <type_traits>
+#include "config.h"
+#include "RingDump.h"
+
+// Deferred logging: instead of formatting the message, debugf stores a hash of the format string and the raw arguments
+// in a RAM ring. The ring is downloaded from GET /dlog and formatted on a computer by tools/dlog.py, using the table of
+// format strings generated by builder.py.
+
+#define DLOG_PAYLOAD_SIZE 24
+
+// Argument tags, part of the dump format (keep tools/dlog.py in sync).
+#define DLOG_ARG_END       0
+#define DLOG_ARG_U32       1
+#define DLOG_ARG_U64       2
+#define DLOG_ARG_DOUBLE    3
+#define DLOG_ARG_STR       4 // Followed by a length byte
+#define DLOG_ARG_TRUNCATED 5 // The remaining arguments didn't fit
+
+// Only in dumps: the record was overwritten while it was being downloaded.
+#define DLOG_ID_OVERWRITTEN 0
+
+#define DLOG_DUMP_MAGIC   0x4C445357 // "WSDL"
+#define DLOG_DUMP_VERSION 1
+
+struct DlogRecord {
+    // FNV-1a of the format string.
+    uint32_t id;
+    uint32_t micros;
+    uint8_t payload[DLOG_PAYLOAD_SIZE];
+};
+
+struct DlogDumpHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t recordSize;
+    uint16_t recordCount;
+    // Sequence number of the first record in the dump, pass the one after the last as ?since= to only get new ones.
+    uint32_t firstSeq;
+    uint32_t reserved;
+    uint64_t nowMicros;
+};
+
+#if DLOG_RECORDS > 0
+static_assert((DLOG_RECORDS & (DLOG_RECORDS - 1)) == 0, "DLOG_RECORDS must be a power of 2");
+#endif
+
+struct DlogRing {
+#if DLOG_RECORDS > 0
+    DlogRecord records[DLOG_RECORDS];
+#endif
+    uint32_t head;
+};
+
+extern DlogRing dlogRing;
+
+constexpr uint32_t dlogHash(const char *s, uint32_t hash = 2166136261UL) {
+    return *s ? dlogHash(s + 1, (hash ^ (uint8_t) *s) * 16777619UL) : hash;
+}
+
+// Forces the hash to be computed at compile time, only the number ends up in the firmware.
+#define DLOG_ID(fmt) (std::integral_constant<uint32_t, dlogHash(fmt)>::value)
+
+class DlogWriter {
+private:
+    uint8_t *pos;
+    uint8_t *const end;
+    bool truncated = false;
+
+public:
+    explicit DlogWriter(uint8_t *payload) : pos{payload}, end{payload + DLOG_PAYLOAD_SIZE} {}
+
+    void put(uint8_t tag, const void *data, size_t len) {
+        // Keep one byte for the end or truncation tag.
+        if (truncated || pos + 1 + len >= end) {
+            truncated = true;
+            return;
+        }
+        *pos++ = tag;
+        memcpy(pos, data, len);
+        pos += len;
+    }
+
+    void putString(const char *s) {
+        if (truncated || pos + 3 >= end) {
+            truncated = true;
+            return;
+        }
+        size_t len = s ? strnlen(s, end - pos - 3) : 0;
+        *pos++ = DLOG_ARG_STR;
+        *pos++ = len;
+        memcpy(pos, s, len);
+        pos += len;
+    }
+
+    void finish() {
+        if (pos < end) {
+            *pos = truncated ? DLOG_ARG_TRUNCATED : DLOG_ARG_END;
+        }
+    }
+};
+
+template<typename T>
+static inline void dlogArg(DlogWriter &writer, T arg) {
+    if constexpr (std::is_same<T, const char *>::value || std::is_same<T, char *>::value) {
+        writer.putString(arg);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        double value = arg;
+        writer.put(DLOG_ARG_DOUBLE, &value, sizeof(value));
+    } else if constexpr (std::is_pointer<T>::value) {
+        uint32_t value = (uintptr_t) arg;
+        writer.put(DLOG_ARG_U32, &value, sizeof(value));
+    } else if constexpr (sizeof(T) > 4) {
+        uint64_t value = arg;
+        writer.put(DLOG_ARG_U64, &value, sizeof(value));
+    } else {
+        // Sign-extended, the format string tells how to print it.
+        uint32_t value = (typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type) arg;
+        writer.put(DLOG_ARG_U32, &value, sizeof(value));
+    }
+}
+
+template<typename... Args>
+static inline void dlog(uint32_t id, Args... args) {
+#if DLOG_RECORDS > 0
+    DlogRecord &record = dlogRing.records[dlogRing.head++ & (DLOG_RECORDS - 1)];
+    record.id = id;
+    record.micros = micros();
+    DlogWriter writer(record.payload);
+    (dlogArg(writer, args), ...);
+    writer.finish();
+#endif
+}
+
+// Serializes the records from a given sequence number on for GET /dlog, the overwritten ones become
+// DLOG_ID_OVERWRITTEN.
+class DlogDumper : public RingDumper<DlogDumpHeader, DlogRecord> {
+public:
+    explicit DlogDumper(uint32_t since);
+};
+
+#endif // WI_SE_SW_DLOG_H
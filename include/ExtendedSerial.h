@@ -7,7 +7,25 @@
 
 #include <HardwareSerial.h>
 
+// What the UART driver reports about bytes it couldn't deliver. Counters are cumulative since the last reset.
+struct UartErrorCounters {
+    // Hardware FIFO overflows. On ESP8266, also overflows of the UART_RX_BUF_SIZE buffer.
+    uint32_t overruns;
+    // Overflows of the UART_RX_BUF_SIZE buffer (ESP32 only).
+    uint32_t bufferFull;
+    // On ESP8266 the core doesn't tell framing and parity errors apart, both are counted here.
+    uint32_t framingErrors;
+    // ESP32 only.
+    uint32_t parityErrors;
+    // Breaks detected on RX (ESP32 only).
+    uint32_t breaks;
+};
+
 class ExtendedSerial : public HardwareSerial {
+private:
+    volatile UartErrorCounters errors = {};
+    uint32_t lostAtLastPoll = 0;
+    size_t rxHighWatermark = 0;
 
 public:
     ExtendedSerial(int uart_nr) : HardwareSerial(uart_nr) {};
@@ -19,6 +37,35 @@ public:
     static int autobaudGetClosestStdRate(int32_t rawBaud);
 
     void sendBreak();
+
+    // Call after begin(). On ESP32 the driver reports errors through a callback, on ESP8266 they're polled.
+    void beginErrorTracking();
+
+    // Picks up the errors flagged by the driver since the last call. Returns true if bytes were lost.
+    bool pollErrors();
+
+    UartErrorCounters getErrorCounters() const {
+        UartErrorCounters copy;
+        copy.overruns = errors.overruns;
+        copy.bufferFull = errors.bufferFull;
+        copy.framingErrors = errors.framingErrors;
+        copy.parityErrors = errors.parityErrors;
+        copy.breaks = errors.breaks;
+        return copy;
+    }
+
+    // Peak fill level of the RX buffer, as seen by whoever calls noteRxLevel.
+    void noteRxLevel(size_t available) {
+        if (available > rxHighWatermark) {
+            rxHighWatermark = available;
+        }
+    }
+
+    size_t getRxHighWatermark() const {
+        return rxHighWatermark;
+    }
+
+    void resetErrorCounters();
 };
 
 extern ExtendedSerial ExtSerial0;
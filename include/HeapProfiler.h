@@ -0,0 +1,173 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_HEAPPROFILER_H
+#define WI_SE_SW_HEAPPROFILER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// Allocation categories. Explicit HeapTag scopes win, then realloc() is assumed to be String (it's the only heavy user
+// of it), then allocations made by the network stack are AsyncTCP.
+#define HEAP_CAT_OTHER     0
+#define HEAP_CAT_WS_BUFFER 1
+#define HEAP_CAT_JSON      2
+#define HEAP_CAT_ASYNC_TCP 3 // AsyncTCP, the web server and the rest of the network stack
+#define HEAP_CAT_STRING    4
+#define HEAP_CAT_COUNT     5
+#define HEAP_CAT_NONE      HEAP_CAT_COUNT
+
+// Seconds of free heap and largest free block history.
+#define HEAP_PROFILER_HISTORY 60
+
+#if HEAP_PROFILER_SLOTS > 0
+static_assert((HEAP_PROFILER_SLOTS & (HEAP_PROFILER_SLOTS - 1)) == 0, "HEAP_PROFILER_SLOTS must be a power of 2");
+#endif
+
+struct HeapCategoryStats {
+    uint32_t liveBytes;
+    uint32_t liveCount;
+    uint32_t peakBytes;
+    uint32_t allocs;
+    uint64_t allocBytes;
+    // Over the last second, updated by HeapProfiler::sample()
+    uint32_t allocsPerSec;
+    uint32_t bytesPerSec;
+    uint32_t prevAllocs;
+    uint64_t prevAllocBytes;
+};
+
+struct HeapSample {
+    uint32_t freeHeap;
+    uint32_t maxFreeBlock;
+};
+
+struct HeapSlot {
+    void *ptr;
+    uint32_t size;
+    uint8_t category;
+};
+
+// Attributes heap allocations to categories. When HEAP_PROFILER_SLOTS is not 0, malloc(), free(), realloc() and calloc()
+// are wrapped at link time (-Wl,--wrap) and every live allocation is remembered in a fixed hash table, so that frees
+// can be accounted to the category of the allocation. Allocations that don't fit in the table are only counted.
+class HeapProfiler {
+private:
+#if HEAP_PROFILER_SLOTS > 0
+    HeapSlot slots[HEAP_PROFILER_SLOTS] = {};
+#endif
+    uint32_t tracked = 0;
+    HeapCategoryStats categories[HEAP_CAT_COUNT] = {};
+    // One for the main loop and one for the network stack, which on ESP32 runs in its own task.
+    uint8_t tags[2] = {HEAP_CAT_NONE, HEAP_CAT_NONE};
+
+    HeapSample history[HEAP_PROFILER_HISTORY] = {};
+    uint8_t historyHead = 0;
+    uint8_t historyLen = 0;
+    uint32_t minMaxFreeBlock = UINT32_MAX;
+
+public:
+    uint32_t untracked = 0;
+
+    // Call from setup().
+    void begin();
+
+    static uint8_t getContext();
+
+    uint8_t getTag(uint8_t context) const {
+        return tags[context];
+    }
+
+    void setTag(uint8_t context, uint8_t category) {
+        tags[context] = category;
+    }
+
+    uint8_t categorize(bool isRealloc) const;
+
+    void onAlloc(void *ptr, size_t size, uint8_t category);
+
+    // Returns the category of the allocation, HEAP_CAT_NONE if it wasn't tracked.
+    uint8_t onFree(void *ptr);
+
+    // Call once per second.
+    void sample();
+
+    // Resets the counters and the peaks, live allocations stay tracked.
+    void reset();
+
+    const HeapCategoryStats &getCategory(uint8_t category) const {
+        return categories[category];
+    }
+
+    uint32_t getTracked() const {
+        return tracked;
+    }
+
+    uint32_t getMinMaxFreeBlock() const {
+        return minMaxFreeBlock;
+    }
+
+    // 0 is the oldest one.
+    uint8_t getHistoryLen() const {
+        return historyLen;
+    }
+
+    const HeapSample &getHistory(uint8_t i) const;
+
+    static const char *getCategoryName(uint8_t category);
+
+private:
+#if HEAP_PROFILER_SLOTS > 0
+    static uint32_t slotFor(const void *ptr);
+#endif
+};
+
+extern HeapProfiler heapProfiler;
+
+// Attributes the allocations made while it's in scope to a category.
+class HeapTag {
+#if HEAP_PROFILER_SLOTS > 0
+private:
+    uint8_t context;
+    uint8_t previous;
+
+public:
+    explicit HeapTag(uint8_t category) : context{HeapProfiler::getContext()}, previous{heapProfiler.getTag(context)} {
+        heapProfiler.setTag(context, category);
+    }
+
+    ~HeapTag() {
+        heapProfiler.setTag(context, previous);
+    }
+#else
+public:
+    explicit HeapTag(uint8_t) {}
+#endif
+};
+
+#if HEAP_PROFILER_SLOTS > 0
+struct HeapTaggedJsonAllocator {
+    void *allocate(size_t size) {
+        HeapTag tag(HEAP_CAT_JSON);
+        return malloc(size);
+    }
+
+    void deallocate(void *ptr) {
+        free(ptr);
+    }
+
+    void *reallocate(void *ptr, size_t size) {
+        HeapTag tag(HEAP_CAT_JSON);
+        return realloc(ptr, size);
+    }
+};
+
+// Use instead of DynamicJsonDocument, so that documents are accounted as JSON.
+typedef BasicJsonDocument<HeapTaggedJsonAllocator> TaggedJsonDocument;
+#else
+typedef DynamicJsonDocument TaggedJsonDocument;
+#endif
+
+#endif // WI_SE_SW_HEAPPROFILER_H
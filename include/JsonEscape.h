@@ -0,0 +1,102 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_JSONESCAPE_H
+#define WI_SE_SW_JSONESCAPE_H
+
+#include <Arduino.h>
+
+// Longest representation of a single character: \u00XX or \ufffd
+#define JSON_ESCAPED_CHAR_MAX 6
+
+// Writes the JSON string representation of c into dest (at least JSON_ESCAPED_CHAR_MAX bytes), returns its length.
+// Used by the endpoints that stream raw UART data as JSON strings, since ArduinoJson would need it all in RAM.
+inline size_t jsonEscapeChar(uint8_t c, char *dest) {
+    static const char hex[] = "0123456789abcdef";
+    switch (c) {
+        case '"':
+        case '\\':
+            dest[0] = '\\';
+            dest[1] = (char) c;
+            return 2;
+        case '\n':
+            dest[0] = '\\';
+            dest[1] = 'n';
+            return 2;
+        case '\r':
+            dest[0] = '\\';
+            dest[1] = 'r';
+            return 2;
+        case '\t':
+            dest[0] = '\\';
+            dest[1] = 't';
+            return 2;
+        default:
+            if (c < 0x20 || c == 0x7F) {
+                memcpy(dest, "\\u00", 4);
+                dest[4] = hex[c >> 4];
+                dest[5] = hex[c & 0xF];
+                return 6;
+            }
+            dest[0] = (char) c;
+            return 1;
+    }
+}
+
+// Length of the valid UTF-8 sequence at the start of src, 0 if it's not one (overlong forms, surrogates, stray
+// continuation bytes and sequences cut short by the end of src included).
+inline size_t jsonUtf8SequenceLength(const uint8_t *src, size_t srcLen) {
+    uint8_t c = src[0];
+    size_t len;
+    uint8_t secondMin = 0x80, secondMax = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        if (c == 0xE0) {
+            secondMin = 0xA0;
+        } else if (c == 0xED) {
+            secondMax = 0x9F;
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        if (c == 0xF0) {
+            secondMin = 0x90;
+        } else if (c == 0xF4) {
+            secondMax = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+    if (srcLen < len || src[1] < secondMin || src[1] > secondMax) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if ((src[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+// Like jsonEscapeChar(), but for the first character of src, which may take more than one byte. Valid UTF-8 goes
+// through as is, any other byte above 0x7F becomes U+FFFD, so that garbage received at the wrong baud rate still
+// makes valid JSON. *consumed is set to the number of bytes of src it took.
+inline size_t jsonEscapeNext(const uint8_t *src, size_t srcLen, size_t *consumed, char *dest) {
+    if (src[0] < 0x80) {
+        *consumed = 1;
+        return jsonEscapeChar(src[0], dest);
+    }
+    size_t len = jsonUtf8SequenceLength(src, srcLen);
+    if (len == 0) {
+        *consumed = 1;
+        memcpy(dest, "\\ufffd", 6);
+        return 6;
+    }
+    *consumed = len;
+    memcpy(dest, src, len);
+    return len;
+}
+
+#endif // WI_SE_SW_JSONESCAPE_H
@@ -0,0 +1,52 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_LATENCYHISTOGRAM_H
+#define WI_SE_SW_LATENCYHISTOGRAM_H
+
+#include <Arduino.h>
+
+// Bucket i holds values in [2^i, 2^(i+1)) microseconds, the last one everything above ~8 s.
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+// Fixed-size log-scale histogram of latencies in microseconds. Recording is O(1) and it never allocates, percentiles
+// are only accurate to a factor of 2, which is plenty to set SLOs and spot regressions.
+class LatencyHistogram {
+private:
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS] = {0};
+    uint32_t count = 0;
+    uint32_t maxMicros = 0;
+
+public:
+    void record(uint32_t micros) {
+        uint8_t bucket = micros == 0 ? 0 : 31 - __builtin_clz(micros);
+        if (bucket >= LATENCY_HISTOGRAM_BUCKETS) {
+            bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+        }
+        buckets[bucket]++;
+        count++;
+        if (micros > maxMicros) {
+            maxMicros = micros;
+        }
+    }
+
+    void reset() {
+        memset(buckets, 0, sizeof(buckets));
+        count = 0;
+        maxMicros = 0;
+    }
+
+    uint32_t getCount() const {
+        return count;
+    }
+
+    uint32_t getMax() const {
+        return maxMicros;
+    }
+
+    // Upper bound of the bucket containing the given percentile (0-100), never above the max.
+    uint32_t percentile(uint8_t p) const;
+};
+
+#endif // WI_SE_SW_LATENCYHISTOGRAM_H
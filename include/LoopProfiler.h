@@ -0,0 +1,111 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_LOOPPROFILER_H
+#define WI_SE_SW_LOOPPROFILER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "LatencyHistogram.h"
+
+// Phases of loop(), in the order they run.
+#define LOOP_PHASE_OUTSIDE_LOOP  0 // Between two loop() runs, the SDK runs Wi-Fi, TCP and web server callbacks here
+#define LOOP_PHASE_OTA           1
+#define LOOP_PHASE_DISPATCH_UART 2
+#define LOOP_PHASE_YIELD_1       3
+#define LOOP_PHASE_HOUSEKEEPING  4
+#define LOOP_PHASE_YIELD_2       5
+// Known blocking calls. They are measured inside the phase they happen in and subtracted from it.
+#define LOOP_PHASE_SOFT_MIN_DELAY 6 // delay() in dispatchUart waiting for more UART data
+#define LOOP_PHASE_SEND_BREAK     7
+#define LOOP_PHASE_COUNT          8
+
+#define LOOP_PROFILER_RECENT_STALLS 8
+
+struct LoopPhaseStats {
+    uint32_t count;
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint64_t totalMicros;
+    // Iterations that went over the stall threshold mostly because of this phase.
+    uint32_t stalls;
+    LatencyHistogram histogram;
+};
+
+struct LoopStall {
+    uint64_t atMillis;
+    uint32_t iterationMicros;
+    uint8_t phase;
+    uint32_t phaseMicros;
+};
+
+// Measures how long each phase of loop() takes, with micros() resolution. An iteration is the time from one loop() run
+// to the next, so that time spent by the SDK in between is accounted for too. Iterations longer than
+// LOOP_STALL_THRESHOLD_MICROS are stalls and get attributed to the phase that took the longest in them.
+class LoopProfiler {
+private:
+    LoopPhaseStats phases[LOOP_PHASE_COUNT] = {};
+    uint32_t iterationPhaseMicros[LOOP_PHASE_COUNT] = {0};
+    uint32_t iterations = 0;
+    uint32_t stalls = 0;
+    LoopStall recentStalls[LOOP_PROFILER_RECENT_STALLS] = {};
+    uint8_t recentStallsHead = 0;
+
+    bool started = false;
+    uint32_t iterationStartedAtMicros = 0;
+    uint8_t currentPhase = LOOP_PHASE_COUNT;
+    uint32_t phaseStartedAtMicros = 0;
+    // Time spent in blocking calls during the current phase.
+    uint32_t phaseBlockingMicros = 0;
+
+public:
+    // Call at the top of loop(). Closes the previous iteration.
+    void startIteration();
+
+    // Ends the current phase and starts the given one.
+    void enterPhase(uint8_t phase);
+
+    // Call when loop() returns.
+    void endLoop();
+
+    // Measure a blocking call: pass the value returned by startBlocking() to endBlocking() right after it.
+    static uint32_t startBlocking() {
+        return micros();
+    }
+
+    void endBlocking(uint8_t phase, uint32_t startedAtMicros);
+
+    void reset();
+
+    const LoopPhaseStats &getPhase(uint8_t phase) const {
+        return phases[phase];
+    }
+
+    uint32_t getIterations() const {
+        return iterations;
+    }
+
+    uint32_t getStalls() const {
+        return stalls;
+    }
+
+    // LOOP_PHASE_COUNT before the first iteration.
+    uint8_t getCurrentPhase() const {
+        return currentPhase;
+    }
+
+    // 0 is the most recent one. Returns nullptr if there's no such stall.
+    const LoopStall *getRecentStall(uint8_t i) const;
+
+    static const char *getPhaseName(uint8_t phase);
+
+private:
+    void recordPhase(uint8_t phase, uint32_t micros);
+
+    void endIteration(uint32_t now);
+};
+
+extern LoopProfiler loopProfiler;
+
+#endif // WI_SE_SW_LOOPPROFILER_H
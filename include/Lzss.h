@@ -0,0 +1,28 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_LZSS_H
+#define WI_SE_SW_LZSS_H
+
+#include <Arduino.h>
+
+// Small-window LZSS codec for console output. Every group of 8 items is preceded by a flag byte, where a set bit marks
+// a literal byte and a clear one a match: 12 bits of offset, 4 bits of length, plus one extra length byte when the 4 bits
+// are all set.
+#define LZSS_WINDOW_SIZE 4096
+#define LZSS_MIN_MATCH 3
+#define LZSS_SHORT_MAX_MATCH (LZSS_MIN_MATCH + 14)
+#define LZSS_MAX_MATCH (LZSS_SHORT_MAX_MATCH + 1 + 255)
+
+#define LZSS_HASH_BITS 9
+#define LZSS_HASH_SIZE (1 << LZSS_HASH_BITS)
+
+// Compresses src into dst using hashTable (LZSS_HASH_SIZE entries) as scratch space.
+// Returns the compressed length, or 0 if it doesn't fit in dstCap: in that case the data is better stored as is.
+size_t lzssCompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dstCap, uint16_t *hashTable);
+
+// Returns the decompressed length, at most dstCap.
+size_t lzssDecompress(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstCap);
+
+#endif // WI_SE_SW_LZSS_H
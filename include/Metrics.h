@@ -0,0 +1,63 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_METRICS_H
+#define WI_SE_SW_METRICS_H
+
+#include <Arduino.h>
+#include "LatencyHistogram.h"
+
+#define METRICS_FLOW_CTL_LOCAL  0
+#define METRICS_FLOW_CTL_REMOTE 1
+#define METRICS_FLOW_CTL_HEAP   2
+
+// Counters for the data path of a port, exported by its /metrics. Plain fields so that updating them costs a single
+// add.
+struct Metrics {
+    uint64_t wsTxFrames;
+    uint64_t wsTxBytes;
+    uint64_t wsRxFrames;
+    uint64_t wsRxBytes;
+
+    // Indexed by METRICS_FLOW_CTL_*.
+    uint32_t flowControlEngagements[3];
+    // Time the UART spent XOFF'd, and the WebSocket clients spent paused because of the heap.
+    uint64_t uartXoffMillis;
+    uint64_t wsPausedMillis;
+
+    uint32_t wsCannotSend;
+    uint32_t makeBufferFailures;
+    uint32_t clientsBlocked;
+    uint32_t clientsNuked;
+};
+
+// Shared by all ports, exported by each of them.
+struct LoopMetrics {
+    // Time between two consecutive loop() runs.
+    LatencyHistogram loopIteration;
+    uint64_t lastLoopStartedAtMicros;
+};
+
+extern LoopMetrics loopMetrics;
+
+class TTY;
+
+// Renders the metrics in the Prometheus text format, one metric per call at most, straight into the response buffer.
+// It keeps its own position so that it can be used by a chunked response filler without allocating anything.
+class MetricsRenderer {
+private:
+    const TTY *ttyd;
+    uint8_t section = 0;
+
+public:
+    explicit MetricsRenderer(const TTY *ttyd) : ttyd{ttyd} {}
+
+    // Returns RESPONSE_TRY_AGAIN if the next metric doesn't fit in maxLen, 0 when done.
+    size_t render(uint8_t *dest, size_t maxLen);
+
+private:
+    size_t renderSection(uint8_t i, char *buf, size_t size) const;
+};
+
+#endif // WI_SE_SW_METRICS_H
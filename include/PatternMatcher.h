@@ -0,0 +1,63 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_PATTERNMATCHER_H
+#define WI_SE_SW_PATTERNMATCHER_H
+
+#include <Arduino.h>
+
+// All patterns share a single 32-bit state word, one bit per pattern byte.
+#define PATTERN_MATCHER_MAX_TOTAL_LEN 32
+#define PATTERN_MATCHER_MAX_PATTERNS 8
+
+// Bit-parallel (shift-and) matcher for a handful of short byte patterns.
+// Matching costs one table lookup, a shift, an OR and two ANDs per byte no matter how many patterns are loaded.
+class PatternMatcher {
+private:
+    // One mask per byte value, bit i is set if the byte appears at position i of the concatenated patterns.
+    // Allocated only while patterns are loaded: 1 KB is a lot to keep around for nothing.
+    uint32_t *masks = nullptr;
+    uint32_t startBits = 0;
+    uint32_t endBits = 0;
+    uint32_t state = 0;
+
+    uint8_t usedBits = 0;
+    uint8_t patternsLen = 0;
+    uint8_t patternEndBit[PATTERN_MATCHER_MAX_PATTERNS] = {0};
+
+public:
+    ~PatternMatcher() {
+        clear();
+    }
+
+    // Returns the pattern index, -1 if there's no room for it or it can't be allocated.
+    int add(const uint8_t *pattern, size_t len);
+
+    void clear();
+
+    void reset() {
+        state = 0;
+    }
+
+    uint8_t count() const {
+        return patternsLen;
+    }
+
+    uint8_t bitsLeft() const {
+        return PATTERN_MATCHER_MAX_TOTAL_LEN - usedBits;
+    }
+
+    // Feeds a byte, returns a non-zero value if any pattern ends here. Must not be called with no patterns loaded.
+    inline uint32_t feed(uint8_t c) {
+        state = ((state << 1) | startBits) & masks[c];
+        return state & endBits;
+    }
+
+    // Whether the given pattern is part of the result returned by feed().
+    bool matched(uint32_t feedResult, int pattern) const {
+        return (feedResult & (1UL << patternEndBit[pattern])) != 0;
+    }
+};
+
+#endif // WI_SE_SW_PATTERNMATCHER_H
@@ -0,0 +1,74 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_RINGDUMP_H
+#define WI_SE_SW_RINGDUMP_H
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+
+// Serializes a ring of fixed-size items into a known-length binary response: Header, then the items. Items are
+// snapshotted by index when the dump starts and copied as the TCP window allows, so it needs no memory for a copy;
+// items overwritten in the meantime are sent as the given placeholder. Base of the /trace and /dlog dumps, which fill
+// in the header.
+template<typename Header, typename Item>
+class RingDumper {
+protected:
+    Header header = {};
+    // Sequence number of the first item in the dump, and how many there are.
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+private:
+    const Item *ring;
+    uint32_t ringSize;
+    const uint32_t *head;
+    Item overwritten;
+
+protected:
+    // Takes the items from sequence number since on, or all of those still in the ring if since is too old or comes
+    // from before a reboot (ahead of the head). ring may be null if ringSize is 0.
+    RingDumper(const Item *ring, uint32_t ringSize, const uint32_t *head, uint32_t since, const Item &overwritten)
+            : ring{ring}, ringSize{ringSize}, head{head}, overwritten(overwritten) {
+        uint32_t now = *head;
+        count = std::min(now, ringSize);
+        if (since <= now && now - since < count) {
+            count = now - since;
+        }
+        first = now - count;
+    }
+
+public:
+    size_t length() const {
+        return sizeof(Header) + count * sizeof(Item);
+    }
+
+    size_t render(uint8_t *dest, size_t maxLen, size_t index) const {
+        size_t len = 0;
+
+        if (index < sizeof(Header)) {
+            len = std::min(maxLen, sizeof(Header) - index);
+            memcpy(dest, (const uint8_t *) &header + index, len);
+        }
+
+        while (len < maxLen && index + len < length()) {
+            size_t offset = index + len - sizeof(Header);
+            uint32_t i = first + offset / sizeof(Item);
+            size_t itemOffset = offset % sizeof(Item);
+
+            Item item = ring[i & (ringSize - 1)];
+            if (*head - i > ringSize) {
+                item = overwritten;
+            }
+            size_t chunk = std::min(maxLen - len, sizeof(Item) - itemOffset);
+            memcpy(dest + len, (const uint8_t *) &item + itemOffset, chunk);
+            len += chunk;
+        }
+
+        return len;
+    }
+};
+
+#endif // WI_SE_SW_RINGDUMP_H
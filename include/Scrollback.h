@@ -0,0 +1,120 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_SCROLLBACK_H
+#define WI_SE_SW_SCROLLBACK_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "Lzss.h"
+
+#if SCROLLBACK_BLOCK_SIZE > LZSS_WINDOW_SIZE
+#error "SCROLLBACK_BLOCK_SIZE can't be larger than the LZSS window"
+#endif
+#if SCROLLBACK_SIZE > 65535
+#error "SCROLLBACK_SIZE must be less than 64 KB"
+#endif
+// A block that doesn't compress is stored as is, and there must be some history left after it replaces the oldest.
+#if SCROLLBACK_SIZE > 0 && SCROLLBACK_SIZE < 2 * SCROLLBACK_BLOCK_SIZE
+#error "SCROLLBACK_SIZE must hold at least two blocks of SCROLLBACK_BLOCK_SIZE"
+#endif
+
+// Console output rarely compresses better than 16:1 with our block size, so that's enough descriptors.
+#define SCROLLBACK_MAX_BLOCKS (SCROLLBACK_SIZE * 16 / SCROLLBACK_BLOCK_SIZE + 1)
+
+struct ScrollbackBlock {
+    uint16_t offset;
+    uint16_t storedLen;
+    uint16_t rawLen;
+    bool compressed;
+};
+
+// Position of a download in the scrollback, it survives blocks being evicted or compressed in the meantime.
+struct ScrollbackReader {
+    uint32_t seq;
+    size_t pos;
+    // Decompressed copy of the block being read, SCROLLBACK_BLOCK_SIZE bytes.
+    uint8_t *decoded;
+    uint32_t decodedSeq;
+    bool hasDecoded;
+};
+
+// Scrollback of UART output kept in RAM: data goes into an uncompressed hot tail, and every time that fills up it's
+// compressed into a circular arena where the oldest blocks are evicted to make room.
+class Scrollback {
+private:
+    uint8_t *arena = nullptr;
+    uint8_t *hot = nullptr;
+    uint8_t *compressBuf = nullptr;
+    uint16_t *hashTable = nullptr;
+
+    size_t hotLen = 0;
+    size_t arenaWritePos = 0;
+
+    ScrollbackBlock blocks[SCROLLBACK_MAX_BLOCKS] = {};
+    // Sequence number of the oldest block, the hot tail is always firstSeq + blocksLen.
+    uint32_t firstSeq = 0;
+    uint32_t blocksLen = 0;
+
+    size_t retainedRawBytes = 0;
+    size_t storedBytes = 0;
+
+    // Compression cost accounting.
+    uint64_t compressedRawBytesTotal = 0;
+    uint64_t compressedBytesTotal = 0;
+    uint64_t compressMicrosTotal = 0;
+
+public:
+    // Allocates all the buffers, the scrollback stays inactive if that fails.
+    void begin();
+
+    bool active() const {
+        return arena != nullptr;
+    }
+
+    void feed(const uint8_t *data, size_t len);
+
+    // Prepares reader to download the last maxBytes bytes (or everything if 0), returns false if out of memory.
+    bool openReader(ScrollbackReader &reader, size_t maxBytes);
+
+    void closeReader(ScrollbackReader &reader);
+
+    // Returns 0 once the reader reaches the end of the data that was available when called.
+    size_t read(ScrollbackReader &reader, uint8_t *dest, size_t maxLen);
+
+    size_t getRetainedBytes() const {
+        return retainedRawBytes + hotLen;
+    }
+
+    size_t getStoredBytes() const {
+        return storedBytes + hotLen;
+    }
+
+    uint32_t getBlockCount() const {
+        return blocksLen;
+    }
+
+    uint64_t getCompressedRawBytesTotal() const {
+        return compressedRawBytesTotal;
+    }
+
+    uint64_t getCompressedBytesTotal() const {
+        return compressedBytesTotal;
+    }
+
+    uint64_t getCompressMicrosTotal() const {
+        return compressMicrosTotal;
+    }
+
+private:
+    ScrollbackBlock &block(uint32_t seq) {
+        return blocks[seq % SCROLLBACK_MAX_BLOCKS];
+    }
+
+    void compressHot();
+
+    void evictOldest();
+};
+
+#endif // WI_SE_SW_SCROLLBACK_H
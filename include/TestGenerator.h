@@ -0,0 +1,108 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_TESTGENERATOR_H
+#define WI_SE_SW_TESTGENERATOR_H
+
+#include <Arduino.h>
+#include "config.h"
+
+enum TestGeneratorContent {
+    TEST_GEN_COMPRESSIBLE = 0, // The same line over and over
+    TEST_GEN_RANDOM,           // Random printable characters
+    TEST_GEN_ANSI,             // Colors and cursor movements with a few words in between
+    TEST_GEN_CONTENT_COUNT,
+};
+
+#define TEST_GEN_PATTERN_MAX_LEN 64
+
+// Synthetic UART: while it runs, TTY::dispatchUart() reads from it instead of UART_COMM, so that the throughput of the
+// firmware and of the Wi-Fi can be measured without the UART in the way. It behaves like a device writing at the given
+// rate into a buffer as large as the UART RX one: it stops while flow control is engaged and drops what doesn't fit.
+class TestGenerator {
+private:
+    bool running = false;
+    TestGeneratorContent content = TEST_GEN_COMPRESSIBLE;
+    // Bytes per second, 0 for as fast as the firmware can take them.
+    uint32_t rate = 0;
+    // Data shows up in chunks of this size, like a device that writes in bursts.
+    uint16_t chunk = 1;
+    uint64_t durationMillis = 0;
+
+    uint64_t startedAtMillis = 0;
+    uint64_t stoppedAtMillis = 0;
+    uint64_t lastUpdateMicros = 0;
+    // Bytes in the "RX buffer" and fractional bytes that didn't make a chunk yet (in bytes * 1000000).
+    size_t pending = 0;
+    uint64_t credit = 0;
+
+    uint64_t generatedBytes = 0;
+    uint64_t droppedBytes = 0;
+
+    char pattern[TEST_GEN_PATTERN_MAX_LEN] = {0};
+    uint8_t patternLen = 0;
+    uint8_t patternPos = 0;
+    uint32_t sequence = 0;
+    uint32_t randomState = 1;
+
+public:
+    void start(TestGeneratorContent content, uint32_t rate, uint16_t chunk, uint64_t durationMillis);
+
+    void stop();
+
+    bool isRunning() const {
+        return running;
+    }
+
+    // Call periodically, stops the generator when the duration is over.
+    void checkTimeout(uint64_t now);
+
+    // Like UART_COMM.available(). Pass whether flow control asked the sender to stop.
+    size_t available(bool paused);
+
+    size_t readBytes(char *buf, size_t len);
+
+    TestGeneratorContent getContent() const {
+        return content;
+    }
+
+    uint32_t getRate() const {
+        return rate;
+    }
+
+    uint16_t getChunk() const {
+        return chunk;
+    }
+
+    uint64_t getDurationMillis() const {
+        return durationMillis;
+    }
+
+    uint64_t getStartedAtMillis() const {
+        return startedAtMillis;
+    }
+
+    // Time it's been running, or ran for if it's stopped.
+    uint64_t getElapsedMillis() const;
+
+    uint64_t getGeneratedBytes() const {
+        return generatedBytes;
+    }
+
+    uint64_t getDroppedBytes() const {
+        return droppedBytes;
+    }
+
+    static const char *getContentName(TestGeneratorContent content);
+
+    // Returns TEST_GEN_CONTENT_COUNT if there's no such content.
+    static TestGeneratorContent parseContent(const char *name);
+
+private:
+    void nextPattern();
+
+    uint32_t random();
+};
+
+#endif // WI_SE_SW_TESTGENERATOR_H
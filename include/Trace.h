@@ -0,0 +1,87 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_TRACE_H
+#define WI_SE_SW_TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "RingDump.h"
+
+// Event types. The numbers are part of the dump format, only ever append (and update tools/decode_trace.py).
+#define TRACE_UART_XOFF           1  // arg0: source, arg1: free bytes in the UART RX buffer
+#define TRACE_UART_XON            2  // arg0: source, arg1: millis spent XOFF'd
+#define TRACE_WS_PAUSE            3  // arg1: free heap
+#define TRACE_WS_RESUME           4  // arg1: free heap, arg2: millis spent paused
+#define TRACE_CLIENT_ADDED        5  // arg1: client id, arg2: clients after adding it
+#define TRACE_CLIENT_REMOVED      6  // arg1: client id, arg2: clients after removing it
+#define TRACE_CLIENT_BLOCKED      7  // arg1: client id
+#define TRACE_CLIENT_NUKED        8  // arg0: close reason, arg1: client id
+#define TRACE_AUTOBAUD_REQUESTED  9
+#define TRACE_AUTOBAUD_RESULT     10 // arg1: closest standard rate (0 on timeout), arg2: measured rate
+#define TRACE_STTY                11 // arg0: UART config, arg1: baud rate
+#define TRACE_MAKE_BUFFER_FAILED  12 // arg1: requested size, arg2: free heap
+#define TRACE_LOOP_STALL          13 // arg0: LOOP_PHASE_* that took the longest, arg1: iteration micros, arg2: its micros
+#define TRACE_UART_DATA_LOST      14 // arg1: overruns so far, arg2: bytes in the UART RX buffer
+// Only in dumps: the event was overwritten while it was being downloaded.
+#define TRACE_OVERWRITTEN         0xFFFF
+
+#define TRACE_DUMP_MAGIC   0x52545357 // "WSTR"
+#define TRACE_DUMP_VERSION 1
+
+struct TraceEvent {
+    // Wraps every ~71 minutes, the decoder unwraps it using the order of the events.
+    uint32_t micros;
+    uint16_t type;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+};
+
+// Precedes the events in GET /trace, little-endian like the events.
+struct TraceDumpHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t eventSize;
+    uint16_t eventCount;
+    // Events recorded since boot, the ones before the dump were overwritten.
+    uint32_t recorded;
+    uint32_t reserved;
+    // Taken when the dump was started, to map event times to the device uptime.
+    uint64_t nowMicros;
+};
+
+#if TRACE_EVENTS > 0
+static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of 2");
+#endif
+
+// Flight recorder: fixed ring of the last TRACE_EVENTS events, always on. Recording an event is a handful of stores,
+// there's no locking, allocation or formatting.
+struct TraceRing {
+#if TRACE_EVENTS > 0
+    TraceEvent events[TRACE_EVENTS];
+#endif
+    uint32_t head;
+};
+
+extern TraceRing traceRing;
+
+static inline void trace(uint16_t type, uint16_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0) {
+#if TRACE_EVENTS > 0
+    TraceEvent &event = traceRing.events[traceRing.head++ & (TRACE_EVENTS - 1)];
+    event.micros = micros();
+    event.type = type;
+    event.arg0 = arg0;
+    event.arg1 = arg1;
+    event.arg2 = arg2;
+#endif
+}
+
+// Serializes the ring for GET /trace, events overwritten while it's being sent become TRACE_OVERWRITTEN.
+class TraceDumper : public RingDumper<TraceDumpHeader, TraceEvent> {
+public:
+    TraceDumper();
+};
+
+#endif // WI_SE_SW_TRACE_H
@@ -0,0 +1,110 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_UARTCAPTURE_H
+#define WI_SE_SW_UARTCAPTURE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PatternMatcher.h"
+
+#if UART_CAPTURE_MAX_TRIGGERS > PATTERN_MATCHER_MAX_PATTERNS
+#error "UART_CAPTURE_MAX_TRIGGERS can't be larger than PATTERN_MATCHER_MAX_PATTERNS"
+#endif
+
+enum UartCaptureSlotState {
+    UART_CAPTURE_SLOT_EMPTY = 0,
+    UART_CAPTURE_SLOT_FILLING,
+    UART_CAPTURE_SLOT_READY,
+};
+
+struct UartCaptureTrigger {
+    bool inUse;
+    char pattern[PATTERN_MATCHER_MAX_TOTAL_LEN + 1];
+    uint8_t patternLen;
+    // Bytes kept before the end of the match (pattern included) and after it.
+    uint16_t preBytes;
+    uint16_t postBytes;
+
+    uint32_t hits;
+    // Hits that found no free slot.
+    uint32_t missed;
+    // Slot being filled for this trigger, -1 if none. Retriggering is held off until it's done.
+    int8_t fillingSlot;
+};
+
+struct UartCaptureSlot {
+    UartCaptureSlotState state;
+    // Changes every time the slot is reused, so downloads in progress can tell their data is gone.
+    uint32_t generation;
+    uint8_t trigger;
+    uint64_t triggeredAtMillis;
+    uint8_t *data;
+    size_t len;
+    size_t preLen;
+    size_t postLeft;
+};
+
+// Oscilloscope-style capture: keeps a rolling history of UART output and, when a trigger pattern shows up, snapshots
+// the bytes around it into a RAM slot that can be downloaded later (/capture).
+class UartCapture {
+private:
+    UartCaptureTrigger triggers[UART_CAPTURE_MAX_TRIGGERS] = {};
+    UartCaptureSlot slots[UART_CAPTURE_SLOTS] = {};
+    PatternMatcher matcher;
+    int8_t triggerForPattern[PATTERN_MATCHER_MAX_PATTERNS] = {0};
+
+    // Pre-trigger history, only allocated while triggers are defined.
+    uint8_t *history = nullptr;
+    size_t historyHead = 0;
+    size_t historyLen = 0;
+
+public:
+    // Returns the trigger ID, or -1 if there's no room for it.
+    int addTrigger(const char *pattern, uint16_t preBytes, uint16_t postBytes);
+
+    bool removeTrigger(int id);
+
+    const UartCaptureTrigger *getTrigger(int id) const {
+        if (id < 0 || id >= UART_CAPTURE_MAX_TRIGGERS || !triggers[id].inUse) {
+            return nullptr;
+        }
+        return &triggers[id];
+    }
+
+    const UartCaptureSlot *getSlot(int id) const {
+        if (id < 0 || id >= UART_CAPTURE_SLOTS || slots[id].state == UART_CAPTURE_SLOT_EMPTY) {
+            return nullptr;
+        }
+        return &slots[id];
+    }
+
+    bool freeSlot(int id);
+
+    bool active() const {
+        return matcher.count() > 0;
+    }
+
+    uint8_t patternBytesLeft() const {
+        return matcher.bitsLeft();
+    }
+
+    void feed(const uint8_t *data, size_t len, uint64_t rxMillis);
+
+    // Copies captured data of a ready slot starting at index, returns 0 if the slot was freed in the meantime.
+    size_t read(int id, uint32_t generation, uint8_t *dest, size_t index, size_t maxLen) const;
+
+private:
+    void compile();
+
+    void trigger(int id, const uint8_t *data, size_t len, size_t matchEnd, uint64_t rxMillis);
+
+    void appendPost(UartCaptureSlot &slot, const uint8_t *data, size_t len);
+
+    void appendHistory(const uint8_t *data, size_t len);
+
+    void copyHistoryTail(uint8_t *dest, size_t len) const;
+};
+
+#endif // WI_SE_SW_UARTCAPTURE_H
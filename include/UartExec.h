@@ -0,0 +1,75 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_UARTEXEC_H
+#define WI_SE_SW_UARTEXEC_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "PatternMatcher.h"
+
+#define UART_EXEC_DEFAULT_TIMEOUT_MILLIS 5000
+
+enum UartExecState {
+    UART_EXEC_IDLE = 0,
+    UART_EXEC_RUNNING,
+    UART_EXEC_DONE,
+};
+
+// Runs a single expect-style command (POST /exec): writes to the UART, then captures UART output until a terminator
+// pattern shows up or the timeout expires. The result is rendered as JSON through a chunked response filler so the
+// output doesn't need to be copied again.
+class UartExec {
+private:
+    UartExecState state = UART_EXEC_IDLE;
+    // Identifies the request owning the slot, so a late disconnect of an old request can't release a new one.
+    uint32_t generation = 0;
+
+    PatternMatcher matcher;
+    char *output = nullptr;
+    size_t outputLen = 0;
+    bool truncated = false;
+    bool matched = false;
+
+    uint64_t startedAtMillis = 0;
+    uint64_t timeoutMillis = 0;
+    uint64_t firstByteAtMillis = 0;
+    uint64_t finishedAtMillis = 0;
+
+    // Rendering state.
+    char head[160] = {0};
+    size_t headLen = 0;
+    size_t renderHeadPos = 0;
+    size_t renderOutputPos = 0;
+    size_t renderTrailerPos = 0;
+
+    // Where the command goes, the UART of the TTY owning it
+    Print *uart = nullptr;
+
+public:
+    void setUart(Print *uart) {
+        this->uart = uart;
+    }
+
+    // Returns the generation owning the slot, 0 if busy or out of memory.
+    uint32_t start(const char *send, size_t sendLen, const char *until, uint64_t timeout);
+
+    void release(uint32_t gen);
+
+    bool active() const {
+        return state == UART_EXEC_RUNNING;
+    }
+
+    void feed(const uint8_t *data, size_t len, uint64_t rxMillis);
+
+    void checkTimeout(uint64_t now);
+
+    // Chunked response filler, returns RESPONSE_TRY_AGAIN while the command is still running.
+    size_t render(uint32_t gen, uint8_t *dest, size_t maxLen);
+
+private:
+    void finish(uint64_t now);
+};
+
+#endif // WI_SE_SW_UARTEXEC_H
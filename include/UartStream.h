@@ -0,0 +1,70 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_UARTSTREAM_H
+#define WI_SE_SW_UARTSTREAM_H
+
+#include <Arduino.h>
+#include <cbuf.h>
+#include "config.h"
+
+#define UART_STREAM_MODE_RAW    0
+#define UART_STREAM_MODE_NDJSON 1
+
+// Lines longer than this are split into multiple NDJSON records.
+#define UART_STREAM_LINE_MAX 256
+
+struct UartStreamClient {
+    bool inUse;
+    uint8_t mode;
+    cbuf *ring;
+
+    // NDJSON line assembly.
+    char line[UART_STREAM_LINE_MAX];
+    size_t lineLen;
+    uint64_t lineStartedAtMillis;
+
+    uint64_t droppedBytes;
+};
+
+// Fans UART output out to plain HTTP clients (GET /uart/stream) using chunked transfer encoding.
+// Each client gets its own ring buffer which is drained by the web server's chunk filler.
+class UartStreamer {
+private:
+    UartStreamClient clients[UART_STREAM_MAX_CLIENTS] = {};
+    uint8_t clientsLen = 0;
+
+public:
+    // Returns the client slot, or -1 if the client can't be handled right now.
+    int open(uint8_t mode);
+
+    void close(int slot);
+
+    bool active() const {
+        return clientsLen > 0;
+    }
+
+    uint8_t count() const {
+        return clientsLen;
+    }
+
+    // Same semantics as TTY::wsCanSend: false if any client can't take a full chunk.
+    bool canAccept() const;
+
+    void feed(const uint8_t *data, size_t len, uint64_t rxMillis);
+
+    // Copies buffered output of the given client into dest, returns the number of bytes copied.
+    size_t drain(int slot, uint8_t *dest, size_t maxLen);
+
+    uint64_t getDroppedBytes(int slot) const {
+        return clients[slot].droppedBytes;
+    }
+
+private:
+    void feedNdjson(UartStreamClient &client, const uint8_t *data, size_t len, uint64_t rxMillis);
+
+    void emitNdjsonLine(UartStreamClient &client);
+};
+
+#endif // WI_SE_SW_UARTSTREAM_H
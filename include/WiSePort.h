@@ -0,0 +1,91 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_WISEPORT_H
+#define WI_SE_SW_WISEPORT_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "server.h"
+#include "ExtendedSerial.h"
+
+// The ESP has one UART for the target. On Linux, fakeesp can serve many tty devices from one process.
+#ifdef FAKEESP
+    #define WISE_MAX_PORTS 64
+#else
+    #define WISE_MAX_PORTS 1
+#endif
+
+#define WISE_PORT_PATH_LEN 12
+
+// One serial port and everything that serves it: its TTY, its WebSocket and the server handling the WebSocket events.
+// Port 0 is at /ws and its server also registers the global HTTP routes, the others are at /ws/<index> and share the
+// same HTTP server. With more than one port, each one has its own /stty, /stats, /exec... under /ports/<index>; port 0
+// also keeps them at the top level.
+class WiSePort {
+private:
+    uint8_t index;
+    char path[WISE_PORT_PATH_LEN] = {0};
+    ExtendedSerial &uart;
+    AsyncWebSocket *websocket;
+    TTY *ttyd;
+    WiSeServer *server;
+
+    // Heap taken by the port's objects and buffers, measured when it's set up.
+    uint32_t memoryUsage = 0;
+    // Time spent in dispatchUart() and performHousekeeping(). Network callbacks aren't accounted to any port.
+    uint64_t busyMicros = 0;
+
+public:
+    WiSePort(uint8_t index, ExtendedSerial &uart, char *token, AsyncWebServer *httpd);
+
+    // Opens the UART and sets up the TTY. Call before begin().
+    void beginUart(uint32_t baudrate, uint8_t config);
+
+    // Registers the WebSocket and the port's HTTP routes, and for port 0 the global ones.
+    void begin();
+
+    void end() const;
+
+    void dispatchUart();
+
+    void performHousekeeping();
+
+    uint64_t getNextHousekeepingMillis() const {
+        return ttyd->getNextHousekeepingMillis();
+    }
+
+    uint8_t getIndex() const {
+        return index;
+    }
+
+    const char *getPath() const {
+        return path;
+    }
+
+    AsyncWebSocket *getWebSocket() const {
+        return websocket;
+    }
+
+    TTY *getTTY() const {
+        return ttyd;
+    }
+
+    WiSeServer *getServer() const {
+        return server;
+    }
+
+    uint32_t getMemoryUsage() const {
+        return memoryUsage;
+    }
+
+    uint64_t getBusyMicros() const {
+        return busyMicros;
+    }
+};
+
+extern WiSePort *ports[WISE_MAX_PORTS];
+extern uint8_t portCount;
+
+#endif //WI_SE_SW_WISEPORT_H
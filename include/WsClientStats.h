@@ -0,0 +1,110 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifndef WI_SE_SW_WSCLIENTSTATS_H
+#define WI_SE_SW_WSCLIENTSTATS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Frames whose size and time are remembered until the WebSocket library sends them. If the library queues more than
+// this, the oldest ones are accounted as sent early.
+#define WS_CLIENT_STATS_FIFO_LEN 16
+
+#define WS_CLIENT_RECENT_IPS 8
+
+struct WsQueuedFrame {
+    uint32_t size;
+    uint32_t queuedAtMillis;
+};
+
+// Delivery counters of a single WebSocket client, kept by TTY next to the client list.
+//
+// The WebSocket library doesn't say when a frame leaves, so sent frames are inferred from the queue length: when it
+// shrinks, the oldest frames we queued are gone. Frames queued by other paths (title, GPIOs...) make this approximate,
+// but they're rare and tiny compared to the output.
+class WsClientStats {
+public:
+    uint32_t clientId;
+    uint64_t connectedAtMillis;
+    // Previous connections from the same address since boot.
+    uint16_t reconnects;
+    bool subscribed;
+
+    uint32_t framesQueued;
+    uint64_t bytesQueued;
+    uint32_t framesSent;
+    uint64_t bytesSent;
+    // Frames not queued because the client's queue was full.
+    uint32_t framesDropped;
+    uint64_t bytesDropped;
+
+    uint16_t queueDepth;
+    uint16_t peakQueueDepth;
+
+    // Time this client kept wsCanSend() from returning true.
+    uint64_t blockingMillis;
+    uint64_t blockingSinceMillis;
+
+    uint32_t inputFrames;
+    uint64_t inputBytes;
+
+    // Taken when the test generator starts (or when the client connects, if later), to report the rate it achieved.
+    uint64_t testStartedAtMillis;
+    uint64_t testStartBytes;
+    uint64_t testStartBytesDropped;
+
+private:
+    WsQueuedFrame fifo[WS_CLIENT_STATS_FIFO_LEN];
+    uint8_t fifoHead;
+    uint8_t fifoLen;
+
+public:
+    void begin(uint32_t id, uint16_t previousConnections);
+
+    void onFrameQueued(size_t len, bool dropped);
+
+    // Accounts frames sent since the last call, given the current length of the client's queue.
+    void syncQueue(size_t queueLen);
+
+    void setBlocking(bool blocking);
+
+    void onInput(size_t len) {
+        inputFrames++;
+        inputBytes += len;
+    }
+
+    // Age of the oldest frame still in the queue, 0 if there's none.
+    uint32_t getLagMillis() const;
+
+    void toJson(JsonObject obj, uint64_t lastSeenMillis) const;
+
+    // Bytes that left, or were queued with the legacy library which doesn't tell.
+    uint64_t getDeliveredBytes() const {
+#ifdef LEGACY_LIB
+        return bytesQueued;
+#else
+        return bytesSent;
+#endif
+    }
+
+    void markTestStart();
+
+    // Rate achieved since markTestStart(), up to the given time.
+    void testRateToJson(JsonObject obj, uint64_t untilMillis) const;
+};
+
+// Remembers how many times each of the last few client addresses connected, to count reconnects.
+class WsRecentClients {
+private:
+    uint32_t ips[WS_CLIENT_RECENT_IPS] = {0};
+    uint16_t connections[WS_CLIENT_RECENT_IPS] = {0};
+    uint8_t next = 0;
+
+public:
+    // Returns the number of connections from this address before this one.
+    uint16_t onConnect(uint32_t ip);
+};
+
+#endif // WI_SE_SW_WSCLIENTSTATS_H
@@ -31,6 +31,10 @@ static inline uint8_t getHeapFragmentation() {
     return ESP.getHeapFragmentation();
 }
 
+static inline uint32_t getMaxFreeBlockSize() {
+    return ESP.getMaxFreeBlockSize();
+}
+
 static inline const char* getChipModel() {
     return "ESP8266";
 }
@@ -44,6 +48,7 @@ static inline void wisePanic(const char* msg) {
 
 #include <WiFi.h>
 #include "esp_system.h"
+#include "esp_timer.h"
 
 static inline void analogWriteRange(uint32_t) {
     return;
@@ -72,6 +77,10 @@ static inline uint8_t getHeapFragmentation() {
     return (uint8_t)((1.0 - (float)largest / free) * 100.0);
 }
 
+static inline uint32_t getMaxFreeBlockSize() {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
 static inline const char* getChipModel() {
     static char buf[10];
     esp_chip_info_t chip_info;
@@ -96,6 +105,10 @@ static inline void wisePanic(const char* msg) {
     esp_system_abort(msg);
 }
 
+static inline uint64_t micros64() {
+    return esp_timer_get_time();
+}
+
 #endif
 
 #endif // WI_SE_SW_COMPAT_H
@@ -7,7 +7,11 @@
 
 #include "config.h"
 
-#if ENABLE_DEBUG == 1
+#if DLOG_RECORDS > 0
+#include "Dlog.h"
+// The format must be a string literal: tools/dlog.py looks for it in the sources.
+#define debugf(fmt, ...) dlog(DLOG_ID(fmt), ##__VA_ARGS__)
+#elif ENABLE_DEBUG == 1
 #define debugf(...) UART_DEBUG.printf(__VA_ARGS__)
 #else
 #define debugf(...) do {} while(0)
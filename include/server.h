@@ -54,8 +54,15 @@ public:
         snprintf(serverHeader, sizeof(serverHeader) / sizeof(char), "%s", "Wi-Se/" VERSION);
     };
 
+    // The routes shared by all ports, the TTY routes at the top level and the WebSocket, for the first port.
     void begin();
 
+    // The TTY routes (/stty, /stats, /exec...) under prefix.
+    void beginPortRoutes(const String &prefix);
+
+    // Only the WebSocket, for the ports other than the first one that share the HTTP server.
+    void beginWebSocket();
+
     void end() const;
 
     static bool checkHttpBasicAuth(AsyncWebServerRequest *request);
@@ -64,6 +71,24 @@ public:
 
     void handleStatsRequest(AsyncWebServerRequest *request) const;
 
+    void handleClientStatsRequest(AsyncWebServerRequest *request) const;
+
+    void handlePortsRequest(AsyncWebServerRequest *request) const;
+
+    void handleMetricsRequest(AsyncWebServerRequest *request) const;
+
+    void handleTraceRequest(AsyncWebServerRequest *request) const;
+
+    void handleDlogRequest(AsyncWebServerRequest *request) const;
+
+#if HEAP_PROFILER_SLOTS > 0
+    void handleHeapProfileRequest(AsyncWebServerRequest *request) const;
+#endif
+
+    void handleProfileRequest(AsyncWebServerRequest *request) const;
+
+    void handleUartStreamRequest(AsyncWebServerRequest *request) const;
+
     void handleSttyRequest(AsyncWebServerRequest *request) const;
 
     void handleSttyBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const;
@@ -76,6 +101,32 @@ public:
 
     void handleGpioBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const;
 
+    void handleExecRequest(AsyncWebServerRequest *request) const;
+
+    void handleExecBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const;
+
+    void handleCaptureTriggersRequest(AsyncWebServerRequest *request) const;
+
+    void handleCaptureTriggersBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                                   size_t total) const;
+
+    void handleCaptureRequest(AsyncWebServerRequest *request) const;
+
+    void handleScrollbackRequest(AsyncWebServerRequest *request) const;
+
+    void handleScrollbackStatsRequest(AsyncWebServerRequest *request) const;
+
+    void handleAutoResponderRequest(AsyncWebServerRequest *request) const;
+
+    void handleAutoResponderBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                                 size_t total) const;
+
+    void handleTestGenRequest(AsyncWebServerRequest *request) const;
+
+    void handleTestGenBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const;
+
+    void testGenSendResponse(AsyncWebServerRequest *request) const;
+
     void
     onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data,
                      size_t len);
@@ -7,6 +7,18 @@
 
 #include <AsyncWebSocket.h>
 #include "config.h"
+#include "ExtendedSerial.h"
+#include "UartStream.h"
+#include "AutoResponder.h"
+#include "UartExec.h"
+#include "UartCapture.h"
+#include "Scrollback.h"
+#include "LatencyHistogram.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "LoopProfiler.h"
+#include "WsClientStats.h"
+#include "TestGenerator.h"
 
 // Client messages:
 #define CMD_INPUT '0'
@@ -16,6 +28,10 @@
 #define CMD_JSON_DATA '{'
 #define CMD_DETECT_BAUD 'B'
 #define CMD_SEND_BREAK 'b'
+// '1' to start receiving CMD_SERVER_CLIENT_STATS every second, '0' to stop.
+#define CMD_SUBSCRIBE_CLIENT_STATS 'T'
+// Answered right away with CMD_SERVER_PONG and the same payload, to measure the network round trip.
+#define CMD_PING 'p'
 
 // Server messages:
 #define CMD_OUTPUT '0'
@@ -24,6 +40,9 @@
 #define CMD_SERVER_DETECTED_BAUD 'B'
 #define CMD_SERVER_GPIO_STATES 'G'
 #define CMD_SET_WINDOW_TITLE '1'
+// Followed by the same JSON array as GET /stats/clients.
+#define CMD_SERVER_CLIENT_STATS 'T'
+#define CMD_SERVER_PONG 'p'
 
 // Defined as a string to be concatenated below.
 #define CMD_SET_PREFERENCES "2"
@@ -44,6 +63,14 @@ const char ttydWebConfig[] = CMD_SET_PREFERENCES TTYD_WEB_CONFIG;
 #define FLOW_CTL_XOFF 0x13
 #define FLOW_CTL_XON 0x11
 
+// Shown in the terminal where UART output was lost, if enabled with UART_LOSS_MARKER.
+#define UART_LOSS_MARKER_TEXT "\r\n\x1b[7m[Wi-Se: UART data lost]\x1b[0m\r\n"
+
+#define PING_PAYLOAD_MAX_LEN 32
+
+// Input that isn't answered within this time isn't counted in the echo latency.
+#define ECHO_TIMEOUT_MICROS 1000000
+
 #define WS_MAX_BLOCKED_CLIENTS 50
 #define WS_CLIENT_BLOCK_EXPIRE_MILLIS 5000
 
@@ -85,6 +112,7 @@ class TTY {
 private:
     char *token;
     AsyncWebSocket *websocket;
+    ExtendedSerial &uart;
 
     uint32_t uartBaudRate = UART_COMM_BAUD;
     uint8_t uartConfig = UART_COMM_CONFIG;
@@ -93,6 +121,9 @@ private:
     uint8_t wsClientsLen = 0;
     uint32_t wsClients[WS_MAX_CLIENTS] = {0};
     uint64_t wsClientsLastSeen[WS_MAX_CLIENTS] = {0};
+    // Parallel to wsClients.
+    WsClientStats wsClientStats[WS_MAX_CLIENTS] = {};
+    WsRecentClients wsRecentClients;
     uint8_t pendingAuthClients = 0;
 
     uint8_t wsBlockedClientsLen = 0;
@@ -129,13 +160,62 @@ private:
     uint64_t txRate = 0;
     uint64_t rxRate = 0;
 
+    // Latency from the first byte of a chunk showing up in the UART buffer to it being read, and to it being handed
+    // over to the WebSocket library.
+    uint64_t uartFirstAvailableMicros = 0;
+
+    // Latency from keyboard input being written to the UART to the first bytes coming back, and to them being handed
+    // over to the WebSocket library. Only measured when the UART is quiet, so that the first bytes are the echo.
+    uint64_t echoSentAtMicros = 0;
+    bool echoNoticed = false;
+    LatencyHistogram latencyEchoUart;
+    LatencyHistogram latencyEchoWs;
+
+    bool pendingLossMarker = false;
+    LatencyHistogram latencyUartToRead;
+    LatencyHistogram latencyUartToWs;
+
+    Metrics metrics = {};
+
+    // Plain HTTP clients tailing the UART output.
+    UartStreamer uartStreams;
+
+    // Rules answering UART prompts on-device.
+    AutoResponder autoResponder;
+
+    // UART output the auto-responder has already seen, read ahead while dispatching is held back so that prompts are
+    // still answered. It goes out before what's still in the UART.
+    uint8_t *rxHoldover = nullptr;
+    size_t rxHoldoverLen = 0;
+    // How many bytes at the start of the last sourceRead() came from rxHoldover.
+    size_t rxHoldoverRead = 0;
+
+    // Expect-style command run through POST /exec.
+    UartExec uartExec;
+
+    // Pattern-triggered snapshots of the UART output.
+    UartCapture uartCapture;
+
+    // Compressed history of the UART output.
+    Scrollback scrollback;
+
+    // Replaces the UART as the source of the output during throughput tests.
+    TestGenerator testGenerator;
+
     // GPIOs states and configuration.
     GpioConfig gpioConfigs[TARGET_GPIO_COUNT] = {
         TARGET_GPIO_INITS
     };
 
 public:
-    explicit TTY(char *token, AsyncWebSocket *websocket) : token{token}, websocket{websocket} {}
+    TTY(char *token, AsyncWebSocket *websocket, ExtendedSerial &uart) : token{token}, websocket{websocket}, uart{uart} {
+        autoResponder.setUart(&uart);
+        uartExec.setUart(&uart);
+    }
+
+    ExtendedSerial &getUart() const {
+        return uart;
+    }
 
     uint32_t getUartBaudRate() const {
         return uartBaudRate;
@@ -153,6 +233,20 @@ public:
 
     uint64_t getTxRate() const { return txRate; }
 
+    uint8_t getClientCount() const { return wsClientsLen; }
+
+    const LatencyHistogram &getLatencyUartToRead() const { return latencyUartToRead; }
+
+    const LatencyHistogram &getLatencyUartToWs() const { return latencyUartToWs; }
+
+    const LatencyHistogram &getLatencyEchoUart() const { return latencyEchoUart; }
+
+    const LatencyHistogram &getLatencyEchoWs() const { return latencyEchoWs; }
+
+    const Metrics &getMetrics() const { return metrics; }
+
+    void clientStatsToJson(JsonArray arr) const;
+
     void begin();
 
     void end();
@@ -161,7 +255,8 @@ public:
 
     bool onNewWebSocketClient(uint32_t clientId);
 
-    void removeClient(uint32_t clientId);
+    // kicked is for clients we're disconnecting, rather than ones that went away.
+    void removeClient(uint32_t clientId, bool kicked = false);
 
     void handleWebSocketMessage(uint32_t clientId, const uint8_t *buf, size_t len, char fragmentCachedCommand = 0);
 
@@ -169,9 +264,14 @@ public:
 
     void performHousekeeping();
 
+    // When performHousekeeping() or dispatchUart() have something to do next, now if dispatchUart() can move UART data.
+    uint64_t getNextHousekeepingMillis();
+
     void handleWebSocketPong(uint32_t clientId);
 
-    void blockClient(uint32_t clientId);
+    // Ignores whatever the client still sends for a while. Only kicked clients count as blocked in the metrics, the
+    // others are blocked just so that late events are ignored.
+    void blockClient(uint32_t clientId, bool kicked);
 
     bool isClientBlocked(uint32_t clientId);
     
@@ -179,6 +279,42 @@ public:
 
     GpioConfig* getGpioConfigs();
 
+    UartStreamer *getUartStreamer() {
+        return &uartStreams;
+    }
+
+    AutoResponder *getAutoResponder() {
+        return &autoResponder;
+    }
+
+    // Returns the generation of the started command, 0 if another one is running or there isn't enough memory.
+    uint32_t startExec(const char *send, size_t sendLen, const char *until, uint64_t timeout);
+
+    UartExec *getUartExec() {
+        return &uartExec;
+    }
+
+    UartCapture *getUartCapture() {
+        return &uartCapture;
+    }
+
+    Scrollback *getScrollback() {
+        return &scrollback;
+    }
+
+    void startTestGenerator(TestGeneratorContent content, uint32_t rate, uint16_t chunk, uint64_t durationMillis);
+
+    TestGenerator *getTestGenerator() {
+        return &testGenerator;
+    }
+
+    // Rate achieved by each client since the test generator started.
+    void testRatesToJson(JsonArray arr) const;
+
+#if TARGET_GPIO_COUNT > 0
+    void setGpioState(size_t index, uint64_t state);
+#endif
+
 private:
 
     int findClientIndex(uint32_t clientId) {
@@ -197,6 +333,12 @@ private:
         }
     }
 
+    // Whether anybody is interested in UART output, WebSocket clients or not.
+    bool hasUartConsumers() const {
+        return wsClientsLen > 0 || uartStreams.active() || autoResponder.active() || uartExec.active() ||
+               uartCapture.active() || scrollback.active();
+    }
+
     void pingClients();
 
     void checkClientTimeouts();
@@ -221,10 +363,37 @@ private:
 
     bool wsCanSend();
 
+    bool uartSinksCanAccept();
+
+    // Whether dispatchUart() would get data somewhere now. Unlike the checks it makes, it doesn't count anything.
+    bool canDispatchUart();
+
+    void onUartRx(const uint8_t *buf, size_t len, uint64_t rxMillis);
+
+    // Feeds the auto-responder, and applies the GPIO states of the rules that fired.
+    void answerPrompts(const uint8_t *buf, size_t len);
+
+    // Reads whatever the UART has into rxHoldover for the auto-responder, if it has rules.
+    void readAheadForPrompts();
+
     bool areAllClientsAuthenticated() const;
 
+    // websocket->makeBuffer(), accounted as WebSocket buffers by the heap profiler.
+    AsyncWebSocketMessageBuffer *makeWsBuffer(size_t size);
+
+    AsyncWebSocketMessageBuffer *makeWsBuffer(uint8_t *data, size_t size);
+
+    // Takes ownership of wsBuffer, which is released even if there's nobody to send it to.
     void broadcastBufferToClients(AsyncWebSocketMessageBuffer *wsBuffer);
 
+    // For buffers from makeWsBuffer() that end up not being sent.
+    void releaseWsBuffer(AsyncWebSocketMessageBuffer *wsBuffer);
+
+    // The UART, or the test generator while it's running. Includes rxHoldover.
+    size_t sourceAvailable();
+
+    size_t sourceRead(char *buf, size_t len);
+
     void flowControlWebSocketRequest(bool stop);
 
     bool performFlowControl_SlowWiFi(size_t uartAvailable);
@@ -233,6 +402,12 @@ private:
 
     void collectStats();
 
+    void pushClientStats();
+
+    void sendLossMarker();
+
+    void sendPong(uint32_t clientId, const uint8_t *payload, size_t len);
+
     void removeExpiredClientBlocks();
 
     void requestAutobaud();
@@ -0,0 +1,111 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "debug.h"
+#include "AutoResponder.h"
+
+int AutoResponder::addRule(const char *pattern, const char *response, int8_t gpioIndex, uint64_t gpioState,
+                           uint32_t maxHits) {
+    size_t patternLen = strlen(pattern);
+    size_t responseLen = strlen(response);
+    if (patternLen == 0 || patternLen > matcher.bitsLeft() || responseLen > AUTORESPONDER_RESPONSE_MAX_LEN) {
+        return -1;
+    }
+
+    for (int i = 0; i < AUTORESPONDER_MAX_RULES; i++) {
+        AutoResponderRule &rule = rules[i];
+        if (rule.inUse) {
+            continue;
+        }
+        memcpy(rule.pattern, pattern, patternLen + 1);
+        memcpy(rule.response, response, responseLen + 1);
+        rule.patternLen = patternLen;
+        rule.responseLen = responseLen;
+        rule.gpioIndex = gpioIndex;
+        rule.gpioState = gpioState;
+        rule.maxHits = maxHits;
+        rule.hits = 0;
+        rule.lastHitMillis = 0;
+        rule.inUse = true;
+
+        compile();
+        debugf("Autoresponder rule %d added, %d pattern bytes left\r\n", i, matcher.bitsLeft());
+        return i;
+    }
+    return -1;
+}
+
+bool AutoResponder::removeRule(int id) {
+    if (!getRule(id)) {
+        return false;
+    }
+    rules[id].inUse = false;
+    compile();
+    debugf("Autoresponder rule %d removed\r\n", id);
+    return true;
+}
+
+void AutoResponder::clearRules() {
+    for (AutoResponderRule &rule : rules) {
+        rule.inUse = false;
+    }
+    matcher.clear();
+}
+
+// Rebuilds the matcher tables from the armed rules. Rules that reached their max hits are left out so they don't cost
+// anything on the hot path.
+void AutoResponder::compile() {
+    matcher.clear();
+    for (int i = 0; i < AUTORESPONDER_MAX_RULES; i++) {
+        AutoResponderRule &rule = rules[i];
+        if (!rule.inUse || (rule.maxHits > 0 && rule.hits >= rule.maxHits)) {
+            continue;
+        }
+        int pattern = matcher.add((const uint8_t *) rule.pattern, rule.patternLen);
+        if (pattern < 0) {
+            debugf("Autoresponder can't compile rule %d\r\n", i);
+            continue;
+        }
+        ruleForPattern[pattern] = (int8_t) i;
+    }
+}
+
+void AutoResponder::fire(AutoResponderRule &rule, size_t &txBytes) {
+    if (rule.responseLen > 0) {
+        uart->write((const uint8_t *) rule.response, rule.responseLen);
+        txBytes += rule.responseLen;
+    }
+    rule.hits++;
+    rule.lastHitMillis = millis();
+}
+
+uint32_t AutoResponder::feed(const uint8_t *data, size_t len, size_t &txBytes) {
+    uint32_t fired = 0;
+    bool disarmed = false;
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t result = matcher.feed(data[i]);
+        if (!result) {
+            continue;
+        }
+        for (int p = 0; p < matcher.count(); p++) {
+            if (!matcher.matched(result, p)) {
+                continue;
+            }
+            AutoResponderRule &rule = rules[ruleForPattern[p]];
+            if (rule.maxHits > 0 && rule.hits >= rule.maxHits) {
+                // Disarmed earlier in this chunk, the matcher will be rebuilt below.
+                continue;
+            }
+            fire(rule, txBytes);
+            fired |= 1UL << ruleForPattern[p];
+            disarmed |= rule.maxHits > 0 && rule.hits >= rule.maxHits;
+        }
+    }
+
+    if (disarmed) {
+        compile();
+    }
+    return fired;
+}
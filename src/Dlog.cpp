@@ -0,0 +1,26 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "compat.h"
+#include "Dlog.h"
+
+DlogRing dlogRing = {};
+
+#if DLOG_RECORDS > 0
+#define DLOG_RING_RECORDS dlogRing.records
+#else
+#define DLOG_RING_RECORDS nullptr
+#endif
+
+static constexpr DlogRecord dlogOverwritten = {DLOG_ID_OVERWRITTEN, 0, {}};
+
+DlogDumper::DlogDumper(uint32_t since)
+        : RingDumper(DLOG_RING_RECORDS, DLOG_RECORDS, &dlogRing.head, since, dlogOverwritten) {
+    header.magic = DLOG_DUMP_MAGIC;
+    header.version = DLOG_DUMP_VERSION;
+    header.recordSize = sizeof(DlogRecord);
+    header.recordCount = count;
+    header.firstSeq = first;
+    header.nowMicros = micros64();
+}
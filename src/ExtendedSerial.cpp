@@ -13,6 +13,10 @@
 #include "ExtendedSerial.h"
 
 int ExtendedSerial::autobaudMeasure() {
+#ifdef FAKEESP
+    // No pulses to measure on a host, the fake serial port estimates it from the data
+    return estimateBaudrate();
+#else
     static bool doTrigger = true;
 
     if (doTrigger) {
@@ -38,6 +42,7 @@ int ExtendedSerial::autobaudMeasure() {
     int32_t baudrate = UART_CLK_FREQ / divisor;
 
     return baudrate;
+#endif
 }
 
 int ExtendedSerial::autobaudGetClosestStdRate(int32_t rawBaud) {
@@ -59,7 +64,9 @@ int ExtendedSerial::autobaudGetClosestStdRate(int32_t rawBaud) {
 }
 
 void ExtendedSerial::sendBreak() {
-#ifdef ESP8266
+#if defined(FAKEESP)
+    HardwareSerial::sendBreak();
+#elif defined(ESP8266)
     uart_wait_tx_empty(_uart);
     USC0(_uart_nr) |= BIT(UCBRK);
 
@@ -72,5 +79,61 @@ void ExtendedSerial::sendBreak() {
 #endif
 }
 
+void ExtendedSerial::beginErrorTracking() {
+#ifndef ESP8266
+    onReceiveError([this](hardwareSerial_error_t error) {
+        switch (error) {
+            case UART_FIFO_OVF_ERROR:
+                errors.overruns++;
+                break;
+            case UART_BUFFER_FULL_ERROR:
+                errors.bufferFull++;
+                break;
+            case UART_FRAME_ERROR:
+                errors.framingErrors++;
+                break;
+            case UART_PARITY_ERROR:
+                errors.parityErrors++;
+                break;
+            case UART_BREAK_ERROR:
+                errors.breaks++;
+                break;
+            default:
+                break;
+        }
+    });
+#endif
+}
+
+bool ExtendedSerial::pollErrors() {
+#ifdef ESP8266
+    // Both flags are cleared when read.
+    if (hasRxError()) {
+        errors.framingErrors++;
+    }
+    if (hasOverrun()) {
+        errors.overruns++;
+        return true;
+    }
+    return false;
+#else
+    // Updated by the driver task, just compare against the last poll.
+    uint32_t lost = errors.overruns + errors.bufferFull;
+    bool changed = lost != lostAtLastPoll;
+    lostAtLastPoll = lost;
+    return changed;
+#endif
+}
+
+void ExtendedSerial::resetErrorCounters() {
+    errors.overruns = 0;
+    errors.bufferFull = 0;
+    errors.framingErrors = 0;
+    errors.parityErrors = 0;
+    errors.breaks = 0;
+    lostAtLastPoll = 0;
+    rxHighWatermark = 0;
+}
+
 ExtendedSerial ExtSerial0(UART0);
 ExtendedSerial ExtSerial1(UART1);
@@ -0,0 +1,233 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "HeapProfiler.h"
+
+#if HEAP_PROFILER_SLOTS > 0
+
+#include "compat.h"
+#include "LoopProfiler.h"
+#ifdef FAKEESP
+    #include "FakeHeap.h"
+#endif
+
+#ifdef ESP32
+static portMUX_TYPE heapProfilerMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t mainTask = nullptr;
+#define HEAP_PROFILER_LOCK()   portENTER_CRITICAL(&heapProfilerMux)
+#define HEAP_PROFILER_UNLOCK() portEXIT_CRITICAL(&heapProfilerMux)
+#elif defined(FAKEESP)
+#define HEAP_PROFILER_LOCK()   do {} while (0)
+#define HEAP_PROFILER_UNLOCK() do {} while (0)
+#else
+// malloc() may be called from interrupts
+#define HEAP_PROFILER_LOCK()   uint32_t savedPs = xt_rsil(15)
+#define HEAP_PROFILER_UNLOCK() xt_wsr_ps(savedPs)
+#endif
+
+HeapProfiler heapProfiler;
+
+static const char *const categoryNames[HEAP_CAT_COUNT] = {
+        "other",
+        "wsBuffer",
+        "json",
+        "asyncTcp",
+        "string",
+};
+
+void HeapProfiler::begin() {
+#ifdef ESP32
+    mainTask = xTaskGetCurrentTaskHandle();
+#endif
+}
+
+uint8_t HeapProfiler::getContext() {
+#ifdef ESP32
+    return mainTask != nullptr && xTaskGetCurrentTaskHandle() != mainTask;
+#else
+    // The SDK runs network callbacks between two loop() runs and when the loop yields.
+    uint8_t phase = loopProfiler.getCurrentPhase();
+    return phase == LOOP_PHASE_OUTSIDE_LOOP || phase == LOOP_PHASE_YIELD_1 || phase == LOOP_PHASE_YIELD_2;
+#endif
+}
+
+uint8_t HeapProfiler::categorize(bool isRealloc) const {
+    uint8_t context = getContext();
+    if (tags[context] != HEAP_CAT_NONE) {
+        return tags[context];
+    }
+    if (isRealloc) {
+        return HEAP_CAT_STRING;
+    }
+    return context ? HEAP_CAT_ASYNC_TCP : HEAP_CAT_OTHER;
+}
+
+uint32_t HeapProfiler::slotFor(const void *ptr) {
+    // Fibonacci hashing, the low bits of heap pointers are always 0
+    return (((uintptr_t) ptr >> 3) * 2654435769UL) & (HEAP_PROFILER_SLOTS - 1);
+}
+
+void HeapProfiler::onAlloc(void *ptr, size_t size, uint8_t category) {
+    HEAP_PROFILER_LOCK();
+    HeapCategoryStats &stats = categories[category];
+    stats.allocs++;
+    stats.allocBytes += size;
+
+    // Keep one slot free so that lookups always terminate
+    if (tracked < HEAP_PROFILER_SLOTS - 1) {
+        uint32_t i = slotFor(ptr);
+        while (slots[i].ptr != nullptr) {
+            i = (i + 1) & (HEAP_PROFILER_SLOTS - 1);
+        }
+        slots[i] = {ptr, (uint32_t) size, category};
+        tracked++;
+
+        stats.liveBytes += size;
+        stats.liveCount++;
+        if (stats.liveBytes > stats.peakBytes) {
+            stats.peakBytes = stats.liveBytes;
+        }
+    } else {
+        untracked++;
+    }
+    HEAP_PROFILER_UNLOCK();
+}
+
+uint8_t HeapProfiler::onFree(void *ptr) {
+    uint8_t category = HEAP_CAT_NONE;
+    HEAP_PROFILER_LOCK();
+    uint32_t i = slotFor(ptr);
+    while (slots[i].ptr != nullptr && slots[i].ptr != ptr) {
+        i = (i + 1) & (HEAP_PROFILER_SLOTS - 1);
+    }
+    if (slots[i].ptr != nullptr) {
+        HeapCategoryStats &stats = categories[slots[i].category];
+        stats.liveBytes -= slots[i].size;
+        stats.liveCount--;
+        category = slots[i].category;
+        tracked--;
+
+        // Move back the following entries of the cluster that would no longer be found, instead of leaving a tombstone
+        uint32_t hole = i;
+        uint32_t j = i;
+        while (true) {
+            j = (j + 1) & (HEAP_PROFILER_SLOTS - 1);
+            if (slots[j].ptr == nullptr) {
+                break;
+            }
+            uint32_t home = slotFor(slots[j].ptr);
+            if (((j - home) & (HEAP_PROFILER_SLOTS - 1)) >= ((j - hole) & (HEAP_PROFILER_SLOTS - 1))) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = {};
+    }
+    HEAP_PROFILER_UNLOCK();
+    return category;
+}
+
+void HeapProfiler::sample() {
+    for (HeapCategoryStats &stats: categories) {
+        stats.allocsPerSec = stats.allocs - stats.prevAllocs;
+        stats.bytesPerSec = stats.allocBytes - stats.prevAllocBytes;
+        stats.prevAllocs = stats.allocs;
+        stats.prevAllocBytes = stats.allocBytes;
+    }
+
+    HeapSample &sample = history[(historyHead + historyLen) % HEAP_PROFILER_HISTORY];
+    sample.freeHeap = ESP.getFreeHeap();
+    sample.maxFreeBlock = getMaxFreeBlockSize();
+    if (historyLen < HEAP_PROFILER_HISTORY) {
+        historyLen++;
+    } else {
+        historyHead = (historyHead + 1) % HEAP_PROFILER_HISTORY;
+    }
+    if (sample.maxFreeBlock < minMaxFreeBlock) {
+        minMaxFreeBlock = sample.maxFreeBlock;
+    }
+}
+
+void HeapProfiler::reset() {
+    HEAP_PROFILER_LOCK();
+    for (HeapCategoryStats &stats: categories) {
+        stats.peakBytes = stats.liveBytes;
+        stats.allocs = 0;
+        stats.allocBytes = 0;
+        stats.allocsPerSec = 0;
+        stats.bytesPerSec = 0;
+        stats.prevAllocs = 0;
+        stats.prevAllocBytes = 0;
+    }
+    untracked = 0;
+    HEAP_PROFILER_UNLOCK();
+    historyLen = 0;
+    minMaxFreeBlock = UINT32_MAX;
+}
+
+const HeapSample &HeapProfiler::getHistory(uint8_t i) const {
+    return history[(historyHead + i) % HEAP_PROFILER_HISTORY];
+}
+
+const char *HeapProfiler::getCategoryName(uint8_t category) {
+    return category < HEAP_CAT_COUNT ? categoryNames[category] : "unknown";
+}
+
+// Linked with -Wl,--wrap=malloc,--wrap=free,--wrap=realloc,--wrap=calloc (see builder/platformio.j2.ini and
+// fakeesp/CMakeLists.txt): calls to malloc() end up here and the real one is __real_malloc(). On the host that's the
+// emulated heap, which falls back to the system one.
+#ifdef FAKEESP
+#define __real_malloc  fakeHeapMalloc
+#define __real_free    fakeHeapFree
+#define __real_realloc fakeHeapRealloc
+#define __real_calloc  fakeHeapCalloc
+#endif
+
+extern "C" {
+#ifndef FAKEESP
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_calloc(size_t count, size_t size);
+#endif
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    if (ptr) {
+        heapProfiler.onAlloc(ptr, size, heapProfiler.categorize(false));
+    }
+    return ptr;
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr) {
+        heapProfiler.onFree(ptr);
+    }
+    __real_free(ptr);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *newPtr = __real_realloc(ptr, size);
+    if (ptr && (newPtr || size == 0)) {
+        // Growing a block keeps it in the category it was allocated in
+        uint8_t category = heapProfiler.onFree(ptr);
+        if (newPtr) {
+            heapProfiler.onAlloc(newPtr, size, category != HEAP_CAT_NONE ? category : heapProfiler.categorize(true));
+        }
+    } else if (newPtr) {
+        heapProfiler.onAlloc(newPtr, size, heapProfiler.categorize(true));
+    }
+    return newPtr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    if (ptr) {
+        heapProfiler.onAlloc(ptr, count * size, heapProfiler.categorize(false));
+    }
+    return ptr;
+}
+}
+
+#endif // HEAP_PROFILER_SLOTS > 0
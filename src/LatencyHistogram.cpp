@@ -0,0 +1,26 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "LatencyHistogram.h"
+
+uint32_t LatencyHistogram::percentile(uint8_t p) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the sample we're looking for, rounded up.
+    uint64_t rank = ((uint64_t) count * p + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint32_t upperBound = i >= 31 ? UINT32_MAX : (2UL << i) - 1;
+            return std::min(upperBound, maxMicros);
+        }
+    }
+    return maxMicros;
+}
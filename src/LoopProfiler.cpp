@@ -0,0 +1,117 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <cstring>
+#include "debug.h"
+#include "Trace.h"
+#include "LoopProfiler.h"
+
+LoopProfiler loopProfiler;
+
+static const char *const phaseNames[LOOP_PHASE_COUNT] = {
+        "outsideLoop",
+        "ota",
+        "dispatchUart",
+        "yield1",
+        "housekeeping",
+        "yield2",
+        "softMinDelay",
+        "sendBreak",
+};
+
+void LoopProfiler::startIteration() {
+    uint32_t now = micros();
+    if (started) {
+        enterPhase(LOOP_PHASE_OUTSIDE_LOOP);
+        endIteration(now);
+    }
+    started = true;
+    iterationStartedAtMicros = now;
+    memset(iterationPhaseMicros, 0, sizeof(iterationPhaseMicros));
+    currentPhase = LOOP_PHASE_COUNT;
+}
+
+void LoopProfiler::enterPhase(uint8_t phase) {
+    uint32_t now = micros();
+    if (currentPhase < LOOP_PHASE_COUNT) {
+        recordPhase(currentPhase, now - phaseStartedAtMicros - phaseBlockingMicros);
+    }
+    currentPhase = phase;
+    phaseStartedAtMicros = now;
+    phaseBlockingMicros = 0;
+}
+
+void LoopProfiler::endLoop() {
+    enterPhase(LOOP_PHASE_OUTSIDE_LOOP);
+}
+
+void LoopProfiler::endBlocking(uint8_t phase, uint32_t startedAtMicros) {
+    uint32_t duration = micros() - startedAtMicros;
+    recordPhase(phase, duration);
+    phaseBlockingMicros += duration;
+}
+
+void LoopProfiler::recordPhase(uint8_t phase, uint32_t micros) {
+    LoopPhaseStats &stats = phases[phase];
+    if (stats.count == 0 || micros < stats.minMicros) {
+        stats.minMicros = micros;
+    }
+    if (micros > stats.maxMicros) {
+        stats.maxMicros = micros;
+    }
+    stats.count++;
+    stats.totalMicros += micros;
+    stats.histogram.record(micros);
+    iterationPhaseMicros[phase] += micros;
+}
+
+void LoopProfiler::endIteration(uint32_t now) {
+    uint32_t iterationMicros = now - iterationStartedAtMicros;
+    iterations++;
+    if (LOOP_STALL_THRESHOLD_MICROS == 0 || iterationMicros <= LOOP_STALL_THRESHOLD_MICROS) {
+        return;
+    }
+
+    uint8_t culprit = 0;
+    for (uint8_t i = 1; i < LOOP_PHASE_COUNT; i++) {
+        if (iterationPhaseMicros[i] > iterationPhaseMicros[culprit]) {
+            culprit = i;
+        }
+    }
+    stalls++;
+    phases[culprit].stalls++;
+
+    LoopStall &stall = recentStalls[recentStallsHead];
+    recentStallsHead = (recentStallsHead + 1) % LOOP_PROFILER_RECENT_STALLS;
+    stall.atMillis = millis();
+    stall.iterationMicros = iterationMicros;
+    stall.phase = culprit;
+    stall.phaseMicros = iterationPhaseMicros[culprit];
+
+    trace(TRACE_LOOP_STALL, culprit, iterationMicros, iterationPhaseMicros[culprit]);
+    BENCH debugf("Loop stall: %d us, %s took %d us\r\n", iterationMicros, phaseNames[culprit],
+                 iterationPhaseMicros[culprit]);
+}
+
+void LoopProfiler::reset() {
+    // Not memset(), the histograms have initializers of their own
+    for (LoopPhaseStats &phase : phases) {
+        phase = {};
+    }
+    memset(recentStalls, 0, sizeof(recentStalls));
+    recentStallsHead = 0;
+    iterations = 0;
+    stalls = 0;
+}
+
+const LoopStall *LoopProfiler::getRecentStall(uint8_t i) const {
+    if (i >= LOOP_PROFILER_RECENT_STALLS || i >= stalls) {
+        return nullptr;
+    }
+    return &recentStalls[(recentStallsHead + LOOP_PROFILER_RECENT_STALLS - 1 - i) % LOOP_PROFILER_RECENT_STALLS];
+}
+
+const char *LoopProfiler::getPhaseName(uint8_t phase) {
+    return phase < LOOP_PHASE_COUNT ? phaseNames[phase] : "unknown";
+}
@@ -0,0 +1,107 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "Lzss.h"
+
+// Flag byte plus 8 items of at most 3 bytes each.
+#define LZSS_GROUP_MAX_SIZE (1 + 8 * 3)
+
+static inline uint16_t lzssHash(const uint8_t *p) {
+    uint32_t v = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+    return (uint16_t) ((uint32_t) (v * 2654435761UL) >> (32 - LZSS_HASH_BITS));
+}
+
+size_t lzssCompress(const uint8_t *src, size_t len, uint8_t *dst, size_t dstCap, uint16_t *hashTable) {
+    // Positions are stored + 1 so that 0 means "none".
+    memset(hashTable, 0, LZSS_HASH_SIZE * sizeof(uint16_t));
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        if (out + LZSS_GROUP_MAX_SIZE > dstCap) {
+            return 0;
+        }
+        size_t flagsPos = out++;
+        uint8_t flags = 0;
+
+        for (uint8_t bit = 0; bit < 8 && in < len; bit++) {
+            size_t matchLen = 0;
+            size_t matchOffset = 0;
+
+            if (in + LZSS_MIN_MATCH <= len) {
+                uint16_t h = lzssHash(src + in);
+                size_t candidate = hashTable[h];
+                hashTable[h] = in + 1;
+                // A single candidate per hash is plenty for console output, which mostly repeats whole lines.
+                if (candidate && in - (candidate - 1) <= LZSS_WINDOW_SIZE) {
+                    const uint8_t *c = src + candidate - 1;
+                    size_t maxLen = std::min((size_t) LZSS_MAX_MATCH, len - in);
+                    while (matchLen < maxLen && c[matchLen] == src[in + matchLen]) {
+                        matchLen++;
+                    }
+                    matchOffset = in - (candidate - 1);
+                }
+            }
+
+            if (matchLen < LZSS_MIN_MATCH) {
+                flags |= 1 << bit;
+                dst[out++] = src[in++];
+                continue;
+            }
+
+            size_t off = matchOffset - 1;
+            uint8_t lenCode = std::min(matchLen - LZSS_MIN_MATCH, (size_t) 15);
+            dst[out++] = off >> 4;
+            dst[out++] = ((off & 0xF) << 4) | lenCode;
+            if (lenCode == 15) {
+                dst[out++] = matchLen - LZSS_SHORT_MAX_MATCH - 1;
+            }
+
+            // Index the positions we're skipping, so later lines can match against this one too.
+            for (size_t k = 1; k < matchLen && in + k + LZSS_MIN_MATCH <= len; k++) {
+                hashTable[lzssHash(src + in + k)] = in + k + 1;
+            }
+            in += matchLen;
+        }
+        dst[flagsPos] = flags;
+    }
+    return out;
+}
+
+size_t lzssDecompress(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstCap) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < srcLen && out < dstCap) {
+        uint8_t flags = src[in++];
+        for (uint8_t bit = 0; bit < 8 && in < srcLen && out < dstCap; bit++) {
+            if (flags & (1 << bit)) {
+                dst[out++] = src[in++];
+                continue;
+            }
+            if (in + 2 > srcLen) {
+                return out;
+            }
+            size_t off = ((size_t) src[in] << 4) | (src[in + 1] >> 4);
+            size_t matchLen = (src[in + 1] & 0xF) + LZSS_MIN_MATCH;
+            in += 2;
+            if (matchLen == LZSS_SHORT_MAX_MATCH + 1) {
+                if (in >= srcLen) {
+                    return out;
+                }
+                matchLen += src[in++];
+            }
+            if (off + 1 > out) {
+                // Corrupt data, don't read outside of the buffer.
+                return out;
+            }
+            // Byte by byte: matches may overlap with what they produce.
+            const uint8_t *from = dst + out - off - 1;
+            for (size_t k = 0; k < matchLen && out < dstCap; k++) {
+                dst[out++] = from[k];
+            }
+        }
+    }
+    return out;
+}
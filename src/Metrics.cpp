@@ -0,0 +1,192 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <ESPAsyncWebServer.h>
+#include "compat.h"
+#include "debug.h"
+#include "ExtendedSerial.h"
+#include "ttyd.h"
+#include "Metrics.h"
+
+// Longest metric block, with all of its samples.
+#define METRICS_SECTION_MAX_LEN 512
+
+LoopMetrics loopMetrics = {};
+
+// snprintf() that returns at most size, so that the lengths can be added up without ever pointing past the buffer.
+// A section that fills the buffer has been cut short.
+__attribute__((format(printf, 3, 4)))
+static size_t printTo(char *buf, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, size, format, args);
+    va_end(args);
+    return len < 0 ? size : std::min((size_t) len, size);
+}
+
+static size_t printHeader(char *buf, size_t size, const char *name, const char *type, const char *help) {
+    return printTo(buf, size, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static size_t printMetric(char *buf, size_t size, const char *name, const char *type, const char *help,
+                          uint64_t value) {
+    size_t len = printHeader(buf, size, name, type, help);
+    return len + printTo(buf + len, size - len, "%s %llu\n", name, value);
+}
+
+// Prints milliseconds as seconds, without going through floats.
+static size_t printSeconds(char *buf, size_t size, const char *name, const char *labels, uint64_t millis) {
+    return printTo(buf, size, "%s%s %llu.%03llu\n", name, labels, millis / 1000, millis % 1000);
+}
+
+static size_t printMicrosAsSeconds(char *buf, size_t size, const char *name, const char *labels, uint64_t micros) {
+    return printTo(buf, size, "%s%s %llu.%06llu\n", name, labels, micros / 1000000, micros % 1000000);
+}
+
+static size_t printSummary(char *buf, size_t size, const char *name, const char *help,
+                           const LatencyHistogram &histogram) {
+    size_t len = printHeader(buf, size, name, "summary", help);
+    len += printMicrosAsSeconds(buf + len, size - len, name, "{quantile=\"0.5\"}", histogram.percentile(50));
+    len += printMicrosAsSeconds(buf + len, size - len, name, "{quantile=\"0.99\"}", histogram.percentile(99));
+    len += printMicrosAsSeconds(buf + len, size - len, name, "{quantile=\"1\"}", histogram.getMax());
+    len += printTo(buf + len, size - len, "%s_count %u\n", name, histogram.getCount());
+    return len;
+}
+
+size_t MetricsRenderer::renderSection(uint8_t i, char *buf, size_t size) const {
+    const Metrics &metrics = ttyd->getMetrics();
+    size_t len;
+    switch (i) {
+        case 0:
+            return printMetric(buf, size, "wise_uart_rx_bytes_total", "counter", "Bytes received from the UART.",
+                               ttyd->getTotalRx());
+        case 1:
+            return printMetric(buf, size, "wise_uart_tx_bytes_total", "counter", "Bytes sent to the UART.",
+                               ttyd->getTotalTx());
+        case 2:
+            return printMetric(buf, size, "wise_ws_tx_frames_total", "counter",
+                               "UART output frames handed to the WebSocket library.", metrics.wsTxFrames);
+        case 3:
+            return printMetric(buf, size, "wise_ws_tx_bytes_total", "counter",
+                               "UART output bytes handed to the WebSocket library.", metrics.wsTxBytes);
+        case 4:
+            return printMetric(buf, size, "wise_ws_rx_frames_total", "counter",
+                               "WebSocket messages received from clients.", metrics.wsRxFrames);
+        case 5:
+            return printMetric(buf, size, "wise_ws_rx_bytes_total", "counter",
+                               "WebSocket message bytes received from clients.", metrics.wsRxBytes);
+        case 6:
+            len = printHeader(buf, size, "wise_flow_control_engagements_total", "counter",
+                              "Times flow control was engaged, by source.");
+            len += printTo(buf + len, size - len,
+                            "wise_flow_control_engagements_total{source=\"local\"} %u\n"
+                            "wise_flow_control_engagements_total{source=\"remote\"} %u\n"
+                            "wise_flow_control_engagements_total{source=\"heap\"} %u\n",
+                            metrics.flowControlEngagements[METRICS_FLOW_CTL_LOCAL],
+                            metrics.flowControlEngagements[METRICS_FLOW_CTL_REMOTE],
+                            metrics.flowControlEngagements[METRICS_FLOW_CTL_HEAP]);
+            return len;
+        case 7:
+            len = printHeader(buf, size, "wise_uart_xoff_seconds_total", "counter", "Time the UART spent XOFF'd.");
+            return len + printSeconds(buf + len, size - len, "wise_uart_xoff_seconds_total", "",
+                                      metrics.uartXoffMillis);
+        case 8:
+            len = printHeader(buf, size, "wise_ws_paused_seconds_total", "counter",
+                              "Time WebSocket clients spent paused because of low heap.");
+            return len + printSeconds(buf + len, size - len, "wise_ws_paused_seconds_total", "",
+                                      metrics.wsPausedMillis);
+        case 9:
+            return printMetric(buf, size, "wise_ws_cannot_send_total", "counter",
+                               "Times a WebSocket client queue was found full or not connected.",
+                               metrics.wsCannotSend);
+        case 10:
+            return printMetric(buf, size, "wise_ws_make_buffer_failures_total", "counter",
+                               "WebSocket buffers that could not be allocated.", metrics.makeBufferFailures);
+        case 11:
+            return printMetric(buf, size, "wise_ws_clients_blocked_total", "counter",
+                               "WebSocket clients blocked after being disconnected by the server.",
+                               metrics.clientsBlocked);
+        case 12:
+            return printMetric(buf, size, "wise_ws_clients_nuked_total", "counter",
+                               "WebSocket clients forcibly disconnected.", metrics.clientsNuked);
+        case 13:
+            return printMetric(buf, size, "wise_ws_clients", "gauge", "Connected WebSocket clients.",
+                               ttyd->getClientCount());
+        case 14:
+            return printMetric(buf, size, "wise_heap_free_bytes", "gauge", "Free heap.", ESP.getFreeHeap());
+        case 15:
+            return printMetric(buf, size, "wise_heap_fragmentation_percent", "gauge", "Heap fragmentation.",
+                               getHeapFragmentation());
+        case 16:
+            return printMetric(buf, size, "wise_uart_rx_high_watermark_bytes", "gauge",
+                               "Most bytes found waiting in the UART RX buffer since the last reset.",
+                               ttyd->getUart().getRxHighWatermark());
+        case 17:
+            return printMetric(buf, size, "wise_uart_rx_buffer_size_bytes", "gauge", "Size of the UART RX buffer.",
+                               UART_RX_BUF_SIZE);
+        case 18:
+            return printSummary(buf, size, "wise_loop_iteration_seconds", "Time between two main loop runs.",
+                                loopMetrics.loopIteration);
+        case 19:
+            return printSummary(buf, size, "wise_uart_to_read_latency_seconds",
+                                "Time from UART data being noticed to it being read.",
+                                ttyd->getLatencyUartToRead());
+        case 20:
+            return printSummary(buf, size, "wise_uart_to_ws_latency_seconds",
+                                "Time from UART data being noticed to it being handed to WebSocket.",
+                                ttyd->getLatencyUartToWs());
+        case 21:
+            len = printHeader(buf, size, "wise_uptime_seconds", "gauge", "Time since boot.");
+            return len + printSeconds(buf + len, size - len, "wise_uptime_seconds", "", millis());
+        case 22: {
+            UartErrorCounters errors = ttyd->getUart().getErrorCounters();
+            len = printHeader(buf, size, "wise_uart_errors_total", "counter",
+                              "UART receive errors since the last reset, by type.");
+            len += printTo(buf + len, size - len,
+                            "wise_uart_errors_total{type=\"overrun\"} %u\n"
+                            "wise_uart_errors_total{type=\"buffer_full\"} %u\n"
+                            "wise_uart_errors_total{type=\"framing\"} %u\n"
+                            "wise_uart_errors_total{type=\"parity\"} %u\n"
+                            "wise_uart_errors_total{type=\"break\"} %u\n",
+                            errors.overruns, errors.bufferFull, errors.framingErrors, errors.parityErrors,
+                            errors.breaks);
+            return len;
+        }
+        case 23:
+            return printSummary(buf, size, "wise_echo_uart_latency_seconds",
+                                "Time from input being written to the UART to the echo being noticed.",
+                                ttyd->getLatencyEchoUart());
+        case 24:
+            return printSummary(buf, size, "wise_echo_ws_latency_seconds",
+                                "Time from input being written to the UART to the echo being handed to WebSocket.",
+                                ttyd->getLatencyEchoWs());
+        default:
+            return 0;
+    }
+}
+
+size_t MetricsRenderer::render(uint8_t *dest, size_t maxLen) {
+    char buf[METRICS_SECTION_MAX_LEN];
+    size_t len = 0;
+
+    while (true) {
+        size_t sectionLen = renderSection(section, buf, sizeof(buf));
+        if (sectionLen == 0) {
+            return len;
+        }
+        if (sectionLen >= sizeof(buf)) {
+            // Truncated, better leave it out than send half of it
+            debugf("Metrics section %u too long, skipped\r\n", section);
+            section++;
+            continue;
+        }
+        if (sectionLen > maxLen - len) {
+            // It will be rendered again, with fresh values, when there's room for it.
+            return len > 0 ? len : RESPONSE_TRY_AGAIN;
+        }
+        memcpy(dest + len, buf, sectionLen);
+        len += sectionLen;
+        section++;
+    }
+}
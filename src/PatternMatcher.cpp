@@ -0,0 +1,39 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <new>
+#include "PatternMatcher.h"
+
+int PatternMatcher::add(const uint8_t *pattern, size_t len) {
+    if (len == 0 || len > bitsLeft() || patternsLen >= PATTERN_MATCHER_MAX_PATTERNS) {
+        return -1;
+    }
+    if (!masks) {
+        masks = new(std::nothrow) uint32_t[256]();
+        if (!masks) {
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        masks[pattern[i]] |= 1UL << (usedBits + i);
+    }
+    startBits |= 1UL << usedBits;
+    usedBits += len;
+    endBits |= 1UL << (usedBits - 1);
+    patternEndBit[patternsLen] = usedBits - 1;
+
+    reset();
+    return patternsLen++;
+}
+
+void PatternMatcher::clear() {
+    delete[] masks;
+    masks = nullptr;
+    startBits = 0;
+    endBits = 0;
+    usedBits = 0;
+    patternsLen = 0;
+    reset();
+}
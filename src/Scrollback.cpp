@@ -0,0 +1,156 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <new>
+#include "compat.h"
+#include "debug.h"
+#include "Scrollback.h"
+
+void Scrollback::begin() {
+    if (SCROLLBACK_SIZE == 0 || arena) {
+        return;
+    }
+    arena = new(std::nothrow) uint8_t[SCROLLBACK_SIZE];
+    hot = new(std::nothrow) uint8_t[SCROLLBACK_BLOCK_SIZE];
+    compressBuf = new(std::nothrow) uint8_t[SCROLLBACK_BLOCK_SIZE];
+    hashTable = new(std::nothrow) uint16_t[LZSS_HASH_SIZE];
+
+    if (!arena || !hot || !compressBuf || !hashTable) {
+        debugf("Scrollback can't be allocated\r\n");
+        delete[] arena;
+        delete[] hot;
+        delete[] compressBuf;
+        delete[] hashTable;
+        arena = nullptr;
+    }
+}
+
+void Scrollback::feed(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = std::min(len, (size_t) SCROLLBACK_BLOCK_SIZE - hotLen);
+        memcpy(hot + hotLen, data, n);
+        hotLen += n;
+        data += n;
+        len -= n;
+        if (hotLen == SCROLLBACK_BLOCK_SIZE) {
+            compressHot();
+        }
+    }
+}
+
+void Scrollback::evictOldest() {
+    ScrollbackBlock &oldest = block(firstSeq);
+    retainedRawBytes -= oldest.rawLen;
+    storedBytes -= oldest.storedLen;
+    firstSeq++;
+    blocksLen--;
+}
+
+void Scrollback::compressHot() {
+    uint64_t startedAtMicros = micros64();
+    // Anything that doesn't get smaller is stored as is.
+    size_t compressedLen = lzssCompress(hot, hotLen, compressBuf, hotLen - 1, hashTable);
+    compressMicrosTotal += micros64() - startedAtMicros;
+
+    bool compressed = compressedLen > 0;
+    const uint8_t *src = compressed ? compressBuf : hot;
+    size_t len = compressed ? compressedLen : hotLen;
+    compressedRawBytesTotal += hotLen;
+    compressedBytesTotal += len;
+
+    if (blocksLen == SCROLLBACK_MAX_BLOCKS) {
+        evictOldest();
+    }
+    if (arenaWritePos + len > SCROLLBACK_SIZE) {
+        // Doesn't fit before the end: the blocks still there are the oldest ones, drop them and wrap around.
+        while (blocksLen > 0 && block(firstSeq).offset >= arenaWritePos) {
+            evictOldest();
+        }
+        arenaWritePos = 0;
+    }
+    // Make room by evicting whatever we're about to overwrite.
+    while (blocksLen > 0 && block(firstSeq).offset >= arenaWritePos &&
+           block(firstSeq).offset < arenaWritePos + len) {
+        evictOldest();
+    }
+
+    memcpy(arena + arenaWritePos, src, len);
+    ScrollbackBlock &newest = block(firstSeq + blocksLen);
+    newest.offset = arenaWritePos;
+    newest.storedLen = len;
+    newest.rawLen = hotLen;
+    newest.compressed = compressed;
+    blocksLen++;
+
+    arenaWritePos += len;
+    retainedRawBytes += hotLen;
+    storedBytes += len;
+    hotLen = 0;
+}
+
+bool Scrollback::openReader(ScrollbackReader &reader, size_t maxBytes) {
+    reader.decoded = new(std::nothrow) uint8_t[SCROLLBACK_BLOCK_SIZE];
+    if (!reader.decoded) {
+        return false;
+    }
+    reader.hasDecoded = false;
+    reader.seq = firstSeq;
+    reader.pos = 0;
+
+    size_t skip = maxBytes > 0 && maxBytes < getRetainedBytes() ? getRetainedBytes() - maxBytes : 0;
+    while (reader.seq < firstSeq + blocksLen && skip >= block(reader.seq).rawLen) {
+        skip -= block(reader.seq).rawLen;
+        reader.seq++;
+    }
+    reader.pos = skip;
+    return true;
+}
+
+void Scrollback::closeReader(ScrollbackReader &reader) {
+    delete[] reader.decoded;
+    reader.decoded = nullptr;
+}
+
+size_t Scrollback::read(ScrollbackReader &reader, uint8_t *dest, size_t maxLen) {
+    if (reader.seq < firstSeq) {
+        // Evicted while we were sending it, skip to what's still there.
+        reader.seq = firstSeq;
+        reader.pos = 0;
+    }
+
+    size_t len = 0;
+    while (len < maxLen) {
+        if (reader.seq == firstSeq + blocksLen) {
+            // Hot tail, read up to where it is now.
+            if (reader.pos >= hotLen) {
+                break;
+            }
+            size_t n = std::min(maxLen - len, hotLen - reader.pos);
+            memcpy(dest + len, hot + reader.pos, n);
+            len += n;
+            reader.pos += n;
+            continue;
+        }
+
+        ScrollbackBlock &b = block(reader.seq);
+        const uint8_t *src = arena + b.offset;
+        if (b.compressed) {
+            if (!reader.hasDecoded || reader.decodedSeq != reader.seq) {
+                lzssDecompress(src, b.storedLen, reader.decoded, b.rawLen);
+                reader.decodedSeq = reader.seq;
+                reader.hasDecoded = true;
+            }
+            src = reader.decoded;
+        }
+        size_t n = std::min(maxLen - len, b.rawLen - reader.pos);
+        memcpy(dest + len, src + reader.pos, n);
+        len += n;
+        reader.pos += n;
+        if (reader.pos == b.rawLen) {
+            reader.seq++;
+            reader.pos = 0;
+        }
+    }
+    return len;
+}
@@ -0,0 +1,164 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "compat.h"
+#include "debug.h"
+#include "TestGenerator.h"
+
+static const char *const contentNames[TEST_GEN_CONTENT_COUNT] = {
+        "compressible",
+        "random",
+        "ansi",
+};
+
+static const char *const ansiWords[] = {
+        "root", "login:", "eth0", "OK", "FAILED", "kernel", "[  1.337]", "usb 1-1:", "systemd", "Starting",
+};
+
+void TestGenerator::start(TestGeneratorContent content, uint32_t rate, uint16_t chunk, uint64_t durationMillis) {
+    this->content = content;
+    this->rate = rate;
+    this->chunk = chunk ? chunk : 1;
+    this->durationMillis = durationMillis;
+
+    startedAtMillis = millis();
+    stoppedAtMillis = 0;
+    lastUpdateMicros = micros64();
+    pending = 0;
+    credit = 0;
+    generatedBytes = 0;
+    droppedBytes = 0;
+    patternLen = 0;
+    patternPos = 0;
+    sequence = 0;
+    randomState = esp_random() | 1;
+    running = true;
+
+    debugf("Test generator started: %s, %u B/s, chunks of %u B\r\n", contentNames[content], rate, this->chunk);
+}
+
+void TestGenerator::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    stoppedAtMillis = millis();
+    debugf("Test generator stopped, %llu B in %llu ms\r\n", generatedBytes, stoppedAtMillis - startedAtMillis);
+}
+
+void TestGenerator::checkTimeout(uint64_t now) {
+    if (running && durationMillis != 0 && now - startedAtMillis >= durationMillis) {
+        stop();
+    }
+}
+
+size_t TestGenerator::available(bool paused) {
+    if (!running) {
+        return 0;
+    }
+    uint64_t now = micros64();
+    uint64_t elapsed = now - lastUpdateMicros;
+    lastUpdateMicros = now;
+    if (paused) {
+        // XOFF'd, the device doesn't write anything
+        return pending;
+    }
+
+    size_t written;
+    if (rate == 0) {
+        written = UART_RX_BUF_SIZE - pending;
+    } else {
+        credit += elapsed * rate;
+        uint64_t chunkCredit = (uint64_t) chunk * 1000000;
+        uint64_t chunks = credit / chunkCredit;
+        credit -= chunks * chunkCredit;
+        written = chunks * chunk;
+    }
+
+    if (pending + written > UART_RX_BUF_SIZE) {
+        droppedBytes += pending + written - UART_RX_BUF_SIZE;
+        pending = UART_RX_BUF_SIZE;
+    } else {
+        pending += written;
+    }
+    return pending;
+}
+
+size_t TestGenerator::readBytes(char *buf, size_t len) {
+    size_t read = std::min(len, pending);
+    for (size_t i = 0; i < read;) {
+        if (patternPos == patternLen) {
+            nextPattern();
+        }
+        size_t n = std::min((size_t) (patternLen - patternPos), read - i);
+        memcpy(buf + i, pattern + patternPos, n);
+        patternPos += n;
+        i += n;
+    }
+    pending -= read;
+    generatedBytes += read;
+    return read;
+}
+
+uint64_t TestGenerator::getElapsedMillis() const {
+    if (startedAtMillis == 0) {
+        return 0;
+    }
+    return (running ? millis() : stoppedAtMillis) - startedAtMillis;
+}
+
+const char *TestGenerator::getContentName(TestGeneratorContent content) {
+    return content < TEST_GEN_CONTENT_COUNT ? contentNames[content] : "unknown";
+}
+
+TestGeneratorContent TestGenerator::parseContent(const char *name) {
+    for (int i = 0; i < TEST_GEN_CONTENT_COUNT; i++) {
+        if (strcmp(name, contentNames[i]) == 0) {
+            return (TestGeneratorContent) i;
+        }
+    }
+    return TEST_GEN_CONTENT_COUNT;
+}
+
+void TestGenerator::nextPattern() {
+    int len = 0;
+    switch (content) {
+        case TEST_GEN_COMPRESSIBLE:
+            len = snprintf(pattern, sizeof(pattern), "The quick brown fox jumps over the lazy dog %u\r\n", sequence);
+            break;
+        case TEST_GEN_RANDOM:
+            for (; len < TEST_GEN_PATTERN_MAX_LEN - 3; len++) {
+                pattern[len] = (char) (' ' + random() % ('~' - ' ' + 1));
+            }
+            pattern[len++] = '\r';
+            pattern[len++] = '\n';
+            break;
+        case TEST_GEN_ANSI: {
+            uint32_t r = random();
+            const char *word = ansiWords[r % (sizeof(ansiWords) / sizeof(ansiWords[0]))];
+            if (sequence % 16 == 0) {
+                len = snprintf(pattern, sizeof(pattern), "\x1b[2J\x1b[H");
+            } else {
+                len = snprintf(pattern, sizeof(pattern), "\x1b[%u;%uH\x1b[%u;3%um%s\x1b[0m\x1b[K",
+                               1 + (r >> 8) % 24, 1 + (r >> 16) % 70, (r >> 24) & 1, 1 + (r >> 25) % 7, word);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    sequence++;
+    patternLen = std::min(len, TEST_GEN_PATTERN_MAX_LEN - 1);
+    patternPos = 0;
+}
+
+uint32_t TestGenerator::random() {
+    // xorshift32, esp_random() is too slow to call for every byte.
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
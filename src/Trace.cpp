@@ -0,0 +1,25 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "compat.h"
+#include "Trace.h"
+
+TraceRing traceRing = {};
+
+#if TRACE_EVENTS > 0
+#define TRACE_RING_EVENTS traceRing.events
+#else
+#define TRACE_RING_EVENTS nullptr
+#endif
+
+static constexpr TraceEvent traceOverwritten = {0, TRACE_OVERWRITTEN, 0, 0, 0};
+
+TraceDumper::TraceDumper() : RingDumper(TRACE_RING_EVENTS, TRACE_EVENTS, &traceRing.head, 0, traceOverwritten) {
+    header.magic = TRACE_DUMP_MAGIC;
+    header.version = TRACE_DUMP_VERSION;
+    header.eventSize = sizeof(TraceEvent);
+    header.eventCount = count;
+    header.recorded = first + count;
+    header.nowMicros = micros64();
+}
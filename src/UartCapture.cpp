@@ -0,0 +1,208 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <new>
+#include "debug.h"
+#include "UartCapture.h"
+
+int UartCapture::addTrigger(const char *pattern, uint16_t preBytes, uint16_t postBytes) {
+    size_t patternLen = strlen(pattern);
+    if (patternLen == 0 || patternLen > matcher.bitsLeft() || preBytes < patternLen ||
+        preBytes > UART_CAPTURE_HISTORY_SIZE || preBytes + postBytes > UART_CAPTURE_SLOT_MAX_SIZE) {
+        return -1;
+    }
+    if (!history) {
+        history = new(std::nothrow) uint8_t[UART_CAPTURE_HISTORY_SIZE];
+        if (!history) {
+            return -1;
+        }
+        historyHead = 0;
+        historyLen = 0;
+    }
+
+    for (int i = 0; i < UART_CAPTURE_MAX_TRIGGERS; i++) {
+        UartCaptureTrigger &trigger = triggers[i];
+        if (trigger.inUse) {
+            continue;
+        }
+        memcpy(trigger.pattern, pattern, patternLen + 1);
+        trigger.patternLen = patternLen;
+        trigger.preBytes = preBytes;
+        trigger.postBytes = postBytes;
+        trigger.hits = 0;
+        trigger.missed = 0;
+        trigger.fillingSlot = -1;
+        trigger.inUse = true;
+
+        compile();
+        debugf("Capture trigger %d added, %d pattern bytes left\r\n", i, matcher.bitsLeft());
+        return i;
+    }
+    return -1;
+}
+
+bool UartCapture::removeTrigger(int id) {
+    if (!getTrigger(id)) {
+        return false;
+    }
+    int8_t slot = triggers[id].fillingSlot;
+    if (slot >= 0) {
+        // Keep what we've got so far.
+        slots[slot].state = UART_CAPTURE_SLOT_READY;
+    }
+    triggers[id].inUse = false;
+    compile();
+
+    if (!active()) {
+        delete[] history;
+        history = nullptr;
+    }
+    debugf("Capture trigger %d removed\r\n", id);
+    return true;
+}
+
+bool UartCapture::freeSlot(int id) {
+    if (!getSlot(id)) {
+        return false;
+    }
+    UartCaptureSlot &slot = slots[id];
+    if (slot.state == UART_CAPTURE_SLOT_FILLING) {
+        triggers[slot.trigger].fillingSlot = -1;
+    }
+    delete[] slot.data;
+    slot.data = nullptr;
+    slot.state = UART_CAPTURE_SLOT_EMPTY;
+    slot.generation++;
+    return true;
+}
+
+void UartCapture::compile() {
+    matcher.clear();
+    for (int i = 0; i < UART_CAPTURE_MAX_TRIGGERS; i++) {
+        UartCaptureTrigger &trigger = triggers[i];
+        if (!trigger.inUse) {
+            continue;
+        }
+        int pattern = matcher.add((const uint8_t *) trigger.pattern, trigger.patternLen);
+        if (pattern < 0) {
+            debugf("Capture can't compile trigger %d\r\n", i);
+            continue;
+        }
+        triggerForPattern[pattern] = (int8_t) i;
+    }
+}
+
+void UartCapture::feed(const uint8_t *data, size_t len, uint64_t rxMillis) {
+    // Slots that are already waiting for post-trigger data get the whole chunk.
+    for (UartCaptureSlot &slot : slots) {
+        if (slot.state == UART_CAPTURE_SLOT_FILLING) {
+            appendPost(slot, data, len);
+        }
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t result = matcher.feed(data[i]);
+        if (!result) {
+            continue;
+        }
+        for (int p = 0; p < matcher.count(); p++) {
+            if (matcher.matched(result, p)) {
+                trigger(triggerForPattern[p], data, len, i + 1, rxMillis);
+            }
+        }
+    }
+
+    appendHistory(data, len);
+}
+
+// Snapshots the pre-trigger window ending at data[matchEnd - 1] and starts collecting the post-trigger window.
+void UartCapture::trigger(int id, const uint8_t *data, size_t len, size_t matchEnd, uint64_t rxMillis) {
+    UartCaptureTrigger &trigger = triggers[id];
+    if (trigger.fillingSlot >= 0) {
+        // Still busy with the previous hit, most likely the same crash printing the pattern again.
+        return;
+    }
+    trigger.hits++;
+
+    int slotId = -1;
+    for (int i = 0; i < UART_CAPTURE_SLOTS; i++) {
+        if (slots[i].state == UART_CAPTURE_SLOT_EMPTY) {
+            slotId = i;
+            break;
+        }
+    }
+    // Allocating here means the heap may be tight while we're spewing data, leave some room for the WebSocket.
+    size_t needed = (size_t) trigger.preBytes + trigger.postBytes + HEAP_FREE_HIGH_WATERMARK;
+    if (slotId < 0 || ESP.getFreeHeap() < needed) {
+        trigger.missed++;
+        debugf("Capture trigger %d missed, no free slot or heap\r\n", id);
+        return;
+    }
+    UartCaptureSlot &slot = slots[slotId];
+    slot.data = new(std::nothrow) uint8_t[trigger.preBytes + trigger.postBytes];
+    if (!slot.data) {
+        trigger.missed++;
+        return;
+    }
+
+    size_t fromChunk = std::min((size_t) trigger.preBytes, matchEnd);
+    size_t fromHistory = std::min((size_t) trigger.preBytes - fromChunk, historyLen);
+    copyHistoryTail(slot.data, fromHistory);
+    memcpy(slot.data + fromHistory, data + matchEnd - fromChunk, fromChunk);
+
+    slot.state = UART_CAPTURE_SLOT_FILLING;
+    slot.generation++;
+    slot.trigger = id;
+    slot.triggeredAtMillis = rxMillis;
+    slot.preLen = fromHistory + fromChunk;
+    slot.len = slot.preLen;
+    slot.postLeft = trigger.postBytes;
+    trigger.fillingSlot = (int8_t) slotId;
+    debugf("Capture trigger %d hit, slot %d\r\n", id, slotId);
+
+    // The rest of the chunk is post-trigger data, feed() won't hand it over since the slot wasn't filling yet.
+    appendPost(slot, data + matchEnd, len - matchEnd);
+}
+
+void UartCapture::appendPost(UartCaptureSlot &slot, const uint8_t *data, size_t len) {
+    size_t n = std::min(len, slot.postLeft);
+    memcpy(slot.data + slot.len, data, n);
+    slot.len += n;
+    slot.postLeft -= n;
+    if (slot.postLeft == 0) {
+        slot.state = UART_CAPTURE_SLOT_READY;
+        triggers[slot.trigger].fillingSlot = -1;
+        debugf("Capture slot ready, %d B\r\n", slot.len);
+    }
+}
+
+void UartCapture::appendHistory(const uint8_t *data, size_t len) {
+    // Only the tail can ever be needed.
+    if (len > UART_CAPTURE_HISTORY_SIZE) {
+        data += len - UART_CAPTURE_HISTORY_SIZE;
+        len = UART_CAPTURE_HISTORY_SIZE;
+    }
+    size_t first = std::min(len, (size_t) UART_CAPTURE_HISTORY_SIZE - historyHead);
+    memcpy(history + historyHead, data, first);
+    memcpy(history, data + first, len - first);
+    historyHead = (historyHead + len) % UART_CAPTURE_HISTORY_SIZE;
+    historyLen = std::min(historyLen + len, (size_t) UART_CAPTURE_HISTORY_SIZE);
+}
+
+void UartCapture::copyHistoryTail(uint8_t *dest, size_t len) const {
+    size_t start = (historyHead + UART_CAPTURE_HISTORY_SIZE - len) % UART_CAPTURE_HISTORY_SIZE;
+    size_t first = std::min(len, (size_t) UART_CAPTURE_HISTORY_SIZE - start);
+    memcpy(dest, history + start, first);
+    memcpy(dest + first, history, len - first);
+}
+
+size_t UartCapture::read(int id, uint32_t generation, uint8_t *dest, size_t index, size_t maxLen) const {
+    const UartCaptureSlot *slot = getSlot(id);
+    if (!slot || slot->generation != generation || index >= slot->len) {
+        return 0;
+    }
+    size_t n = std::min(maxLen, slot->len - index);
+    memcpy(dest, slot->data + index, n);
+    return n;
+}
@@ -0,0 +1,141 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <ESPAsyncWebServer.h>
+#include "debug.h"
+#include "JsonEscape.h"
+#include "UartExec.h"
+
+uint32_t UartExec::start(const char *send, size_t sendLen, const char *until, uint64_t timeout) {
+    if (state != UART_EXEC_IDLE) {
+        return 0;
+    }
+    if (ESP.getFreeHeap() < UART_EXEC_OUTPUT_MAX + HEAP_FREE_HIGH_WATERMARK) {
+        debugf("Exec refused, free heap %d\r\n", ESP.getFreeHeap());
+        return 0;
+    }
+    output = new(std::nothrow) char[UART_EXEC_OUTPUT_MAX];
+    if (!output) {
+        return 0;
+    }
+    if (until && until[0] && matcher.add((const uint8_t *) until, strlen(until)) < 0) {
+        delete[] output;
+        output = nullptr;
+        return 0;
+    }
+
+    outputLen = 0;
+    truncated = false;
+    matched = false;
+    firstByteAtMillis = 0;
+    finishedAtMillis = 0;
+    headLen = 0;
+    renderHeadPos = 0;
+    renderOutputPos = 0;
+    renderTrailerPos = 0;
+    timeoutMillis = timeout;
+    startedAtMillis = millis();
+    state = UART_EXEC_RUNNING;
+
+    // Generation 0 means "no slot".
+    if (++generation == 0) {
+        generation = 1;
+    }
+
+    uart->write((const uint8_t *) send, sendLen);
+    debugf("Exec %u started, sent %d B\r\n", generation, sendLen);
+    return generation;
+}
+
+void UartExec::release(uint32_t gen) {
+    if (gen != generation || state == UART_EXEC_IDLE) {
+        return;
+    }
+    debugf("Exec %u released\r\n", gen);
+    delete[] output;
+    output = nullptr;
+    matcher.clear();
+    state = UART_EXEC_IDLE;
+}
+
+void UartExec::feed(const uint8_t *data, size_t len, uint64_t rxMillis) {
+    if (firstByteAtMillis == 0) {
+        firstByteAtMillis = rxMillis;
+    }
+    bool hasPattern = matcher.count() > 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (outputLen < UART_EXEC_OUTPUT_MAX) {
+            output[outputLen++] = (char) data[i];
+        } else {
+            truncated = true;
+        }
+        if (hasPattern && matcher.feed(data[i])) {
+            // Anything after the terminator belongs to whoever is watching the terminal.
+            matched = true;
+            finish(rxMillis);
+            return;
+        }
+    }
+}
+
+void UartExec::checkTimeout(uint64_t now) {
+    if (state == UART_EXEC_RUNNING && now - startedAtMillis >= timeoutMillis) {
+        finish(now);
+    }
+}
+
+void UartExec::finish(uint64_t now) {
+    finishedAtMillis = now;
+    // Without a terminator, running until the timeout is what was asked for.
+    bool timedOut = matcher.count() > 0 && !matched;
+    matcher.clear();
+    state = UART_EXEC_DONE;
+
+    headLen = snprintf(
+            head, sizeof(head),
+            R"({"matched":%s,"timedOut":%s,"truncated":%s,"firstByteMs":%lld,"elapsedMs":%llu,"bytes":%u,"output":")",
+            matched ? "true" : "false", timedOut ? "true" : "false", truncated ? "true" : "false",
+            firstByteAtMillis ? (long long) (firstByteAtMillis - startedAtMillis) : -1LL,
+            finishedAtMillis - startedAtMillis, (unsigned) outputLen);
+    debugf("Exec %u done, matched %d, %d B in %llu ms\r\n", generation, matched, outputLen,
+           finishedAtMillis - startedAtMillis);
+}
+
+size_t UartExec::render(uint32_t gen, uint8_t *dest, size_t maxLen) {
+    if (gen != generation || state == UART_EXEC_IDLE) {
+        return 0;
+    }
+    if (state == UART_EXEC_RUNNING) {
+        return RESPONSE_TRY_AGAIN;
+    }
+
+    static const char trailer[] = "\"}\n";
+    char *out = (char *) dest;
+    size_t len = 0;
+
+    while (renderHeadPos < headLen && len < maxLen) {
+        out[len++] = head[renderHeadPos++];
+    }
+    if (renderHeadPos == headLen) {
+        // Never split an escape sequence across chunks.
+        while (renderOutputPos < outputLen && maxLen - len >= JSON_ESCAPED_CHAR_MAX) {
+            size_t consumed;
+            len += jsonEscapeNext((const uint8_t *) output + renderOutputPos, outputLen - renderOutputPos, &consumed,
+                                  out + len);
+            renderOutputPos += consumed;
+        }
+    }
+    if (renderHeadPos == headLen && renderOutputPos == outputLen) {
+        while (renderTrailerPos < sizeof(trailer) - 1 && len < maxLen) {
+            out[len++] = trailer[renderTrailerPos++];
+        }
+    }
+
+    if (len == 0) {
+        // Everything has been sent.
+        release(gen);
+    }
+    return len;
+}
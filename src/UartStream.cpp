@@ -0,0 +1,125 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include <cstdio>
+#include "debug.h"
+#include "JsonEscape.h"
+#include "UartStream.h"
+
+int UartStreamer::open(uint8_t mode) {
+    if (clientsLen >= UART_STREAM_MAX_CLIENTS) {
+        debugf("Stream too many clients (%d)\r\n", clientsLen);
+        return -1;
+    }
+    // Don't push ourselves into the heap flow control zone just to serve a log tail.
+    if (ESP.getFreeHeap() < UART_STREAM_BUF_SIZE + HEAP_FREE_HIGH_WATERMARK) {
+        debugf("Stream refused, free heap %d\r\n", ESP.getFreeHeap());
+        return -1;
+    }
+
+    for (int i = 0; i < UART_STREAM_MAX_CLIENTS; i++) {
+        UartStreamClient &client = clients[i];
+        if (client.inUse) {
+            continue;
+        }
+        client.ring = new cbuf(UART_STREAM_BUF_SIZE);
+        client.inUse = true;
+        client.mode = mode;
+        client.lineLen = 0;
+        client.lineStartedAtMillis = 0;
+        client.droppedBytes = 0;
+        clientsLen++;
+        debugf("Stream client %d opened, mode %d\r\n", i, mode);
+        return i;
+    }
+    return -1;
+}
+
+void UartStreamer::close(int slot) {
+    if (slot < 0 || slot >= UART_STREAM_MAX_CLIENTS || !clients[slot].inUse) {
+        return;
+    }
+    debugf("Stream client %d closed, dropped %llu B\r\n", slot, clients[slot].droppedBytes);
+    delete clients[slot].ring;
+    clients[slot].ring = nullptr;
+    clients[slot].inUse = false;
+    clientsLen--;
+}
+
+bool UartStreamer::canAccept() const {
+    for (const UartStreamClient &client : clients) {
+        if (client.inUse && client.ring->room() < UART_STREAM_BUF_SIZE / 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UartStreamer::feed(const uint8_t *data, size_t len, uint64_t rxMillis) {
+    for (UartStreamClient &client : clients) {
+        if (!client.inUse) {
+            continue;
+        }
+        if (client.mode == UART_STREAM_MODE_NDJSON) {
+            feedNdjson(client, data, len, rxMillis);
+            continue;
+        }
+        size_t written = client.ring->write((const char *) data, len);
+        client.droppedBytes += len - written;
+    }
+}
+
+void UartStreamer::feedNdjson(UartStreamClient &client, const uint8_t *data, size_t len, uint64_t rxMillis) {
+    for (size_t i = 0; i < len; i++) {
+        char c = (char) data[i];
+        if (client.lineLen == 0 && client.lineStartedAtMillis == 0) {
+            client.lineStartedAtMillis = rxMillis;
+        }
+        if (c == '\n') {
+            emitNdjsonLine(client);
+            continue;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        client.line[client.lineLen++] = c;
+        if (client.lineLen >= UART_STREAM_LINE_MAX) {
+            emitNdjsonLine(client);
+        }
+    }
+}
+
+void UartStreamer::emitNdjsonLine(UartStreamClient &client) {
+    char head[48];
+    char escaped[JSON_ESCAPED_CHAR_MAX];
+    size_t headLen = snprintf(head, sizeof(head), R"({"t":%llu,"line":")", client.lineStartedAtMillis);
+
+    const auto *line = (const uint8_t *) client.line;
+    size_t consumed;
+    size_t len = headLen + 3;
+    for (size_t i = 0; i < client.lineLen; i += consumed) {
+        len += jsonEscapeNext(line + i, client.lineLen - i, &consumed, escaped);
+    }
+
+    // Never write partial records, they would corrupt the stream for the consumer.
+    if (client.ring->room() < len) {
+        client.droppedBytes += len;
+    } else {
+        client.ring->write(head, headLen);
+        for (size_t i = 0; i < client.lineLen; i += consumed) {
+            client.ring->write(escaped, jsonEscapeNext(line + i, client.lineLen - i, &consumed, escaped));
+        }
+        client.ring->write("\"}\n", 3);
+    }
+
+    client.lineLen = 0;
+    client.lineStartedAtMillis = 0;
+}
+
+size_t UartStreamer::drain(int slot, uint8_t *dest, size_t maxLen) {
+    if (slot < 0 || slot >= UART_STREAM_MAX_CLIENTS || !clients[slot].inUse) {
+        return 0;
+    }
+    return clients[slot].ring->read((char *) dest, maxLen);
+}
@@ -0,0 +1,77 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#ifdef FAKEESP
+    #include <malloc.h>
+#endif
+#include "compat.h"
+#include "debug.h"
+#include "WiSePort.h"
+
+WiSePort *ports[WISE_MAX_PORTS] = {nullptr};
+uint8_t portCount = 0;
+
+// Only the difference between two calls means something.
+static int64_t heapAllocated() {
+#ifdef FAKEESP
+    // getFreeHeap() is made up on the host, unless the heap is emulated
+    if (!fakeHeapIsEnabled()) {
+        return (int64_t) mallinfo2().uordblks;
+    }
+#endif
+    return -(int64_t) ESP.getFreeHeap();
+}
+
+WiSePort::WiSePort(uint8_t index, ExtendedSerial &uart, char *token, AsyncWebServer *httpd) : index{index}, uart{uart} {
+    int64_t heapBefore = heapAllocated();
+    if (index == 0) {
+        strcpy(path, "/ws");
+    } else {
+        snprintf(path, sizeof(path), "/ws/%u", index);
+    }
+    websocket = new AsyncWebSocket(path);
+    ttyd = new TTY(token, websocket, uart);
+    server = new WiSeServer(token, httpd, websocket, ttyd);
+    memoryUsage += heapAllocated() - heapBefore;
+}
+
+void WiSePort::beginUart(uint32_t baudrate, uint8_t config) {
+    int64_t heapBefore = heapAllocated();
+    ttyd->stty(baudrate, config);
+    ttyd->begin();
+    memoryUsage += heapAllocated() - heapBefore;
+}
+
+void WiSePort::begin() {
+    int64_t heapBefore = heapAllocated();
+    if (index == 0) {
+        server->begin();
+    } else {
+        server->beginWebSocket();
+    }
+#if WISE_MAX_PORTS > 1
+    // Port 0 too, so that clients can treat all ports the same.
+    char prefix[WISE_PORT_PATH_LEN];
+    snprintf(prefix, sizeof(prefix), "/ports/%u", index);
+    server->beginPortRoutes(prefix);
+#endif
+    memoryUsage += heapAllocated() - heapBefore;
+    debugf("Port %u is up at %s\r\n", index, path);
+}
+
+void WiSePort::end() const {
+    server->end();
+}
+
+void WiSePort::dispatchUart() {
+    uint64_t startedAtMicros = micros64();
+    ttyd->dispatchUart();
+    busyMicros += micros64() - startedAtMicros;
+}
+
+void WiSePort::performHousekeeping() {
+    uint64_t startedAtMicros = micros64();
+    ttyd->performHousekeeping();
+    busyMicros += micros64() - startedAtMicros;
+}
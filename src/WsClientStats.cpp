@@ -0,0 +1,117 @@
+//
+// Created by depau on 10/19/26.
+//
+
+#include "WsClientStats.h"
+
+void WsClientStats::begin(uint32_t id, uint16_t previousConnections) {
+    *this = {};
+    clientId = id;
+    connectedAtMillis = millis();
+    reconnects = previousConnections;
+    testStartedAtMillis = connectedAtMillis;
+}
+
+void WsClientStats::markTestStart() {
+    testStartedAtMillis = millis();
+    testStartBytes = getDeliveredBytes();
+    testStartBytesDropped = bytesDropped;
+}
+
+void WsClientStats::testRateToJson(JsonObject obj, uint64_t untilMillis) const {
+    uint64_t bytes = getDeliveredBytes() - testStartBytes;
+    uint64_t elapsed = untilMillis > testStartedAtMillis ? untilMillis - testStartedAtMillis : 0;
+    obj["id"] = clientId;
+    obj["bytes"] = bytes;
+    obj["bytesPerSec"] = elapsed ? bytes * 1000 / elapsed : 0;
+    obj["bytesDropped"] = bytesDropped - testStartBytesDropped;
+}
+
+void WsClientStats::onFrameQueued(size_t len, bool dropped) {
+    if (dropped) {
+        framesDropped++;
+        bytesDropped += len;
+        return;
+    }
+    framesQueued++;
+    bytesQueued += len;
+
+    if (fifoLen == WS_CLIENT_STATS_FIFO_LEN) {
+        syncQueue(fifoLen - 1);
+    }
+    WsQueuedFrame &frame = fifo[(fifoHead + fifoLen) % WS_CLIENT_STATS_FIFO_LEN];
+    frame.size = len;
+    frame.queuedAtMillis = millis();
+    fifoLen++;
+
+    queueDepth++;
+    if (queueDepth > peakQueueDepth) {
+        peakQueueDepth = queueDepth;
+    }
+}
+
+void WsClientStats::syncQueue(size_t queueLen) {
+    while (fifoLen > queueLen) {
+        framesSent++;
+        bytesSent += fifo[fifoHead].size;
+        fifoHead = (fifoHead + 1) % WS_CLIENT_STATS_FIFO_LEN;
+        fifoLen--;
+    }
+    queueDepth = queueLen;
+    if (queueDepth > peakQueueDepth) {
+        peakQueueDepth = queueDepth;
+    }
+}
+
+void WsClientStats::setBlocking(bool blocking) {
+    if (blocking && blockingSinceMillis == 0) {
+        blockingSinceMillis = millis();
+    } else if (!blocking && blockingSinceMillis != 0) {
+        blockingMillis += millis() - blockingSinceMillis;
+        blockingSinceMillis = 0;
+    }
+}
+
+uint32_t WsClientStats::getLagMillis() const {
+    if (fifoLen == 0) {
+        return 0;
+    }
+    return millis() - fifo[fifoHead].queuedAtMillis;
+}
+
+void WsClientStats::toJson(JsonObject obj, uint64_t lastSeenMillis) const {
+    uint64_t now = millis();
+    obj["id"] = clientId;
+    obj["connectedMs"] = now - connectedAtMillis;
+    obj["lastSeenAgoMs"] = now - lastSeenMillis;
+    obj["reconnects"] = reconnects;
+
+    obj["framesQueued"] = framesQueued;
+    obj["bytesQueued"] = bytesQueued;
+    obj["framesDropped"] = framesDropped;
+    obj["bytesDropped"] = bytesDropped;
+#ifndef LEGACY_LIB
+    // The legacy library doesn't expose the queue length.
+    obj["framesSent"] = framesSent;
+    obj["bytesSent"] = bytesSent;
+    obj["queueDepth"] = queueDepth;
+    obj["peakQueueDepth"] = peakQueueDepth;
+    obj["lagMs"] = getLagMillis();
+#endif
+    obj["blockingMs"] = blockingMillis + (blockingSinceMillis ? now - blockingSinceMillis : 0);
+
+    obj["inputFrames"] = inputFrames;
+    obj["inputBytes"] = inputBytes;
+}
+
+uint16_t WsRecentClients::onConnect(uint32_t ip) {
+    for (int i = 0; i < WS_CLIENT_RECENT_IPS; i++) {
+        if (ips[i] == ip && connections[i] > 0) {
+            return connections[i]++;
+        }
+    }
+    ips[next] = ip;
+    connections[next] = 1;
+    next = (next + 1) % WS_CLIENT_RECENT_IPS;
+    return 0;
+}
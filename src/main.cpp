@@ -10,6 +10,12 @@
 #include "server.h"
 #include "debug.h"
 #include "ExtendedSerial.h"
+#include "LoopProfiler.h"
+#include "HeapProfiler.h"
+#include "WiSePort.h"
+#ifdef FAKEESP
+    #include "Reactor.h"
+#endif
 
 #ifdef ESP8266
     ADC_MODE(ADC_VCC);
@@ -39,6 +45,10 @@ void blinkError() {
 }
 
 void setup() {
+#if HEAP_PROFILER_SLOTS > 0
+    heapProfiler.begin();
+#endif
+
     // Generate token.
     if (HTTP_AUTH_ENABLE) {
         const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!/?_=;':";
@@ -48,13 +58,23 @@ void setup() {
     }
 
     httpd = new AsyncWebServer(HTTP_LISTEN_PORT);
-    websocket = new AsyncWebSocket("/ws");
-    ttyd = new TTY(token, websocket);
-    server = new WiSeServer(token, httpd, websocket, ttyd);
+    ports[portCount++] = new WiSePort(0, UART_COMM, token, httpd);
+#ifdef FAKEESP
+    // One more port for each of FAKEESP_UART2, FAKEESP_UART3... that is set
+    for (int uartNr = 2; portCount < WISE_MAX_PORTS && FakeSerial::hasDevice(uartNr); uartNr++) {
+        ports[portCount] = new WiSePort(portCount, *new ExtendedSerial(uartNr), token, httpd);
+        portCount++;
+    }
+#endif
+    // The first port is the one the rest of the firmware refers to
+    websocket = ports[0]->getWebSocket();
+    ttyd = ports[0]->getTTY();
+    server = ports[0]->getServer();
 
     // Init UART.
-    ttyd->stty(UART_COMM_BAUD, UART_COMM_CONFIG);
-    ttyd->begin();
+    for (uint8_t i = 0; i < portCount; i++) {
+        ports[i]->beginUart(UART_COMM_BAUD, UART_COMM_CONFIG);
+    }
 
 #if ENABLE_DEBUG == 1
     if (UART_COMM != UART_DEBUG) {
@@ -126,7 +146,9 @@ void setup() {
     // TODO: actually do it
     // ArduinoOTA.setHostname(WIFI_HOSTNAME);
 
-    server->begin();
+    for (uint8_t i = 0; i < portCount; i++) {
+        ports[i]->begin();
+    }
     httpd->begin();
     debugf("HTTP server is up\r\n");
 
@@ -148,7 +170,9 @@ void setup() {
 
             delay(50);
 
-            server->end();
+            for (uint8_t i = 0; i < portCount; i++) {
+                ports[i]->end();
+            }
             httpd->end();
 
             // LED animation.
@@ -244,6 +268,14 @@ void setup() {
 }
 
 void loop() {
+    uint64_t loopStartedAtMicros = micros64();
+    if (loopMetrics.lastLoopStartedAtMicros != 0) {
+        loopMetrics.loopIteration.record(loopStartedAtMicros - loopMetrics.lastLoopStartedAtMicros);
+    }
+    loopMetrics.lastLoopStartedAtMicros = loopStartedAtMicros;
+
+    loopProfiler.startIteration();
+    loopProfiler.enterPhase(LOOP_PHASE_OTA);
     ArduinoOTA.handle();
     if (otaRunning) {
         return yield();
@@ -254,10 +286,27 @@ void loop() {
         ESP.restart();
     }
 
-    ttyd->dispatchUart();
+    loopProfiler.enterPhase(LOOP_PHASE_DISPATCH_UART);
+    for (uint8_t i = 0; i < portCount; i++) {
+        ports[i]->dispatchUart();
+    }
+    loopProfiler.enterPhase(LOOP_PHASE_YIELD_1);
     yield();
-    ttyd->performHousekeeping();
+    loopProfiler.enterPhase(LOOP_PHASE_HOUSEKEEPING);
+    for (uint8_t i = 0; i < portCount; i++) {
+        ports[i]->performHousekeeping();
+    }
+    loopProfiler.enterPhase(LOOP_PHASE_YIELD_2);
+#ifdef FAKEESP
+    // Sleep in epoll_wait() until a socket or a serial port are ready, or there's housekeeping to do
+    uint64_t nextHousekeepingMillis = UINT64_MAX;
+    for (uint8_t i = 0; i < portCount; i++) {
+        nextHousekeepingMillis = std::min(nextHousekeepingMillis, ports[i]->getNextHousekeepingMillis());
+    }
+    reactorSetYieldDeadline(nextHousekeepingMillis * 1000);
+#endif
     yield();
+    loopProfiler.endLoop();
 
     // I don't know the real reason but this is a workaround when visitor visit /reset endpoit via browser.
     // In firefox when I do it, esp restart itself and the browser try imidietly reconnect to websocet.
@@ -269,7 +318,9 @@ void loop() {
     // but I decided to keep below code for clean restarts.
     if (server->shouldReboot > 0 &&  millis() > server->shouldReboot) {
         httpd->reset();
-        server->end();
+        for (uint8_t i = 0; i < portCount; i++) {
+            ports[i]->end();
+        }
         httpd->end();
         ESP.restart();
     }
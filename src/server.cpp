@@ -4,6 +4,7 @@
 
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <memory>
 #ifdef ESP8266
     #include <ESPAsyncTCP.h>
 #else
@@ -14,6 +15,13 @@
 #include "html.h"
 #include "server.h"
 #include "debug.h"
+#include "ExtendedSerial.h"
+#include "Dlog.h"
+#include "HeapProfiler.h"
+#include "WiSePort.h"
+#ifdef FAKEESP
+    #include <sys/resource.h>
+#endif
 
 String toString(const IPAddress &address) {
     return String() + address[0] + "." + address[1] + "." + address[2] + "." + address[3];
@@ -24,7 +32,7 @@ void WiSeServer::begin() {
     DefaultHeaders::Instance().addHeader("X-Ttyd-Implementation", "Wi-Se/C++");
 #ifdef HTTP_CORS_ALLOW_ORIGIN
     DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", HTTP_CORS_ALLOW_ORIGIN);
-    DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+    DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS");
     DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type");
 #endif
 
@@ -33,19 +41,20 @@ void WiSeServer::begin() {
     httpd->on("/index.html", HTTP_GET, handleIndex);
     httpd->on("/token", HTTP_GET,
               std::bind(&WiSeServer::handleToken, this, std::placeholders::_1));
-    httpd->on("/stty", HTTP_GET | HTTP_POST,
-              std::bind(&WiSeServer::handleSttyRequest, this, std::placeholders::_1),
-              nullptr,
-              std::bind(&WiSeServer::handleSttyBody, this, std::placeholders::_1, std::placeholders::_2,
-                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
-#if TARGET_GPIO_COUNT > 0
-    httpd->on("/gpio", HTTP_GET | HTTP_POST,
-              std::bind(&WiSeServer::handleGpioRequest, this, std::placeholders::_1),
-              nullptr,
-              std::bind(&WiSeServer::handleGpioBody, this, std::placeholders::_1, std::placeholders::_2,
-                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+    // Only exactly /ports, the ports' own routes are below it.
+    httpd->on("/ports", HTTP_GET, std::bind(&WiSeServer::handlePortsRequest, this, std::placeholders::_1))
+            .setFilter([](AsyncWebServerRequest *request) { return request->url() == "/ports"; });
+    httpd->on("/trace", HTTP_GET, std::bind(&WiSeServer::handleTraceRequest, this, std::placeholders::_1));
+#if DLOG_RECORDS > 0
+    httpd->on("/dlog", HTTP_GET, std::bind(&WiSeServer::handleDlogRequest, this, std::placeholders::_1));
+#endif
+    httpd->on("/profile", HTTP_GET | HTTP_DELETE,
+              std::bind(&WiSeServer::handleProfileRequest, this, std::placeholders::_1));
+#if HEAP_PROFILER_SLOTS > 0
+    // Must come before /heap, which would match it as well.
+    httpd->on("/heap/profile", HTTP_GET | HTTP_DELETE,
+              std::bind(&WiSeServer::handleHeapProfileRequest, this, std::placeholders::_1));
 #endif
-    httpd->on("/stats", HTTP_GET, std::bind(&WiSeServer::handleStatsRequest, this, std::placeholders::_1));
     httpd->on("/heap", HTTP_GET, [](AsyncWebServerRequest *request) {
         if (!checkHttpBasicAuth(request)) return;
         request->send(200, "text/plain", String(ESP.getFreeHeap()));
@@ -63,7 +72,7 @@ void WiSeServer::begin() {
         if (!checkHttpBasicAuth(request)) return;
         AsyncResponseStream *response = request->beginResponseStream("application/json");
 
-        DynamicJsonDocument doc(2000);
+        TaggedJsonDocument doc(2000);
         doc["board"] = BOARD_NAME;
         doc["pretty_name"] = DEVICE_PRETTY_NAME;
         doc["hostname"] = WIFI_HOSTNAME;
@@ -107,12 +116,73 @@ void WiSeServer::begin() {
         }
     });
 
+    // Port 0's routes are also at the top level, where they've always been.
+    beginPortRoutes("");
+    beginWebSocket();
+    debugf("Web app server is up\r\n");
+}
+
+void WiSeServer::beginPortRoutes(const String &prefix) {
+    // The handlers keep their own copy of the URI.
+    auto uri = [&prefix](const char *route) { return prefix + route; };
+
+    httpd->on(uri("/stty").c_str(), HTTP_GET | HTTP_POST,
+              std::bind(&WiSeServer::handleSttyRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleSttyBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+#if TARGET_GPIO_COUNT > 0
+    httpd->on(uri("/gpio").c_str(), HTTP_GET | HTTP_POST,
+              std::bind(&WiSeServer::handleGpioRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleGpioBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+#endif
+    // Must come before /stats, which would match it as well.
+    httpd->on(uri("/stats/clients").c_str(), HTTP_GET,
+              std::bind(&WiSeServer::handleClientStatsRequest, this, std::placeholders::_1));
+    httpd->on(uri("/stats").c_str(), HTTP_GET | HTTP_DELETE,
+              std::bind(&WiSeServer::handleStatsRequest, this, std::placeholders::_1));
+    httpd->on(uri("/metrics").c_str(), HTTP_GET,
+              std::bind(&WiSeServer::handleMetricsRequest, this, std::placeholders::_1));
+    httpd->on(uri("/uart/stream").c_str(), HTTP_GET,
+              std::bind(&WiSeServer::handleUartStreamRequest, this, std::placeholders::_1));
+    httpd->on(uri("/exec").c_str(), HTTP_POST,
+              std::bind(&WiSeServer::handleExecRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleExecBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+    // Must come before /capture, which would match it as well.
+    httpd->on(uri("/capture/triggers").c_str(), HTTP_GET | HTTP_POST | HTTP_DELETE,
+              std::bind(&WiSeServer::handleCaptureTriggersRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleCaptureTriggersBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+    httpd->on(uri("/capture").c_str(), HTTP_GET | HTTP_DELETE,
+              std::bind(&WiSeServer::handleCaptureRequest, this, std::placeholders::_1));
+    // Must come before /scrollback, which would match it as well.
+    httpd->on(uri("/scrollback/stats").c_str(), HTTP_GET,
+              std::bind(&WiSeServer::handleScrollbackStatsRequest, this, std::placeholders::_1));
+    httpd->on(uri("/scrollback").c_str(), HTTP_GET,
+              std::bind(&WiSeServer::handleScrollbackRequest, this, std::placeholders::_1));
+    httpd->on(uri("/autoresponder").c_str(), HTTP_GET | HTTP_POST | HTTP_DELETE,
+              std::bind(&WiSeServer::handleAutoResponderRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleAutoResponderBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+    httpd->on(uri("/testgen").c_str(), HTTP_GET | HTTP_POST | HTTP_DELETE,
+              std::bind(&WiSeServer::handleTestGenRequest, this, std::placeholders::_1),
+              nullptr,
+              std::bind(&WiSeServer::handleTestGenBody, this, std::placeholders::_1, std::placeholders::_2,
+                        std::placeholders::_3, std::placeholders::_4, std::placeholders::_5));
+}
+
+void WiSeServer::beginWebSocket() {
     // Handle WebSocket connections.
     websocket->onEvent(std::bind(&WiSeServer::onWebSocketEvent, this, std::placeholders::_1, std::placeholders::_2,
                                  std::placeholders::_3, std::placeholders::_4, std::placeholders::_5,
                                  std::placeholders::_6));
     httpd->addHandler(websocket);
-    debugf("Web app server is up\r\n");
 }
 
 void WiSeServer::end() const {
@@ -153,7 +223,7 @@ void WiSeServer::handleToken(AsyncWebServerRequest *request) const {
 void WiSeServer::sttySendResponse(AsyncWebServerRequest *request) const {
     AsyncResponseStream *response = request->beginResponseStream("application/json");
 
-    DynamicJsonDocument doc(200);
+    TaggedJsonDocument doc(200);
 
     doc["baudrate"] = ttyd->getUartBaudRate();
 
@@ -210,17 +280,269 @@ void invalidJsonBadRequest(AsyncWebServerRequest *request, const char *message)
     request->send(response);
 }
 
+static void latencyToJson(JsonObject obj, const LatencyHistogram &histogram) {
+    obj["count"] = histogram.getCount();
+    obj["p50Us"] = histogram.percentile(50);
+    obj["p99Us"] = histogram.percentile(99);
+    obj["maxUs"] = histogram.getMax();
+}
+
 void WiSeServer::handleStatsRequest(AsyncWebServerRequest *request) const {
+    if (request->method() == HTTP_DELETE) {
+        if (!checkHttpBasicAuth(request)) return;
+        ttyd->getUart().resetErrorCounters();
+        return request->send(200);
+    }
+
     AsyncResponseStream *response = request->beginResponseStream("application/json");
-    DynamicJsonDocument doc(200);
+    TaggedJsonDocument doc(1024);
     doc["tx"] = ttyd->getTotalTx();
     doc["rx"] = ttyd->getTotalRx();
     doc["txRateBps"] = ttyd->getTxRate();
     doc["rxRateBps"] = ttyd->getRxRate();
+
+    JsonObject latency = doc.createNestedObject("latency");
+    latencyToJson(latency.createNestedObject("uartToRead"), ttyd->getLatencyUartToRead());
+    latencyToJson(latency.createNestedObject("uartToWs"), ttyd->getLatencyUartToWs());
+    latencyToJson(latency.createNestedObject("echoUart"), ttyd->getLatencyEchoUart());
+    latencyToJson(latency.createNestedObject("echoWs"), ttyd->getLatencyEchoWs());
+
+    UartErrorCounters errors = ttyd->getUart().getErrorCounters();
+    JsonObject uart = doc.createNestedObject("uart");
+    uart["overruns"] = errors.overruns;
+    uart["bufferFull"] = errors.bufferFull;
+    uart["framingErrors"] = errors.framingErrors;
+    uart["parityErrors"] = errors.parityErrors;
+    uart["breaks"] = errors.breaks;
+    uart["rxPeakBytes"] = ttyd->getUart().getRxHighWatermark();
+    uart["rxBufSize"] = UART_RX_BUF_SIZE;
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleClientStatsRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(64 + WS_MAX_CLIENTS * 384);
+    ttyd->clientStatsToJson(doc.to<JsonArray>());
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handlePortsRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    // A dozen members per port, at 32 bytes each on the 64-bit fakeesp
+    TaggedJsonDocument doc(256 + portCount * 512);
+
+    uint64_t totalBytes = 0;
+    JsonArray portsArray = doc.createNestedArray("ports");
+    for (uint8_t i = 0; i < portCount; i++) {
+        const WiSePort *port = ports[i];
+        const TTY *portTtyd = port->getTTY();
+        uint64_t bytes = portTtyd->getTotalRx() + portTtyd->getTotalTx();
+        totalBytes += bytes;
+
+        JsonObject obj = portsArray.createNestedObject();
+        obj["index"] = port->getIndex();
+        obj["path"] = port->getPath();
+#if WISE_MAX_PORTS > 1
+        obj["routes"] = String("/ports/") + port->getIndex();
+#endif
+        obj["clients"] = portTtyd->getClientCount();
+        obj["baudrate"] = portTtyd->getUartBaudRate();
+        obj["rx"] = portTtyd->getTotalRx();
+        obj["tx"] = portTtyd->getTotalTx();
+        obj["rxRateBps"] = portTtyd->getRxRate();
+        obj["txRateBps"] = portTtyd->getTxRate();
+        obj["memoryBytes"] = port->getMemoryUsage();
+        obj["busyMs"] = port->getBusyMicros() / 1000;
+        // CPU time per MB moved, which doesn't depend on the rate
+        obj["busyMsPerMB"] = bytes > 0 ? (double) port->getBusyMicros() * 1000 / (double) bytes : 0;
+    }
+
+#ifdef FAKEESP
+    // The whole process, including the network callbacks that aren't accounted to any port
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t cpuMicros = (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+                         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+    JsonObject process = doc.createNestedObject("process");
+    process["cpuMs"] = cpuMicros / 1000;
+    process["cpuMsPerMB"] = totalBytes > 0 ? (double) cpuMicros * 1000 / (double) totalBytes : 0;
+    process["maxRssKB"] = usage.ru_maxrss;
+#endif
+
     serializeJson(doc, *response);
     request->send(response);
 }
 
+void WiSeServer::handleMetricsRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    // Rendered piece by piece as the TCP window allows, so scraping doesn't need any memory for the whole thing.
+    MetricsRenderer renderer(ttyd);
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+            "text/plain; version=0.0.4", [renderer](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+                return renderer.render(buffer, maxLen);
+            });
+    request->send(response);
+}
+
+void WiSeServer::handleTraceRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    TraceDumper dumper;
+    AsyncWebServerResponse *response = request->beginResponse(
+            "application/octet-stream", dumper.length(),
+            [dumper](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return dumper.render(buffer, maxLen, index);
+            });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+#if HEAP_PROFILER_SLOTS > 0
+void WiSeServer::handleHeapProfileRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+
+    if (request->method() == HTTP_DELETE) {
+        heapProfiler.reset();
+        return request->send(200);
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(384 + HEAP_CAT_COUNT * 192 + HEAP_PROFILER_HISTORY * 2 * 16);
+    doc["freeHeap"] = ESP.getFreeHeap();
+    doc["maxFreeBlock"] = getMaxFreeBlockSize();
+    if (heapProfiler.getMinMaxFreeBlock() != UINT32_MAX) {
+        doc["minMaxFreeBlock"] = heapProfiler.getMinMaxFreeBlock();
+    }
+    doc["trackedAllocations"] = heapProfiler.getTracked();
+    doc["untrackedAllocations"] = heapProfiler.untracked;
+
+    JsonObject categories = doc.createNestedObject("categories");
+    for (uint8_t i = 0; i < HEAP_CAT_COUNT; i++) {
+        const HeapCategoryStats &stats = heapProfiler.getCategory(i);
+        JsonObject category = categories.createNestedObject(HeapProfiler::getCategoryName(i));
+        category["liveBytes"] = stats.liveBytes;
+        category["liveCount"] = stats.liveCount;
+        category["peakBytes"] = stats.peakBytes;
+        category["allocs"] = stats.allocs;
+        category["allocBytes"] = stats.allocBytes;
+        category["allocsPerSec"] = stats.allocsPerSec;
+        category["bytesPerSec"] = stats.bytesPerSec;
+    }
+
+    // Oldest first, one sample per second.
+    JsonObject history = doc.createNestedObject("history");
+    JsonArray freeHeap = history.createNestedArray("freeHeap");
+    JsonArray maxFreeBlock = history.createNestedArray("maxFreeBlock");
+    for (uint8_t i = 0; i < heapProfiler.getHistoryLen(); i++) {
+        freeHeap.add(heapProfiler.getHistory(i).freeHeap);
+        maxFreeBlock.add(heapProfiler.getHistory(i).maxFreeBlock);
+    }
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+#endif
+
+void WiSeServer::handleDlogRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    uint32_t since = 0;
+    if (request->hasParam("since")) {
+        since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    }
+    DlogDumper dumper(since);
+    AsyncWebServerResponse *response = request->beginResponse(
+            "application/octet-stream", dumper.length(),
+            [dumper](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return dumper.render(buffer, maxLen, index);
+            });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+void WiSeServer::handleProfileRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+
+    if (request->method() == HTTP_DELETE) {
+        loopProfiler.reset();
+        return request->send(200);
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(256 + LOOP_PHASE_COUNT * 160 + LOOP_PROFILER_RECENT_STALLS * 96);
+    doc["stallThresholdUs"] = LOOP_STALL_THRESHOLD_MICROS;
+    doc["iterations"] = loopProfiler.getIterations();
+    doc["stalls"] = loopProfiler.getStalls();
+
+    JsonObject phases = doc.createNestedObject("phases");
+    for (uint8_t i = 0; i < LOOP_PHASE_COUNT; i++) {
+        const LoopPhaseStats &stats = loopProfiler.getPhase(i);
+        JsonObject phase = phases.createNestedObject(LoopProfiler::getPhaseName(i));
+        phase["count"] = stats.count;
+        phase["minUs"] = stats.minMicros;
+        phase["avgUs"] = stats.count > 0 ? (uint32_t) (stats.totalMicros / stats.count) : 0;
+        phase["maxUs"] = stats.maxMicros;
+        phase["p50Us"] = stats.histogram.percentile(50);
+        phase["p99Us"] = stats.histogram.percentile(99);
+        phase["stalls"] = stats.stalls;
+    }
+
+    JsonArray recentStalls = doc.createNestedArray("recentStalls");
+    for (uint8_t i = 0; i < LOOP_PROFILER_RECENT_STALLS; i++) {
+        const LoopStall *stall = loopProfiler.getRecentStall(i);
+        if (!stall) {
+            break;
+        }
+        JsonObject obj = recentStalls.createNestedObject();
+        obj["atMs"] = stall->atMillis;
+        obj["iterationUs"] = stall->iterationMicros;
+        obj["phase"] = LoopProfiler::getPhaseName(stall->phase);
+        obj["phaseUs"] = stall->phaseMicros;
+    }
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleUartStreamRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    debugf("GET /uart/stream\r\n");
+
+    uint8_t mode = UART_STREAM_MODE_RAW;
+    if (request->hasParam("mode")) {
+        const String &modeName = request->getParam("mode")->value();
+        if (modeName == "ndjson") {
+            mode = UART_STREAM_MODE_NDJSON;
+        } else if (modeName != "raw") {
+            request->send(400, "text/plain", "\"mode\" must be one of raw, ndjson");
+            return;
+        }
+    }
+
+    UartStreamer *streamer = ttyd->getUartStreamer();
+    int slot = streamer->open(mode);
+    if (slot < 0) {
+        request->send(503, "text/plain", "Too many stream clients or not enough memory");
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+            mode == UART_STREAM_MODE_NDJSON ? "application/x-ndjson" : "application/octet-stream",
+            [streamer, slot](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t len = streamer->drain(slot, buffer, maxLen);
+                // Returning 0 would terminate the response, ask the server to poll us again instead.
+                return len > 0 ? len : RESPONSE_TRY_AGAIN;
+            });
+    response->addHeader("Cache-Control", "no-cache");
+    request->onDisconnect([streamer, slot]() {
+        streamer->close(slot);
+    });
+    request->send(response);
+}
+
 void WiSeServer::handleSttyRequest(AsyncWebServerRequest *request) const {
     if (!checkHttpBasicAuth(request)) return;
 
@@ -236,7 +558,7 @@ void WiSeServer::handleSttyBody(
 
     if (request->method() == HTTP_POST) {
         debugf("POST /stty\r\n");
-        DynamicJsonDocument doc(200);
+        TaggedJsonDocument doc(200);
         deserializeJson(doc, data, len);
 
         uint32_t baudrate = ttyd->getUartBaudRate();
@@ -336,7 +658,7 @@ void WiSeServer::handleGpioRequest(AsyncWebServerRequest *request) const {
     }
 
     AsyncResponseStream *response = request->beginResponseStream("application/json");
-    DynamicJsonDocument doc(200);
+    TaggedJsonDocument doc(200);
     const GpioConfig* gpioConfigs = ttyd->getGpioConfigs();
 
     for (size_t i = 0; i < TARGET_GPIO_COUNT; ++i) {
@@ -364,7 +686,7 @@ void WiSeServer::handleGpioBody(
         return;
     }
 
-    DynamicJsonDocument doc(200);
+    TaggedJsonDocument doc(200);
     deserializeJson(doc, data, len);
 
     if (doc.isNull()) {
@@ -382,17 +704,7 @@ void WiSeServer::handleGpioBody(
                     snprintf(buffer, 50, "Value for gpio (%u) must be a positive number!", gpioConfigs[i].gpio);
                     return invalidJsonBadRequest(request, buffer);
                 }
-                debugf("Target gpio %u from index %u unlocked.\r\n", gpioConfigs[i].gpio, i);
-                gpioConfigs[i].lock = TARGET_GPIO_UNLOCKED;
-                gpioConfigs[i].state = doc[(const __FlashStringHelper*)gpioConfigs[i].name];
-                // Discard any other gpio with the same number that may be in pending state.
-                for (size_t x = 0; x < TARGET_GPIO_COUNT; x++) {
-                    if ((x != i) && (gpioConfigs[x].gpio == gpioConfigs[i].gpio)) {
-                        debugf("Target gpio %u from index %u locked by the same gpio from index %u.\r\n", gpioConfigs[x].gpio, x, i);
-                        gpioConfigs[x].lock = TARGET_GPIO_LOCKED;
-                    }
-                }
-
+                ttyd->setGpioState(i, doc[(const __FlashStringHelper*)gpioConfigs[i].name]);
             }
         }
     }
@@ -400,6 +712,456 @@ void WiSeServer::handleGpioBody(
 }
 #endif
 
+void WiSeServer::handleExecRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    // The response is sent by the body handler, but the body may be missing altogether.
+    if (request->contentLength() == 0) {
+        invalidJsonBadRequest(request, "JSON is invalid");
+    }
+}
+
+void WiSeServer::handleExecBody(
+        AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const {
+    if (!checkHttpBasicAuth(request)) return;
+
+    TaggedJsonDocument doc(256);
+    deserializeJson(doc, data, len);
+
+    if (doc.isNull()) {
+        return invalidJsonBadRequest(request, "JSON is invalid");
+    }
+    if (!doc["send"].is<const char *>()) {
+        return invalidJsonBadRequest(request, "\"send\" must be a string");
+    }
+    if (doc.containsKey("until") && !doc["until"].is<const char *>()) {
+        return invalidJsonBadRequest(request, "\"until\" must be a string");
+    }
+    if (doc["until"].is<const char *>() && strlen(doc["until"]) > PATTERN_MATCHER_MAX_TOTAL_LEN) {
+        return invalidJsonBadRequest(request, "\"until\" must be at most 32 bytes");
+    }
+    if (doc.containsKey("timeout") &&
+        (!doc["timeout"].is<unsigned int>() || doc["timeout"].as<unsigned int>() > UART_EXEC_TIMEOUT_MAX_MILLIS)) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "\"timeout\" must be a number of ms up to %d", UART_EXEC_TIMEOUT_MAX_MILLIS);
+        return invalidJsonBadRequest(request, buffer);
+    }
+
+    const char *send = doc["send"];
+    const char *until = doc["until"] | "";
+    uint64_t timeout = doc["timeout"] | UART_EXEC_DEFAULT_TIMEOUT_MILLIS;
+
+    uint32_t gen = ttyd->startExec(send, strlen(send), until, timeout);
+    if (!gen) {
+        request->send(409, "text/plain", "Another command is running or there isn't enough memory");
+        return;
+    }
+
+    UartExec *uartExec = ttyd->getUartExec();
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+            "application/json", [uartExec, gen](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return uartExec->render(gen, buffer, maxLen);
+            });
+    response->addHeader("Cache-Control", "no-cache");
+    request->onDisconnect([uartExec, gen]() {
+        uartExec->release(gen);
+    });
+    request->send(response);
+}
+
+void WiSeServer::handleCaptureTriggersRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    UartCapture *uartCapture = ttyd->getUartCapture();
+
+    if (request->method() == HTTP_DELETE) {
+        if (!request->hasParam("id")) {
+            return request->send(400, "text/plain", "\"id\" is required");
+        }
+        if (uartCapture->removeTrigger(request->getParam("id")->value().toInt())) {
+            request->send(200);
+        } else {
+            request->send(404, "text/plain", "No such trigger");
+        }
+        return;
+    }
+    if (request->method() != HTTP_GET) {
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(128 + UART_CAPTURE_MAX_TRIGGERS * 160);
+    doc["patternBytesLeft"] = uartCapture->patternBytesLeft();
+    JsonArray triggers = doc.createNestedArray("triggers");
+
+    for (int i = 0; i < UART_CAPTURE_MAX_TRIGGERS; i++) {
+        const UartCaptureTrigger *trigger = uartCapture->getTrigger(i);
+        if (!trigger) {
+            continue;
+        }
+        JsonObject obj = triggers.createNestedObject();
+        obj["id"] = i;
+        obj["pattern"] = (const char *) trigger->pattern;
+        obj["pre"] = trigger->preBytes;
+        obj["post"] = trigger->postBytes;
+        obj["hits"] = trigger->hits;
+        obj["missed"] = trigger->missed;
+    }
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleCaptureTriggersBody(
+        AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const {
+    if (!checkHttpBasicAuth(request)) return;
+    if (request->method() != HTTP_POST) {
+        return;
+    }
+
+    TaggedJsonDocument doc(128 + PATTERN_MATCHER_MAX_TOTAL_LEN);
+    deserializeJson(doc, data, len);
+
+    if (doc.isNull()) {
+        return invalidJsonBadRequest(request, "JSON is invalid");
+    }
+    if (!doc["pattern"].is<const char *>() || strlen(doc["pattern"]) == 0) {
+        return invalidJsonBadRequest(request, "\"pattern\" must be a non-empty string");
+    }
+    const char *pattern = doc["pattern"];
+    if ((doc.containsKey("pre") && !doc["pre"].is<unsigned int>()) ||
+        (doc.containsKey("post") && !doc["post"].is<unsigned int>())) {
+        return invalidJsonBadRequest(request, "\"pre\" and \"post\" must be positive numbers");
+    }
+    uint32_t preBytes = doc["pre"] | UART_CAPTURE_HISTORY_SIZE;
+    uint32_t postBytes = doc["post"] | (UART_CAPTURE_SLOT_MAX_SIZE - preBytes);
+    if (preBytes < strlen(pattern) || preBytes > UART_CAPTURE_HISTORY_SIZE ||
+        postBytes > UART_CAPTURE_SLOT_MAX_SIZE || preBytes + postBytes > UART_CAPTURE_SLOT_MAX_SIZE) {
+        char buffer[120];
+        snprintf(buffer, sizeof(buffer),
+                 "\"pre\" must cover the pattern and be up to %d, \"pre\" + \"post\" must be up to %d",
+                 UART_CAPTURE_HISTORY_SIZE, UART_CAPTURE_SLOT_MAX_SIZE);
+        return invalidJsonBadRequest(request, buffer);
+    }
+
+    int id = ttyd->getUartCapture()->addTrigger(pattern, preBytes, postBytes);
+    if (id < 0) {
+        request->send(507, "text/plain", "No room for this trigger, delete some or use shorter patterns");
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf(R"({"id":%d})", id);
+    response->setCode(201);
+    request->send(response);
+}
+
+void WiSeServer::handleCaptureRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    UartCapture *uartCapture = ttyd->getUartCapture();
+
+    if (request->method() == HTTP_DELETE) {
+        if (!request->hasParam("slot")) {
+            for (int i = 0; i < UART_CAPTURE_SLOTS; i++) {
+                uartCapture->freeSlot(i);
+            }
+            request->send(200);
+        } else if (uartCapture->freeSlot(request->getParam("slot")->value().toInt())) {
+            request->send(200);
+        } else {
+            request->send(404, "text/plain", "No such slot");
+        }
+        return;
+    }
+
+    if (request->hasParam("slot")) {
+        int id = request->getParam("slot")->value().toInt();
+        const UartCaptureSlot *slot = uartCapture->getSlot(id);
+        if (!slot) {
+            return request->send(404, "text/plain", "No such slot");
+        }
+        uint32_t generation = slot->generation;
+        size_t len = slot->len;
+        // Send what was captured up to now if the post-trigger window is still being filled.
+        AsyncWebServerResponse *response = request->beginResponse(
+                "application/octet-stream", len,
+                [request, uartCapture, id, generation, len](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                    size_t read = uartCapture->read(id, generation, buffer, index, maxLen);
+                    if (read == 0 && index < len) {
+                        // Freed or reused meanwhile. Drop the connection, or the client would wait for the rest
+                        // until it times out.
+                        request->client()->close();
+                    }
+                    return read;
+                });
+        char disposition[64];
+        snprintf(disposition, sizeof(disposition), "attachment; filename=\"capture-%d-%llu.bin\"", id,
+                 slot->triggeredAtMillis);
+        response->addHeader("Content-Disposition", disposition);
+        request->send(response);
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(64 + UART_CAPTURE_SLOTS * 160);
+    JsonArray slots = doc.createNestedArray("slots");
+    for (int i = 0; i < UART_CAPTURE_SLOTS; i++) {
+        const UartCaptureSlot *slot = uartCapture->getSlot(i);
+        if (!slot) {
+            continue;
+        }
+        JsonObject obj = slots.createNestedObject();
+        obj["slot"] = i;
+        obj["trigger"] = slot->trigger;
+        obj["ready"] = slot->state == UART_CAPTURE_SLOT_READY;
+        obj["triggeredAtMillis"] = slot->triggeredAtMillis;
+        obj["bytes"] = slot->len;
+        obj["pre"] = slot->preLen;
+    }
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleScrollbackRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    Scrollback *scrollback = ttyd->getScrollback();
+    if (!scrollback->active()) {
+        return request->send(404, "text/plain", "Scrollback is disabled");
+    }
+
+    size_t maxBytes = request->hasParam("bytes") ? request->getParam("bytes")->value().toInt() : 0;
+    // Shared with the filler, which is destroyed along with the response.
+    std::shared_ptr<ScrollbackReader> reader(new ScrollbackReader(), [scrollback](ScrollbackReader *r) {
+        scrollback->closeReader(*r);
+        delete r;
+    });
+    if (ESP.getFreeHeap() < SCROLLBACK_BLOCK_SIZE + HEAP_FREE_HIGH_WATERMARK ||
+        !scrollback->openReader(*reader, maxBytes)) {
+        return request->send(503, "text/plain", "Not enough memory");
+    }
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse(
+            "application/octet-stream", [scrollback, reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                return scrollback->read(*reader, buffer, maxLen);
+            });
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+void WiSeServer::handleScrollbackStatsRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    const Scrollback *scrollback = ttyd->getScrollback();
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(300);
+    doc["enabled"] = scrollback->active();
+    doc["size"] = SCROLLBACK_SIZE;
+    doc["blockSize"] = SCROLLBACK_BLOCK_SIZE;
+    doc["blocks"] = scrollback->getBlockCount();
+    doc["retainedBytes"] = scrollback->getRetainedBytes();
+    doc["storedBytes"] = scrollback->getStoredBytes();
+    if (scrollback->getCompressedBytesTotal() > 0) {
+        doc["compressionRatio"] =
+                (float) scrollback->getCompressedRawBytesTotal() / (float) scrollback->getCompressedBytesTotal();
+        doc["compressUsPerKB"] = scrollback->getCompressMicrosTotal() * 1024 / scrollback->getCompressedRawBytesTotal();
+    }
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleAutoResponderRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+    AutoResponder *autoResponder = ttyd->getAutoResponder();
+
+    if (request->method() == HTTP_DELETE) {
+        if (!request->hasParam("id")) {
+            autoResponder->clearRules();
+            request->send(200);
+        } else if (autoResponder->removeRule(request->getParam("id")->value().toInt())) {
+            request->send(200);
+        } else {
+            request->send(404, "text/plain", "No such rule");
+        }
+        return;
+    }
+    if (request->method() != HTTP_GET) {
+        if (request->method() != HTTP_POST) {
+            request->send(405, "text/plain", "Method Not Allowed");
+        }
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(128 + AUTORESPONDER_MAX_RULES * 192);
+    doc["patternBytesLeft"] = autoResponder->patternBytesLeft();
+    JsonArray rules = doc.createNestedArray("rules");
+
+#if TARGET_GPIO_COUNT > 0
+    const GpioConfig *gpioConfigs = ttyd->getGpioConfigs();
+#endif
+    for (int i = 0; i < AUTORESPONDER_MAX_RULES; i++) {
+        const AutoResponderRule *rule = autoResponder->getRule(i);
+        if (!rule) {
+            continue;
+        }
+        JsonObject obj = rules.createNestedObject();
+        obj["id"] = i;
+        obj["pattern"] = (const char *) rule->pattern;
+        obj["response"] = (const char *) rule->response;
+#if TARGET_GPIO_COUNT > 0
+        if (rule->gpioIndex != AUTORESPONDER_NO_GPIO) {
+            obj["gpio"] = (const __FlashStringHelper*)gpioConfigs[rule->gpioIndex].name;
+            obj["gpioState"] = rule->gpioState;
+        }
+#endif
+        obj["maxHits"] = rule->maxHits;
+        obj["hits"] = rule->hits;
+        obj["lastHitMillis"] = rule->lastHitMillis;
+    }
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+void WiSeServer::handleAutoResponderBody(
+        AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const {
+    if (!checkHttpBasicAuth(request)) return;
+    if (request->method() != HTTP_POST) {
+        return;
+    }
+
+    TaggedJsonDocument doc(128 + PATTERN_MATCHER_MAX_TOTAL_LEN + AUTORESPONDER_RESPONSE_MAX_LEN * 2);
+    deserializeJson(doc, data, len);
+
+    if (doc.isNull()) {
+        return invalidJsonBadRequest(request, "JSON is invalid");
+    }
+    if (!doc["pattern"].is<const char *>() || strlen(doc["pattern"]) == 0) {
+        return invalidJsonBadRequest(request, "\"pattern\" must be a non-empty string");
+    }
+    if (doc.containsKey("response") && !doc["response"].is<const char *>()) {
+        return invalidJsonBadRequest(request, "\"response\" must be a string");
+    }
+    if (doc.containsKey("maxHits") && !doc["maxHits"].is<unsigned int>()) {
+        return invalidJsonBadRequest(request, "\"maxHits\" must be a positive number");
+    }
+    const char *pattern = doc["pattern"];
+    const char *responseData = doc["response"] | "";
+    uint32_t maxHits = doc["maxHits"] | 0;
+
+    int8_t gpioIndex = AUTORESPONDER_NO_GPIO;
+    uint64_t gpioState = 0;
+    if (doc.containsKey("gpio")) {
+#if TARGET_GPIO_COUNT > 0
+        const GpioConfig *gpioConfigs = ttyd->getGpioConfigs();
+        for (size_t i = 0; doc["gpio"].is<const char *>() && i < TARGET_GPIO_COUNT; i++) {
+            if ((gpioConfigs[i].mode == OUTPUT || gpioConfigs[i].mode == OUTPUT_OPEN_DRAIN) &&
+                strcmp_P(doc["gpio"], gpioConfigs[i].name) == 0) {
+                gpioIndex = (int8_t) i;
+                break;
+            }
+        }
+#endif
+        if (gpioIndex == AUTORESPONDER_NO_GPIO) {
+            return invalidJsonBadRequest(request, "\"gpio\" must be the name of an output gpio");
+        }
+        if (!doc["gpioState"].is<unsigned int>()) {
+            return invalidJsonBadRequest(request, "\"gpioState\" must be a positive number");
+        }
+        gpioState = doc["gpioState"];
+    }
+
+    if (strlen(responseData) > AUTORESPONDER_RESPONSE_MAX_LEN) {
+        return invalidJsonBadRequest(request, "\"response\" is too long");
+    }
+
+    int id = ttyd->getAutoResponder()->addRule(pattern, responseData, gpioIndex, gpioState, maxHits);
+    if (id < 0) {
+        request->send(507, "text/plain", "No room for this rule, delete some or use shorter patterns");
+        return;
+    }
+
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf(R"({"id":%d})", id);
+    response->setCode(201);
+    request->send(response);
+}
+
+void WiSeServer::handleTestGenRequest(AsyncWebServerRequest *request) const {
+    if (!checkHttpBasicAuth(request)) return;
+
+    if (request->method() == HTTP_DELETE) {
+        ttyd->getTestGenerator()->stop();
+        return testGenSendResponse(request);
+    }
+    if (request->method() != HTTP_GET) {
+        if (request->method() != HTTP_POST) {
+            request->send(405, "text/plain", "Method Not Allowed");
+        } else if (request->contentLength() == 0) {
+            invalidJsonBadRequest(request, "JSON is invalid");
+        }
+        return;
+    }
+    testGenSendResponse(request);
+}
+
+void WiSeServer::handleTestGenBody(
+        AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) const {
+    if (!checkHttpBasicAuth(request)) return;
+    if (request->method() != HTTP_POST) {
+        return;
+    }
+
+    TaggedJsonDocument doc(200);
+    deserializeJson(doc, data, len);
+
+    if (doc.isNull()) {
+        return invalidJsonBadRequest(request, "JSON is invalid");
+    }
+    TestGeneratorContent content = TEST_GEN_COMPRESSIBLE;
+    if (doc.containsKey("content")) {
+        content = doc["content"].is<const char *>() ? TestGenerator::parseContent(doc["content"])
+                                                     : TEST_GEN_CONTENT_COUNT;
+        if (content == TEST_GEN_CONTENT_COUNT) {
+            return invalidJsonBadRequest(request, "\"content\" must be one of compressible, random, ansi");
+        }
+    }
+    if (doc.containsKey("rate") && !doc["rate"].is<unsigned int>()) {
+        return invalidJsonBadRequest(request, "\"rate\" must be a number of bytes per second");
+    }
+    if (doc.containsKey("chunk") && (!doc["chunk"].is<unsigned int>() || doc["chunk"].as<unsigned int>() == 0 ||
+                                     doc["chunk"].as<unsigned int>() > UART_RX_BUF_SIZE)) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "\"chunk\" must be a number of bytes up to %d", UART_RX_BUF_SIZE);
+        return invalidJsonBadRequest(request, buffer);
+    }
+    if (doc.containsKey("duration") && !doc["duration"].is<unsigned int>()) {
+        return invalidJsonBadRequest(request, "\"duration\" must be a number of ms");
+    }
+
+    ttyd->startTestGenerator(content, doc["rate"] | 0, doc["chunk"] | 1, doc["duration"] | 0);
+    testGenSendResponse(request);
+}
+
+void WiSeServer::testGenSendResponse(AsyncWebServerRequest *request) const {
+    const TestGenerator *testGenerator = ttyd->getTestGenerator();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    TaggedJsonDocument doc(256 + WS_MAX_CLIENTS * 96);
+    doc["running"] = testGenerator->isRunning();
+    doc["content"] = TestGenerator::getContentName(testGenerator->getContent());
+    doc["rate"] = testGenerator->getRate();
+    doc["chunk"] = testGenerator->getChunk();
+    doc["durationMs"] = testGenerator->getDurationMillis();
+    doc["elapsedMs"] = testGenerator->getElapsedMillis();
+    doc["bytes"] = testGenerator->getGeneratedBytes();
+    doc["bytesDropped"] = testGenerator->getDroppedBytes();
+    uint64_t elapsed = testGenerator->getElapsedMillis();
+    doc["bytesPerSec"] = elapsed ? testGenerator->getGeneratedBytes() * 1000 / elapsed : 0;
+    ttyd->testRatesToJson(doc.createNestedArray("clients"));
+
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
 void WiSeServer::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg,
                                   uint8_t *data, size_t len) {
     AwsFrameInfo *info = nullptr;
@@ -11,6 +11,7 @@
 #include "ttyd.h"
 #include "xschedule.h"
 #include "ExtendedSerial.h"
+#include "HeapProfiler.h"
 
 void TTY::begin() {
 #if UART_COMM_TX_EN >= 0
@@ -39,12 +40,14 @@ void TTY::begin() {
         }
     }
 #endif
+    // Allocate it early, while the heap isn't fragmented yet.
+    scrollback.begin();
 }
 
 void TTY::end() {
-    UART_COMM.flush();
-    UART_COMM.end();
-    UART_COMM.setRxBufferSize(256);
+    uart.flush();
+    uart.end();
+    uart.setRxBufferSize(256);
 #if UART_COMM_TX_EN >= 0
     // Disable TX line to prevent debug message on boot.
     digitalWrite(UART_COMM_TX_EN, HIGH);
@@ -56,15 +59,17 @@ void TTY::stty(uint32_t baudrate, uint8_t config) {
     this->uartConfig = config;
 
     debugf("TTY stty baud %d config %02X\r\n", baudrate, config);
+    trace(TRACE_STTY, config, baudrate);
 
     if (uartBegun) {
-        UART_COMM.flush();
-        UART_COMM.end();
+        uart.flush();
+        uart.end();
     }
 
-    UART_COMM.setRxBufferSize(UART_RX_BUF_SIZE);
-    UART_COMM.begin(baudrate, (SerialConfig) config);
-    UART_COMM.setTimeout(1);
+    uart.setRxBufferSize(UART_RX_BUF_SIZE);
+    uart.begin(baudrate, (SerialConfig) config);
+    uart.setTimeout(1);
+    uart.beginErrorTracking();
     uartBegun = true;
 
     if (wsClientsLen > 0) {
@@ -73,8 +78,12 @@ void TTY::stty(uint32_t baudrate, uint8_t config) {
 }
 
 void TTY::markClientAuthenticated(uint32_t clientId) {
+    AsyncWebSocketClient *client = websocket->client(clientId);
+    wsClientStats[wsClientsLen].begin(clientId, client ? wsRecentClients.onConnect(client->remoteIP()) : 0);
+    wsClientsLastSeen[wsClientsLen] = millis();
     wsClients[wsClientsLen++] = clientId;
     pendingAuthClients--;
+    trace(TRACE_CLIENT_ADDED, 0, clientId, wsClientsLen);
 }
 
 size_t TTY::snprintWindowTitle(char *dest, size_t len) const {
@@ -134,7 +143,7 @@ void TTY::sendWindowTitle(int64_t clientId) {
     char windowTitle[100] = {0};
     windowTitle[0] = CMD_SET_WINDOW_TITLE;
     size_t titleLen = 1 + snprintWindowTitle(windowTitle + 1, 99);
-    AsyncWebSocketMessageBuffer *wsBuffer = websocket->makeBuffer((uint8_t *) windowTitle, titleLen);
+    AsyncWebSocketMessageBuffer *wsBuffer = makeWsBuffer((uint8_t *) windowTitle, titleLen);
     if (!wsBuffer) return;
     if (clientId < 0) {
         broadcastBufferToClients(wsBuffer);
@@ -168,11 +177,11 @@ bool TTY::isClientAuthenticated(uint32_t clientId) {
     return findClientIndex(clientId) >= 0;
 }
 
-void TTY::removeClient(uint32_t clientId) {
+void TTY::removeClient(uint32_t clientId, bool kicked) {
     debugf("TTY remove client %d\r\n", clientId);
     bool found = false;
 
-    blockClient(clientId);
+    blockClient(clientId, kicked);
 
     for (int i = 0; i < wsClientsLen; i++) {
         if (wsClients[i] == clientId) {
@@ -183,16 +192,22 @@ void TTY::removeClient(uint32_t clientId) {
         if (found && i < wsClientsLen - 1 && i < WS_MAX_CLIENTS - 1) {
             wsClients[i] = wsClients[i + 1];
             wsClientsLastSeen[i] = wsClientsLastSeen[i + 1];
+            wsClientStats[i] = wsClientStats[i + 1];
         }
     }
 
     if (found) {
         wsClientsLen--;
+        trace(TRACE_CLIENT_REMOVED, 0, clientId, wsClientsLen);
     }
 }
 
-void TTY::blockClient(uint32_t clientId) {
+void TTY::blockClient(uint32_t clientId, bool kicked) {
     debugf("TTY client blocked: %d\r\n", clientId);
+    if (kicked) {
+        metrics.clientsBlocked++;
+    }
+    trace(TRACE_CLIENT_BLOCKED, 0, clientId);
     wsBlockedClients[wsBlockedClientsLen++] = clientId;
     wsClientBlockedAtMillis[wsBlockedClientsLen - 1] = millis();
 }
@@ -248,7 +263,9 @@ bool TTY::onNewWebSocketClient(uint32_t clientId) {
 
 void TTY::nukeClient(uint32_t clientId, uint16_t closeReason) {
     debugf("TTY nuke client %d\r\n", clientId);
-    this->removeClient(clientId);
+    metrics.clientsNuked++;
+    trace(TRACE_CLIENT_NUKED, closeReason, clientId);
+    this->removeClient(clientId, true);
     websocket->close(clientId, closeReason);
 }
 
@@ -257,6 +274,9 @@ void TTY::handleWebSocketMessage(uint32_t clientId, const uint8_t *buf, size_t l
     bool isAuthToken = false;
     char authToken[HTTP_AUTH_TOKEN_LEN];
 
+    metrics.wsRxFrames++;
+    metrics.wsRxBytes += len;
+
     debugf("TTY new message, client %d, command %c, cached command %c free heap %d\r\n", clientId, command,
            fragmentCachedCommand, ESP.getFreeHeap());
 
@@ -266,7 +286,7 @@ void TTY::handleWebSocketMessage(uint32_t clientId, const uint8_t *buf, size_t l
     }
 
     if (command == CMD_JSON_DATA) {
-        DynamicJsonDocument doc(200);
+        TaggedJsonDocument doc(200);
         deserializeJson(doc, buf, len);
 
         if (doc.isNull()) {
@@ -294,6 +314,10 @@ void TTY::handleWebSocketMessage(uint32_t clientId, const uint8_t *buf, size_t l
     }
 
     clientSeen(clientId);
+    int clientIndex = findClientIndex(clientId);
+    if (clientIndex >= 0) {
+        wsClientStats[clientIndex].onInput(len);
+    }
 
     const uint8_t *inputDataBuf;
     size_t inputLen;
@@ -308,17 +332,35 @@ void TTY::handleWebSocketMessage(uint32_t clientId, const uint8_t *buf, size_t l
 
     switch (command) {
         case CMD_INPUT:
-            UART_COMM.write((const uint8_t *) inputDataBuf, inputLen);
+            uart.write((const uint8_t *) inputDataBuf, inputLen);
             totalTx += len - 1;
             requestLedBlink.leds.tx = true;
+            // Only when the line is quiet, otherwise the next bytes we get are most likely not the echo. What the test
+            // generator produces is never an echo either.
+            if (echoSentAtMicros == 0 && uartFirstAvailableMicros == 0 && !uart.available() &&
+                !testGenerator.isRunning()) {
+                echoSentAtMicros = micros64();
+                echoNoticed = false;
+            }
+            break;
+        case CMD_PING:
+            sendPong(clientId, inputDataBuf, inputLen);
             break;
         case CMD_DETECT_BAUD:
             debugf("TTY Requesting baudrate detection\r\n");
             requestAutobaud();
             break;
-        case CMD_SEND_BREAK:
+        case CMD_SEND_BREAK: {
             debugf("TTY Send break\r\n");
-            UART_COMM.sendBreak();
+            uint32_t breakStartedAt = LoopProfiler::startBlocking();
+            uart.sendBreak();
+            loopProfiler.endBlocking(LOOP_PHASE_SEND_BREAK, breakStartedAt);
+            break;
+        }
+        case CMD_SUBSCRIBE_CLIENT_STATS:
+            if (clientIndex >= 0 && inputLen > 0) {
+                wsClientStats[clientIndex].subscribed = inputDataBuf[0] == '1';
+            }
             break;
         case CMD_PAUSE:
             flowControlUartRequestStop(FLOW_CTL_SRC_REMOTE);
@@ -341,9 +383,107 @@ void TTY::handleWebSocketPong(uint32_t clientId) {
     clientSeen(clientId);
 }
 
+AsyncWebSocketMessageBuffer *TTY::makeWsBuffer(size_t size) {
+    HeapTag tag(HEAP_CAT_WS_BUFFER);
+    return websocket->makeBuffer(size);
+}
+
+AsyncWebSocketMessageBuffer *TTY::makeWsBuffer(uint8_t *data, size_t size) {
+    HeapTag tag(HEAP_CAT_WS_BUFFER);
+    return websocket->makeBuffer(data, size);
+}
+
+size_t TTY::sourceAvailable() {
+    if (testGenerator.isRunning()) {
+        return testGenerator.available(uartFlowControlStatus != 0);
+    }
+    return rxHoldoverLen + uart.available();
+}
+
+size_t TTY::sourceRead(char *buf, size_t len) {
+    rxHoldoverRead = 0;
+    if (testGenerator.isRunning()) {
+        return testGenerator.readBytes(buf, len);
+    }
+    if (rxHoldoverLen > 0) {
+        rxHoldoverRead = std::min(len, rxHoldoverLen);
+        memcpy(buf, rxHoldover, rxHoldoverRead);
+        rxHoldoverLen -= rxHoldoverRead;
+        memmove(rxHoldover, rxHoldover + rxHoldoverRead, rxHoldoverLen);
+    }
+    if (rxHoldoverLen == 0 && rxHoldover && !autoResponder.active()) {
+        // The rules are gone
+        free(rxHoldover);
+        rxHoldover = nullptr;
+    }
+    return rxHoldoverRead + uart.readBytes(buf + rxHoldoverRead, len - rxHoldoverRead);
+}
+
+void TTY::readAheadForPrompts() {
+    if (!autoResponder.active() || testGenerator.isRunning() || rxHoldoverLen >= AUTORESPONDER_HOLDOVER_SIZE) {
+        return;
+    }
+    size_t available = uart.available();
+    if (available == 0) {
+        return;
+    }
+    if (!rxHoldover) {
+        rxHoldover = (uint8_t *) malloc(AUTORESPONDER_HOLDOVER_SIZE);
+        if (!rxHoldover) {
+            return;
+        }
+    }
+    size_t read = uart.readBytes((char *) rxHoldover + rxHoldoverLen,
+                                 std::min(available, (size_t) AUTORESPONDER_HOLDOVER_SIZE - rxHoldoverLen));
+    if (read > 0) {
+        answerPrompts(rxHoldover + rxHoldoverLen, read);
+        rxHoldoverLen += read;
+    }
+}
+
+void TTY::startTestGenerator(TestGeneratorContent content, uint32_t rate, uint16_t chunk, uint64_t durationMillis) {
+    for (int i = 0; i < wsClientsLen; i++) {
+        wsClientStats[i].markTestStart();
+    }
+    testGenerator.start(content, rate, chunk, durationMillis);
+}
+
+void TTY::testRatesToJson(JsonArray arr) const {
+    uint64_t until = testGenerator.getStartedAtMillis() + testGenerator.getElapsedMillis();
+    for (int i = 0; i < wsClientsLen; i++) {
+        wsClientStats[i].testRateToJson(arr.createNestedObject(), until);
+    }
+}
+
+void TTY::releaseWsBuffer(AsyncWebSocketMessageBuffer *wsBuffer) {
+#ifdef LEGACY_LIB
+    // The library owns it, and frees it once it's not locked by any message.
+    websocket->_cleanBuffers();
+#else
+    // Sending it is what hands it over to the library.
+    delete wsBuffer;
+#endif
+}
+
 void TTY::broadcastBufferToClients(AsyncWebSocketMessageBuffer *wsBuffer) {
     if (!wsBuffer) return;
 
+    if (wsClientsLen == 0) {
+        // Nobody to send it to, e.g. when the data only goes to /uart/stream or a client is still authenticating.
+        releaseWsBuffer(wsBuffer);
+        return;
+    }
+
+    for (int i = 0; i < wsClientsLen; i++) {
+        AsyncWebSocketClient *client = websocket->client(wsClients[i]);
+        if (!client || client->status() != WS_CONNECTED) continue;
+#ifndef LEGACY_LIB
+        wsClientStats[i].syncQueue(client->queueLen());
+#endif
+        // A full queue means the library is going to discard it for this client.
+        wsClientStats[i].onFrameQueued(wsBuffer->length(), client->queueIsFull());
+    }
+
     if (areAllClientsAuthenticated()) {
         // Fast no-copy path
         websocket->binaryAll(wsBuffer);
@@ -384,8 +524,12 @@ void TTY::flowControlUartRequestStop(uint8_t source) {
     }
     if (uartFlowControlStatus == 0) {
         debugf("TTY uart flow control XOFF source %d\r\n", source);
-        UART_COMM.write(FLOW_CTL_XOFF);
+        uart.write(FLOW_CTL_XOFF);
         uartFlowControlEngagedMillis = millis();
+        trace(TRACE_UART_XOFF, source, uart.available());
+    }
+    if (!(uartFlowControlStatus & source)) {
+        metrics.flowControlEngagements[source == FLOW_CTL_SRC_LOCAL ? METRICS_FLOW_CTL_LOCAL : METRICS_FLOW_CTL_REMOTE]++;
     }
     uartFlowControlStatus |= source;
 }
@@ -400,7 +544,10 @@ void TTY::flowControlUartRequestResume(uint8_t source) {
     uartFlowControlStatus &= ~source;
     if (uartFlowControlStatus == 0) {
         debugf("TTY uart flow control XON source %d\r\n", source);
-        UART_COMM.write(FLOW_CTL_XON);
+        uart.write(FLOW_CTL_XON);
+        uint32_t xoffMillis = millis() - uartFlowControlEngagedMillis;
+        metrics.uartXoffMillis += xoffMillis;
+        trace(TRACE_UART_XON, source, xoffMillis);
     }
 }
 
@@ -410,8 +557,20 @@ void TTY::flowControlWebSocketRequest(bool stop) {
     }
     debugf("TTY ws flow control enabled: %d\r\n", stop);
     wsFlowControlStopped = stop;
-    AsyncWebSocketMessageBuffer *buffer = websocket->makeBuffer(1);
-    if (!buffer) return;
+    if (stop) {
+        metrics.flowControlEngagements[METRICS_FLOW_CTL_HEAP]++;
+        trace(TRACE_WS_PAUSE, 0, ESP.getFreeHeap());
+    } else {
+        uint32_t pausedMillis = millis() - wsFlowControlEngagedMillis;
+        metrics.wsPausedMillis += pausedMillis;
+        trace(TRACE_WS_RESUME, 0, ESP.getFreeHeap(), pausedMillis);
+    }
+    AsyncWebSocketMessageBuffer *buffer = makeWsBuffer(1);
+    if (!buffer) {
+        metrics.makeBufferFailures++;
+        trace(TRACE_MAKE_BUFFER_FAILED, 0, 1, ESP.getFreeHeap());
+        return;
+    }
     buffer->get()[0] = stop ? CMD_SERVER_PAUSE : CMD_SERVER_RESUME;
     broadcastBufferToClients(buffer);
 }
@@ -469,24 +628,85 @@ void TTY::performHousekeeping() {
         collectStats();
         lastStatsCollectMillis = millis();
     }
+    uartExec.checkTimeout(now);
+    testGenerator.checkTimeout(now);
 #if TARGET_GPIO_COUNT > 0
     sendGpioStates(0);
 #endif
 }
 
+uint64_t TTY::getNextHousekeepingMillis() {
+    uint64_t now = millis();
+    if (canDispatchUart()) {
+        return now;
+    }
+    // Each task runs once more than its interval has passed
+    uint64_t next = lastLedHandleMillis + LED_HANDLE_EVERY_MILLIS + 1;
+    next = std::min(next, lastClientTimeoutCheckMillis + CLIENT_TIMEOUT_CHECK_EVERY_MILLIS + 1);
+    next = std::min(next, lastClientPingMillis + CLIENT_PING_EVERY_MILLIS + 1);
+    next = std::min(next, lastStatsCollectMillis + COLLECT_STATS_EVERY_MILLIS + 1);
+    if (uartFlowControlStatus) {
+        // See unlockUartFlowControlIfTimedOut()
+        next = std::min(next, uartFlowControlEngagedMillis + UART_SW_LOCAL_FLOW_CONTROL_STOP_MAX_MS + 1);
+    }
+    return std::max(next, now);
+}
+
+bool TTY::canDispatchUart() {
+    if (testGenerator.isRunning()) {
+        return true;
+    }
+    size_t available = uart.available();
+    if (available == 0 && rxHoldoverLen == 0) {
+        return false;
+    }
+    if (!hasUartConsumers()) {
+        // It would be left in the buffer
+        return false;
+    }
+    if (available > 0 && autoResponder.active() && rxHoldoverLen < AUTORESPONDER_HOLDOVER_SIZE) {
+        // Read ahead for prompts even if the sinks are full
+        return true;
+    }
+    // Held back until a client or a stream drain their queue, which wakes the loop up by itself.
+    if (!uartStreams.canAccept()) {
+        return false;
+    }
+    for (int i = 0; i < wsClientsLen; i++) {
+        AsyncWebSocketClient *client = websocket->client(wsClients[i]);
+        if (!client || client->status() != WS_CONNECTED || client->queueIsFull()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool TTY::wsCanSend() {
     if (wsClientsLen == 0) {
         return false;
     }
 
+    // Check all of them rather than stopping at the first one, so that each client is accounted the time it blocks.
+    bool canSend = true;
     for (int i = 0; i < wsClientsLen; i++) {
         AsyncWebSocketClient *client = websocket->client(wsClients[i]);
-        if ((!client) || (client->status() != WS_CONNECTED) || (client->queueIsFull())) {
-            return false;
-        }
+        bool blocking = (!client) || (client->status() != WS_CONNECTED) || (client->queueIsFull());
+        wsClientStats[i].setBlocking(blocking);
+        canSend &= !blocking;
     }
 
-    return true;
+    if (!canSend) {
+        metrics.wsCannotSend++;
+    }
+    return canSend;
+}
+
+// Like wsCanSend, but also accounts for HTTP stream clients and works with no WebSocket clients connected.
+bool TTY::uartSinksCanAccept() {
+    if (wsClientsLen > 0 && !wsCanSend()) {
+        return false;
+    }
+    return uartStreams.canAccept();
 }
 
 bool TTY::areAllClientsAuthenticated() const {
@@ -495,7 +715,7 @@ bool TTY::areAllClientsAuthenticated() const {
 
 // Trigger flow control (UART side) based on the UART buffer and WebSocket send queue status.
 bool TTY::performFlowControl_SlowWiFi(size_t uartAvailable) {
-    bool canSend = wsCanSend();
+    bool canSend = uartSinksCanAccept();
     if (uartAvailable > UART_SW_FLOW_CONTROL_HIGH_WATERMARK || !canSend) {
         debugf("Uart available: %d, watermark %d, can send? %d\r\n", uartAvailable, UART_SW_FLOW_CONTROL_HIGH_WATERMARK,
                canSend);
@@ -540,18 +760,112 @@ void TTY::collectStats() {
     rxRate = rx * 8 * 1000 / (now - lastStatsCollectMillis);
     prevTx = totalTx;
     prevRx = totalRx;
+#if HEAP_PROFILER_SLOTS > 0
+    heapProfiler.sample();
+#endif
+
+#ifndef LEGACY_LIB
+    // Frames also leave the queue while we aren't sending anything.
+    for (int i = 0; i < wsClientsLen; i++) {
+        AsyncWebSocketClient *client = websocket->client(wsClients[i]);
+        if (client) {
+            wsClientStats[i].syncQueue(client->queueLen());
+        }
+    }
+#endif
+    pushClientStats();
+}
+
+// ArduinoJson writer that doesn't NUL-terminate, so it can fill a WebSocket buffer exactly.
+struct RawBufferWriter {
+    uint8_t *pos;
+
+    size_t write(uint8_t c) {
+        *pos++ = c;
+        return 1;
+    }
+
+    size_t write(const uint8_t *s, size_t n) {
+        memcpy(pos, s, n);
+        pos += n;
+        return n;
+    }
+};
+
+void TTY::sendPong(uint32_t clientId, const uint8_t *payload, size_t len) {
+    uint8_t buf[1 + PING_PAYLOAD_MAX_LEN];
+    len = std::min(len, (size_t) PING_PAYLOAD_MAX_LEN);
+    buf[0] = CMD_SERVER_PONG;
+    memcpy(buf + 1, payload, len);
+    websocket->binary(clientId, buf, len + 1);
+}
+
+void TTY::sendLossMarker() {
+    size_t len = sizeof(UART_LOSS_MARKER_TEXT) - 1;
+    AsyncWebSocketMessageBuffer *wsBuffer = makeWsBuffer(len + 1);
+    if (!wsBuffer) {
+        metrics.makeBufferFailures++;
+        return;
+    }
+    uint8_t *buf = wsBuffer->get();
+    buf[0] = CMD_OUTPUT;
+    memcpy(buf + 1, UART_LOSS_MARKER_TEXT, len);
+    broadcastBufferToClients(wsBuffer);
+}
+
+void TTY::clientStatsToJson(JsonArray arr) const {
+    for (int i = 0; i < wsClientsLen; i++) {
+        wsClientStats[i].toJson(arr.createNestedObject(), wsClientsLastSeen[i]);
+    }
+}
+
+void TTY::pushClientStats() {
+    bool anySubscribed = false;
+    for (int i = 0; i < wsClientsLen; i++) {
+        anySubscribed |= wsClientStats[i].subscribed;
+    }
+    if (!anySubscribed) {
+        return;
+    }
+
+    TaggedJsonDocument doc(64 + WS_MAX_CLIENTS * 384);
+    clientStatsToJson(doc.to<JsonArray>());
+    size_t len = measureJson(doc);
+
+    // One buffer per client, sending it hands it over to the library. Only made for a client that can take it, so
+    // there's none left over to release.
+    for (int i = 0; i < wsClientsLen; i++) {
+        AsyncWebSocketClient *client = websocket->client(wsClients[i]);
+        if (!client || !wsClientStats[i].subscribed || client->status() != WS_CONNECTED) continue;
+
+        AsyncWebSocketMessageBuffer *wsBuffer = makeWsBuffer(len + 1);
+        if (!wsBuffer) {
+            metrics.makeBufferFailures++;
+            break;
+        }
+        uint8_t *buf = wsBuffer->get();
+        buf[0] = CMD_SERVER_CLIENT_STATS;
+        RawBufferWriter writer{buf + 1};
+        serializeJson(doc, writer);
+        client->binary(wsBuffer);
+    }
+#ifdef LEGACY_LIB
+    websocket->_cleanBuffers();
+#endif
 }
 
 void TTY::requestAutobaud() {
     pendingAutobaud = true;
+    trace(TRACE_AUTOBAUD_REQUESTED);
 }
 
 void TTY::sendBaurateDetectionResult(int64_t bestApprox, int64_t measured) {
     debugf("TTY Detected baudrate: %lld (measured: %lld)\r\n", bestApprox, measured);
+    trace(TRACE_AUTOBAUD_RESULT, 0, bestApprox, measured);
     uint8_t buf[30];
     size_t len = snprintf(reinterpret_cast<char *>(buf), sizeof(buf), "%c%lld,%lld", CMD_SERVER_DETECTED_BAUD,
                           bestApprox, measured);
-    auto wsBuf = websocket->makeBuffer(buf, len);
+    auto wsBuf = makeWsBuffer(buf, len);
     broadcastBufferToClients(wsBuf);
 }
 
@@ -564,10 +878,10 @@ void TTY::autobaud() {
     }
 
     autobaudLastAttemptAtMillis = millis();
-    int measured = UART_COMM.autobaudMeasure();
+    int measured = uart.autobaudMeasure();
 
     if (measured) {
-        int bestApprox = UART_COMM.autobaudGetClosestStdRate(measured);
+        int bestApprox = uart.autobaudGetClosestStdRate(measured);
         pendingAutobaud = false;
         autobaudStartedAtMillis = 0;
         autobaudLastAttemptAtMillis = 0;
@@ -582,31 +896,127 @@ void TTY::autobaud() {
     }
 }
 
+// Hands UART output to the on-device consumers. It's called before the buffer is passed on to the WebSocket library,
+// since the library takes ownership of it.
+void TTY::onUartRx(const uint8_t *buf, size_t len, uint64_t rxMillis) {
+    // Prompts have to be answered before anything else, boot loaders usually wait for a few seconds at most.
+    // Generated test data must not make us write to the real device.
+    if (autoResponder.active() && !testGenerator.isRunning() && len > rxHoldoverRead) {
+        // What came from rxHoldover has been answered already
+        answerPrompts(buf + rxHoldoverRead, len - rxHoldoverRead);
+    }
+
+    if (uartExec.active()) {
+        uartExec.feed(buf, len, rxMillis);
+    }
+
+    if (uartCapture.active()) {
+        uartCapture.feed(buf, len, rxMillis);
+    }
+
+    if (scrollback.active()) {
+        scrollback.feed(buf, len);
+    }
+
+    if (uartStreams.active()) {
+        uartStreams.feed(buf, len, rxMillis);
+    }
+}
+
+void TTY::answerPrompts(const uint8_t *buf, size_t len) {
+    size_t txBytes = 0;
+    __unused uint32_t fired = autoResponder.feed(buf, len, txBytes);
+    if (txBytes > 0) {
+        totalTx += txBytes;
+        requestLedBlink.leds.tx = true;
+    }
+#if TARGET_GPIO_COUNT > 0
+    bool gpioChanged = false;
+    for (int i = 0; fired && i < AUTORESPONDER_MAX_RULES; i++) {
+        const AutoResponderRule *rule = autoResponder.getRule(i);
+        if ((fired & (1UL << i)) && rule && rule->gpioIndex != AUTORESPONDER_NO_GPIO) {
+            setGpioState(rule->gpioIndex, rule->gpioState);
+            gpioChanged = true;
+        }
+    }
+    if (gpioChanged) {
+        // Apply right away instead of waiting for housekeeping.
+        sendGpioStates(0);
+    }
+#endif
+}
+
+uint32_t TTY::startExec(const char *send, size_t sendLen, const char *until, uint64_t timeout) {
+    uint32_t gen = uartExec.start(send, sendLen, until, timeout);
+    if (gen) {
+        totalTx += sendLen;
+        requestLedBlink.leds.tx = true;
+    }
+    return gen;
+}
+
 void TTY::dispatchUart() {
     if (wsClientsLen == 0) {
-        // Unlock all flow control.
-        flowControlUartRequestResume(FLOW_CTL_SRC_LOCAL | FLOW_CTL_SRC_REMOTE);
         // No clients connected, so we just set the flag.
         wsFlowControlStopped = false;
-        return;
+        if (!hasUartConsumers()) {
+            // Nobody is waiting for whatever is sitting in the buffer, don't count it as latency.
+            uartFirstAvailableMicros = 0;
+            // Unlock all flow control.
+            flowControlUartRequestResume(FLOW_CTL_SRC_LOCAL | FLOW_CTL_SRC_REMOTE);
+            return;
+        }
+        // Only local flow control still makes sense, the clients that requested a pause are gone.
+        flowControlUartRequestResume(FLOW_CTL_SRC_REMOTE);
     }
 
     if (pendingAutobaud) {
         autobaud();
     }
 
-    size_t available = UART_COMM.available();
+    size_t available = sourceAvailable();
     if (!available) {
+        uartFirstAvailableMicros = 0;
+        if (echoSentAtMicros != 0 && micros64() - echoSentAtMicros > ECHO_TIMEOUT_MICROS) {
+            // Not echoed, e.g. a password prompt.
+            echoSentAtMicros = 0;
+        }
         unlockUartFlowControlIfTimedOut();
         return;
     }
+    // We only notice data when we poll, so this includes the time it took the loop to come back here.
+    if (uartFirstAvailableMicros == 0) {
+        uartFirstAvailableMicros = micros64();
+    }
+    if (testGenerator.isRunning()) {
+        // The generated data isn't the echo of a keystroke typed before the test started.
+        echoSentAtMicros = 0;
+        echoNoticed = false;
+    } else if (echoSentAtMicros != 0 && !echoNoticed) {
+        latencyEchoUart.record(uartFirstAvailableMicros - echoSentAtMicros);
+        echoNoticed = true;
+    }
+    if (!testGenerator.isRunning()) {
+        uart.noteRxLevel(available);
+    }
+    if (!testGenerator.isRunning() && uart.pollErrors()) {
+        UartErrorCounters errors = uart.getErrorCounters();
+        trace(TRACE_UART_DATA_LOST, 0, errors.overruns + errors.bufferFull, available);
+        // The bytes that didn't fit were lost after what's in the buffer now.
+        pendingLossMarker = UART_LOSS_MARKER;
+    }
+
+    // Before anything can hold the data back: answering a prompt must not depend on how fast the clients are.
+    readAheadForPrompts();
 
     // Rather wait a little bit longer instead of sending a crapload of tiny chunks that take.
     if (available < UART_RX_SOFT_MIN) {
         // Wait for roughly the amount of time it takes for an amount of data 2/3 the size of the WS buffer to be
         // received over UART at the current rate, but not for too long so we don't affect responsiveness.
+        uint32_t delayStartedAt = LoopProfiler::startBlocking();
         delay(UART_BUFFER_BELOW_SOFT_MIN_DYNAMIC_DELAY);
-        available = UART_COMM.available();
+        loopProfiler.endBlocking(LOOP_PHASE_SOFT_MIN_DELAY, delayStartedAt);
+        available = sourceAvailable();
     }
 
     performFlowControl_SlowWiFi(available);
@@ -614,20 +1024,29 @@ void TTY::dispatchUart() {
     // Avoid flow control deadlocks.
     unlockUartFlowControlIfTimedOut();
 
-    bool shouldContinueDispatching = wsCanSend() && !performFlowControl_HeapFull();
+    bool shouldContinueDispatching = uartSinksCanAccept() && !performFlowControl_HeapFull();
 
     // Don't process if flow control was engaged due to low heap or if the WebSocket library can't handle our input.
     if (!shouldContinueDispatching) {
+        // What arrived meanwhile still gets looked at.
+        readAheadForPrompts();
         return;
     }
 
     // Use the WebSocket library buffer so we can use the "messageAll" fast path that doesn't incur in additional copies
     // +1 for ttyd command.
     size_t bufsize = available + 1;
-    AsyncWebSocketMessageBuffer *wsBuffer = websocket->makeBuffer(bufsize);
-    if (!wsBuffer) return;
+    AsyncWebSocketMessageBuffer *wsBuffer = makeWsBuffer(bufsize);
+    if (!wsBuffer) {
+        metrics.makeBufferFailures++;
+        trace(TRACE_MAKE_BUFFER_FAILED, 0, bufsize, ESP.getFreeHeap());
+        return;
+    }
     char *buf = (char *) wsBuffer->get();
-    if (!buf) return;
+    if (!buf) {
+        releaseWsBuffer(wsBuffer);
+        return;
+    }
     buf[0] = CMD_OUTPUT;
 
     // uint8_t t1;
@@ -635,20 +1054,49 @@ void TTY::dispatchUart() {
     BENCH debugf("Sending %d B to %d clients\r\n", bufsize, wsClientsLen);
 
     // Read directly into the buffer.
-    size_t read = UART_COMM.readBytes(buf + 1, bufsize - 1);
+    size_t read = sourceRead(buf + 1, bufsize - 1);
     totalRx += read;
 
     // BENCH UART_DEBUG.printf("READ %dB time %lld\n", read, micros64() - t1);
 
     if (read == 0) {
+        releaseWsBuffer(wsBuffer);
         return;
     }
 
+    uint64_t readAtMicros = micros64();
+    latencyUartToRead.record(readAtMicros - uartFirstAvailableMicros);
+
     requestLedBlink.leds.rx = true;
 
+    onUartRx((const uint8_t *) buf + 1, read, millis());
+
     // BENCH t1 = micros64();
 
+    // With no WebSocket clients this just releases the buffer.
+    bool hasWsClients = wsClientsLen > 0;
     broadcastBufferToClients(wsBuffer);
+    if (hasWsClients) {
+        uint64_t sentAtMicros = micros64();
+        latencyUartToWs.record(sentAtMicros - uartFirstAvailableMicros);
+        metrics.wsTxFrames++;
+        metrics.wsTxBytes += read;
+        if (echoSentAtMicros != 0) {
+            latencyEchoWs.record(sentAtMicros - echoSentAtMicros);
+        }
+    }
+    if (echoNoticed) {
+        echoSentAtMicros = 0;
+        echoNoticed = false;
+    }
+    if (pendingLossMarker) {
+        if (hasWsClients) {
+            sendLossMarker();
+        }
+        pendingLossMarker = false;
+    }
+    // Whatever is left in the UART buffer has been waiting at least since we read.
+    uartFirstAvailableMicros = sourceAvailable() ? readAtMicros : 0;
     // BENCH UART_DEBUG.printf("WSEND %dB time %lld\n", read, micros64() - t1);
 }
 
@@ -657,6 +1105,20 @@ GpioConfig* TTY::getGpioConfigs() {
     return gpioConfigs;
 }
 
+// Requests a new state for an output GPIO, it's applied by sendGpioStates().
+void TTY::setGpioState(size_t index, uint64_t state) {
+    debugf("Target gpio %u from index %u unlocked.\r\n", gpioConfigs[index].gpio, index);
+    gpioConfigs[index].lock = TARGET_GPIO_UNLOCKED;
+    gpioConfigs[index].state = state;
+    // Discard any other gpio with the same number that may be in pending state.
+    for (size_t x = 0; x < TARGET_GPIO_COUNT; x++) {
+        if ((x != index) && (gpioConfigs[x].gpio == gpioConfigs[index].gpio)) {
+            debugf("Target gpio %u from index %u locked by the same gpio from index %u.\r\n", gpioConfigs[x].gpio, x, index);
+            gpioConfigs[x].lock = TARGET_GPIO_LOCKED;
+        }
+    }
+}
+
 void TTY::sendGpioStates(char force) {
     uint64_t now = millis();
     char buf[TARGET_GPIO_COUNT + 1] = {0}; // {'G','D','E','A','D'};
@@ -698,7 +1160,7 @@ void TTY::sendGpioStates(char force) {
     }
     // Emit changes
     if ((buf[0] == CMD_SERVER_GPIO_STATES) && wsCanSend()) {
-        if (AsyncWebSocketMessageBuffer *wsBuffer = websocket->makeBuffer((uint8_t *) buf, TARGET_GPIO_COUNT + 1))
+        if (AsyncWebSocketMessageBuffer *wsBuffer = makeWsBuffer((uint8_t *) buf, TARGET_GPIO_COUNT + 1))
             broadcastBufferToClients(wsBuffer);
     }
 }
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Decodes the flight recorder dump served by GET /trace.
+#
+#   curl -o trace.bin IP_ADDRESS/trace
+#   tools/decode_trace.py trace.bin
+#
+import struct
+import sys
+
+# Must match include/Trace.h
+TRACE_DUMP_MAGIC = 0x52545357
+TRACE_DUMP_VERSION = 1
+HEADER = struct.Struct('<IBBHIIQ')
+EVENT = struct.Struct('<IHHII')
+
+FLOW_CTL_SOURCES = {1: 'local', 2: 'remote', 3: 'local+remote'}
+LOOP_PHASES = ['outsideLoop', 'ota', 'dispatchUart', 'yield1', 'housekeeping', 'yield2', 'softMinDelay', 'sendBreak']
+
+
+def source(arg0, arg1, arg2):
+    return FLOW_CTL_SOURCES.get(arg0, str(arg0))
+
+
+def loop_phase(arg0, arg1, arg2):
+    return LOOP_PHASES[arg0] if arg0 < len(LOOP_PHASES) else str(arg0)
+
+
+EVENTS = {
+    1: ('uart_xoff', lambda a0, a1, a2: f"source={source(a0, a1, a2)} rx_available={a1}"),
+    2: ('uart_xon', lambda a0, a1, a2: f"source={source(a0, a1, a2)} xoff_ms={a1}"),
+    3: ('ws_pause', lambda a0, a1, a2: f"free_heap={a1}"),
+    4: ('ws_resume', lambda a0, a1, a2: f"free_heap={a1} paused_ms={a2}"),
+    5: ('client_added', lambda a0, a1, a2: f"client={a1} clients={a2}"),
+    6: ('client_removed', lambda a0, a1, a2: f"client={a1} clients={a2}"),
+    7: ('client_blocked', lambda a0, a1, a2: f"client={a1}"),
+    8: ('client_nuked', lambda a0, a1, a2: f"client={a1} close_reason={a0}"),
+    9: ('autobaud_requested', lambda a0, a1, a2: ""),
+    10: ('autobaud_result', lambda a0, a1, a2: f"baud={a1} measured={a2}" if a1 else "timed out"),
+    11: ('stty', lambda a0, a1, a2: f"baud={a1} config=0x{a0:02x}"),
+    12: ('make_buffer_failed', lambda a0, a1, a2: f"size={a1} free_heap={a2}"),
+    13: ('loop_stall', lambda a0, a1, a2: f"iteration_us={a1} phase={loop_phase(a0, a1, a2)} phase_us={a2}"),
+    14: ('uart_data_lost', lambda a0, a1, a2: f"overruns={a1} rx_available={a2}"),
+}
+TRACE_OVERWRITTEN = 0xFFFF
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise ValueError("Dump is too short")
+    magic, version, event_size, event_count, recorded, _, now_us = HEADER.unpack_from(data)
+    if magic != TRACE_DUMP_MAGIC:
+        raise ValueError("Not a Wi-Se trace dump")
+    if version != TRACE_DUMP_VERSION or event_size != EVENT.size:
+        raise ValueError(f"Unsupported dump version {version} (event size {event_size})")
+
+    raw = []
+    for i in range(event_count):
+        offset = HEADER.size + i * EVENT.size
+        if offset + EVENT.size > len(data):
+            print(f"# dump truncated after {i} events", file=sys.stderr)
+            break
+        raw.append(EVENT.unpack_from(data, offset))
+
+    # Event times are the low 32 bits of micros(). Unwrap them going backwards from the time of the dump, assuming no
+    # two consecutive events are more than ~71 minutes apart.
+    times = [0] * len(raw)
+    t = now_us
+    for i in reversed(range(len(raw))):
+        us, type_ = raw[i][0], raw[i][1]
+        if type_ == TRACE_OVERWRITTEN:
+            times[i] = None
+            continue
+        t -= ((t & 0xFFFFFFFF) - us) & 0xFFFFFFFF
+        times[i] = t
+
+    lost = recorded - event_count
+    print(f"# {event_count} events, {recorded} recorded since boot ({lost} overwritten before the dump)")
+    print(f"# dumped at uptime {now_us / 1e6:.6f} s")
+    for (us, type_, arg0, arg1, arg2), t in zip(raw, times):
+        if type_ == TRACE_OVERWRITTEN:
+            print(f"{'?':>16}  overwritten while downloading")
+            continue
+        name, fmt = EVENTS.get(type_, (f"unknown_{type_}", lambda a0, a1, a2: f"args={a0},{a1},{a2}"))
+        print(f"{t / 1e6:16.6f}  {name:<20} {fmt(arg0, arg1, arg2)}".rstrip())
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"Usage: {sys.argv[0]} <trace.bin | ->", file=sys.stderr)
+        sys.exit(1)
+    if sys.argv[1] == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(sys.argv[1], 'rb') as f:
+            data = f.read()
+    try:
+        decode(data)
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Host side of deferred logging (debug.deferred in the config). The firmware only stores a hash of each debugf() format
+# string and its raw arguments; this formats them back using a table of the format strings in the sources, which
+# builder.py writes to dlog_table.json in the build directory.
+#
+#   tools/dlog.py table -o dlog_table.json src include
+#   curl -o dlog.bin IP_ADDRESS/dlog
+#   tools/dlog.py decode dlog_table.json dlog.bin
+#   tools/dlog.py follow dlog_table.json http://IP_ADDRESS [-u user:password]
+#
+import argparse
+import base64
+import json
+import os
+import re
+import struct
+import sys
+import time
+import urllib.request
+
+# Must match include/Dlog.h
+DLOG_DUMP_MAGIC = 0x4C445357
+DLOG_DUMP_VERSION = 1
+DLOG_ID_OVERWRITTEN = 0
+HEADER = struct.Struct('<IBBHIIQ')
+RECORD = struct.Struct('<II24s')
+
+ARG_END = 0
+ARG_U32 = 1
+ARG_U64 = 2
+ARG_DOUBLE = 3
+ARG_STR = 4
+ARG_TRUNCATED = 5
+
+SOURCE_EXTENSIONS = ('.c', '.cpp', '.h', '.hpp')
+DEBUGF_RE = re.compile(r'\bdebugf\s*\(\s*((?:"(?:[^"\\\n]|\\.)*"\s*)+)')
+LITERAL_RE = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+ESCAPE_RE = re.compile(r'\\(x[0-9a-fA-F]+|[0-7]{1,3}|.)')
+SIMPLE_ESCAPES = {'n': '\n', 'r': '\r', 't': '\t', 'a': '\a', 'b': '\b', 'f': '\f', 'v': '\v', 'e': '\x1b',
+                  '\\': '\\', '"': '"', "'": "'", '?': '?'}
+CONVERSION_RE = re.compile(r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(hh|h|ll|l|L|z|j|t|q)?([diouxXeEfFgGcsp%])')
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def unescape(literal):
+    def replace(m):
+        e = m.group(1)
+        if e[0] == 'x':
+            return chr(int(e[1:], 16))
+        if e[0] in '01234567':
+            return chr(int(e, 8))
+        return SIMPLE_ESCAPES.get(e, e)
+
+    return ESCAPE_RE.sub(replace, literal)
+
+
+def scan(paths):
+    table = {}
+    for path in paths:
+        for root, _, files in os.walk(path) if os.path.isdir(path) else [('', None, [path])]:
+            for name in sorted(files):
+                if not name.endswith(SOURCE_EXTENSIONS):
+                    continue
+                filename = os.path.join(root, name)
+                with open(filename, encoding='utf-8') as f:
+                    source = f.read()
+                for m in DEBUGF_RE.finditer(source):
+                    fmt = ''.join(unescape(lit) for lit in LITERAL_RE.findall(m.group(1)))
+                    # The compiler sees the source as UTF-8
+                    id_ = f"{fnv1a(fmt.encode('utf-8', 'surrogateescape')):08x}"
+                    line = source.count('\n', 0, m.start()) + 1
+                    if id_ in table and table[id_]['fmt'] != fmt:
+                        raise ValueError(f"{filename}:{line}: format string hash collides with "
+                                         f"{table[id_]['file']}:{table[id_]['line']}, reword one of them")
+                    table.setdefault(id_, {'fmt': fmt, 'file': filename, 'line': line})
+    return table
+
+
+def parse_args(payload):
+    args = []
+    truncated = False
+    i = 0
+    while i < len(payload):
+        tag = payload[i]
+        i += 1
+        if tag == ARG_END:
+            break
+        elif tag == ARG_TRUNCATED:
+            truncated = True
+            break
+        elif tag == ARG_U32:
+            args.append(struct.unpack_from('<I', payload, i)[0])
+            i += 4
+        elif tag == ARG_U64:
+            args.append(struct.unpack_from('<Q', payload, i)[0])
+            i += 8
+        elif tag == ARG_DOUBLE:
+            args.append(struct.unpack_from('<d', payload, i)[0])
+            i += 8
+        elif tag == ARG_STR:
+            length = payload[i]
+            args.append(payload[i + 1:i + 1 + length].decode('utf-8', 'replace'))
+            i += 1 + length
+        else:
+            raise ValueError(f"Unknown argument tag {tag}")
+    return args, truncated
+
+
+def signed(value, length):
+    if isinstance(value, int):
+        bits = 64 if length in ('ll', 'q', 'j') or value > 0xFFFFFFFF else 32
+        if value >= 1 << (bits - 1):
+            return value - (1 << bits)
+    return value
+
+
+def format_message(fmt, args, truncated):
+    args = list(args)
+
+    def replace(m):
+        flags, width, precision, length, conv = m.groups()
+        if conv == '%':
+            return '%'
+        # The firmware doesn't record * widths separately, they're just arguments
+        if width == '*':
+            width = str(args.pop(0)) if args else ''
+        if precision == '*':
+            precision = str(args.pop(0)) if args else None
+        if not args:
+            return '<?>' if truncated else m.group(0)
+        value = args.pop(0)
+        spec = '%' + flags + (width or '') + ('.' + precision if precision is not None else '')
+        try:
+            if conv in 'di':
+                return (spec + 'd') % signed(value, length)
+            if conv == 'u':
+                return (spec + 'd') % value
+            if conv == 'p':
+                return (spec + '#x') % value
+            if conv == 'c':
+                return (spec + 'c') % chr(value)
+            return (spec + conv) % value
+        except (TypeError, ValueError):
+            return f"<{value!r}>"
+
+    return CONVERSION_RE.sub(replace, fmt)
+
+
+def decode(table, data, file=sys.stdout, since=None):
+    """Prints the records in a dump, returns the sequence number to pass as ?since= to get the following ones."""
+    if len(data) < HEADER.size:
+        raise ValueError("Dump is too short")
+    magic, version, record_size, record_count, first_seq, _, now_us = HEADER.unpack_from(data)
+    if magic != DLOG_DUMP_MAGIC:
+        raise ValueError("Not a Wi-Se deferred log dump")
+    if version != DLOG_DUMP_VERSION or record_size != RECORD.size:
+        raise ValueError(f"Unsupported dump version {version} (record size {record_size})")
+
+    raw = []
+    for i in range(record_count):
+        offset = HEADER.size + i * RECORD.size
+        if offset + RECORD.size > len(data):
+            print(f"# dump truncated after {i} records", file=sys.stderr)
+            break
+        raw.append(RECORD.unpack_from(data, offset))
+
+    # Same as the flight recorder: unwrap the 32-bit micros() going backwards from the time of the dump.
+    times = [None] * len(raw)
+    t = now_us
+    for i in reversed(range(len(raw))):
+        id_, us, _ = raw[i]
+        if id_ == DLOG_ID_OVERWRITTEN:
+            continue
+        t -= ((t & 0xFFFFFFFF) - us) & 0xFFFFFFFF
+        times[i] = t
+
+    if since is None:
+        print(f"# {len(raw)} records from #{first_seq}, dumped at uptime {now_us / 1e6:.6f} s", file=file)
+    elif first_seq > since:
+        print(f"# {first_seq - since} records overwritten before they could be downloaded", file=file)
+    elif first_seq < since:
+        print(f"# device rebooted, restarting from #{first_seq}", file=file)
+    for (id_, us, payload), t in zip(raw, times):
+        if id_ == DLOG_ID_OVERWRITTEN:
+            print(f"{'?':>16}  overwritten while downloading", file=file)
+            continue
+        args, truncated = parse_args(payload)
+        entry = table.get(f"{id_:08x}")
+        if entry is None:
+            message = f"<unknown format {id_:08x}> {args!r}"
+        else:
+            message = format_message(entry['fmt'], args, truncated)
+        print(f"{t / 1e6:16.6f}  {message.rstrip()}", file=file)
+    return first_seq + len(raw)
+
+
+def fetch(url, auth, since):
+    request = urllib.request.Request(f"{url.rstrip('/')}/dlog?since={since}")
+    if auth:
+        request.add_header('Authorization', 'Basic ' + base64.b64encode(auth.encode()).decode())
+    with urllib.request.urlopen(request, timeout=10) as response:
+        return response.read()
+
+
+def load_table(filename):
+    with open(filename) as f:
+        return json.load(f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Wi-Se deferred logging tool")
+    subparsers = parser.add_subparsers(dest='action', required=True)
+
+    p = subparsers.add_parser('table', help="Generate the format string table from the sources")
+    p.add_argument('-o', '--output', default='-')
+    p.add_argument('paths', nargs='+')
+
+    p = subparsers.add_parser('decode', help="Decode a dump downloaded from /dlog")
+    p.add_argument('table')
+    p.add_argument('dump', help="File name, or - for stdin")
+
+    p = subparsers.add_parser('follow', help="Poll /dlog and print new messages as they come")
+    p.add_argument('table')
+    p.add_argument('url', help="e.g. http://192.168.4.1")
+    p.add_argument('-u', '--user', help="user:password for HTTP basic auth")
+    p.add_argument('-i', '--interval', type=float, default=1.0)
+
+    args = parser.parse_args()
+    try:
+        if args.action == 'table':
+            output = json.dumps(scan(args.paths), indent=1, sort_keys=True)
+            if args.output == '-':
+                print(output)
+            else:
+                with open(args.output, 'w') as f:
+                    f.write(output + '\n')
+
+        elif args.action == 'decode':
+            if args.dump == '-':
+                data = sys.stdin.buffer.read()
+            else:
+                with open(args.dump, 'rb') as f:
+                    data = f.read()
+            decode(load_table(args.table), data)
+
+        elif args.action == 'follow':
+            table = load_table(args.table)
+            since = decode(table, fetch(args.url, args.user, 0))
+            while True:
+                time.sleep(args.interval)
+                since = decode(table, fetch(args.url, args.user, since), since=since)
+                sys.stdout.flush()
+
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        sys.exit(1)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()